@@ -2,44 +2,77 @@
 // Based on http://www.6502.org/users/obelisk/6502/reference.html
 // And https://web.archive.org/web/20160406122905/http://homepage.ntlworld.com/cyborgsystems/CS_Main/6502/6502.htm
 
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
 #include <cstring>
 
 #include "6502.h"
-
-#define DEBUG_PRINT 1
-
-#if DEBUG_PRINT
-#include <iostream>
+#include "6502Kernels.h"
+#include "6502Jit.h"
+
+// Build with CPU6502_COMPUTED_GOTO=1 to use computed goto (GCC/Clang extension) instead of the switch
+// in the Switch core. The plain switch measured faster on our hosts so it is the default.
+#if !defined(CPU6502_COMPUTED_GOTO)
+#define CPU6502_COMPUTED_GOTO 0
+#elif CPU6502_COMPUTED_GOTO && !defined(__GNUC__) && !defined(__clang__)
+#error "CPU6502_COMPUTED_GOTO requires GCC or Clang"
 #endif
 
-namespace
-{
-	constexpr uint8_t kBit7Mask = 0b10000000;
-	constexpr uint8_t kBit6Mask = 0b01000000;
-
-	inline int8_t AsInt8(uint8_t value)
-	{
-		return *reinterpret_cast<int8_t*>(&value);
-	}
-}
-
-
-Cpu6502::Cpu6502(Clock& clock, Cpu6502Model model)
+// Expands X(opcode) for each of the 256 opcodes
+#define CPU6502_OPCODE_ROW(X, hi) \
+	X(0x##hi##0) X(0x##hi##1) X(0x##hi##2) X(0x##hi##3) X(0x##hi##4) X(0x##hi##5) X(0x##hi##6) X(0x##hi##7) \
+	X(0x##hi##8) X(0x##hi##9) X(0x##hi##A) X(0x##hi##B) X(0x##hi##C) X(0x##hi##D) X(0x##hi##E) X(0x##hi##F)
+#define CPU6502_OPCODES(X) \
+	CPU6502_OPCODE_ROW(X, 0) CPU6502_OPCODE_ROW(X, 1) CPU6502_OPCODE_ROW(X, 2) CPU6502_OPCODE_ROW(X, 3) \
+	CPU6502_OPCODE_ROW(X, 4) CPU6502_OPCODE_ROW(X, 5) CPU6502_OPCODE_ROW(X, 6) CPU6502_OPCODE_ROW(X, 7) \
+	CPU6502_OPCODE_ROW(X, 8) CPU6502_OPCODE_ROW(X, 9) CPU6502_OPCODE_ROW(X, A) CPU6502_OPCODE_ROW(X, B) \
+	CPU6502_OPCODE_ROW(X, C) CPU6502_OPCODE_ROW(X, D) CPU6502_OPCODE_ROW(X, E) CPU6502_OPCODE_ROW(X, F)
+
+Cpu6502::Cpu6502(Clock& clock, Cpu6502Model model, Cpu6502Core core)
 	: CpuClock(clock)
 	, A(0)
 	, X(0)
 	, Y(0)
 	, SP(0)
 	, PC(0)
-	, F(0)
+	, NResult(0)
+	, ZResult(1)
+	, C(0)
+	, V(0)
+	, D(0)
+	, I(0)
+	, InterruptPending(false)
 	, NextInstruction(0)
+	, InterruptSequence(0)
 	, InstructionCycle(0)
+	, InstructionExtraCycles(0)
 	, InstructionDecoding()
 	, Model(model)
+	, Core(core)
+	, InstructionInfo(model == Cpu6502Model::Original ? InstructionTable<Cpu6502Model::Original> : InstructionTable<Cpu6502Model::Cpu65C02>)
+#if CPU6502_TRACE
+	, Tracer(nullptr)
+	, TraceBase(0)
+	, TraceCycle(0)
+	, TracePC(0)
+#endif
+{
+#if CPU6502_JIT_SUPPORTED
+	if (Core == Cpu6502Core::Jit)
+		JitCompiler = std::make_unique<Jit>();
+#else
+	if (Core == Cpu6502Core::Jit)
+		Core = Cpu6502Core::BlockCache;
+#endif
+	if (Core == Cpu6502Core::BlockCache || Core == Cpu6502Core::Jit)
+		Blocks = std::make_unique<BlockCache>();
+}
+
+Cpu6502::~Cpu6502() = default;
+
+void Cpu6502::PrintOpcodeMap() const
 {
-	Reset();
-#if DEBUG_PRINT
 	const char* collunmName[] = { "0", "1", "2", "3", "4", "5", "6", "7", "8", "9", "A", "B", "C", "D", "E", "F" };
 	printf("  0 1 2 3 4 5 6 7 8 9 A B C D E F\n");
 	for (int i = 0; i < 0x10; ++i)
@@ -52,2390 +85,522 @@ Cpu6502::Cpu6502(Clock& clock, Cpu6502Model model)
 		}
 		printf("\n");
 	}
-#endif
 }
 
 // Information for instruction decoding
-const Cpu6502::InstructionInformation Cpu6502::InstructionInfo[256] =
+// Each entry is (size, cycles, addressing mode, operation), see 6502Kernels.h
+#define CPU6502_INSTRUCTION(size, cycles, mode, operation) Kernels::Instruction<Kernels::mode, Kernels::operation>(size, cycles)
+template <Cpu6502Model MODEL>
+const Cpu6502::InstructionInformation Cpu6502::InstructionTable[256] =
 {
-	/* 00 BRK*/
-	{
-		1,
-		7,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			// The BRK instruction forces the generation of an interrupt request.
-			// The program counter and processor status are pushed on the stack then the 
-			// IRQ interrupt vector at $FFFE/F is loaded into the PC and the break flag 
-			// in the status set to one.
-			cpu->PC += 1;
-			mem[cpu->SP--] = (cpu->PC >> 8) & 0xFF;
-			mem[cpu->SP--] = cpu->PC & 0xFF;
-			cpu->B = 1; // The break flag nneds to be set in the stack version of the flags
-			mem[cpu->SP--] = cpu->F;
-			cpu->B = 0; // reset it to 0 since it should not be set durint the interrupt
+	/* 00 BRK */ CPU6502_INSTRUCTION(1, 7, Implied, Brk),
+	/* 01 ORA (Indirect,X) */ CPU6502_INSTRUCTION(2, 6, IndexedIndirect, Ora),
+	/* 02 */ Kernels::Illegal(),
+	/* 03 */ Kernels::Illegal(),
+	/* 04 */ Kernels::Illegal(),
+	/* 05 ORA ZeroPage */ CPU6502_INSTRUCTION(2, 3, ZeroPage, Ora),
+	/* 06 ASL ZeroPage */ CPU6502_INSTRUCTION(2, 5, ZeroPage, Asl),
+	/* 07 */ Kernels::Illegal(),
+	/* 08 PHP */ CPU6502_INSTRUCTION(1, 3, Implied, Php),
+	/* 09 ORA Immediate */ CPU6502_INSTRUCTION(2, 2, Immediate, Ora),
+	/* 0A ASL A */ CPU6502_INSTRUCTION(1, 2, Accumulator, Asl),
+	/* 0B */ Kernels::Illegal(),
+	/* 0C */ Kernels::Illegal(),
+	/* 0D ORA Absolute */ CPU6502_INSTRUCTION(3, 4, Absolute, Ora),
+	/* 0E ASL Absolute */ CPU6502_INSTRUCTION(3, 6, Absolute, Asl),
+	/* 0F */ Kernels::Illegal(),
+	/* 10 BPL */ CPU6502_INSTRUCTION(2, 2, Relative, Bpl),
+	/* 11 ORA (Indirect),Y */ CPU6502_INSTRUCTION(2, 5, IndirectIndexed, Ora),
+	/* 12 */ Kernels::Illegal(),
+	/* 13 */ Kernels::Illegal(),
+	/* 14 */ Kernels::Illegal(),
+	/* 15 ORA ZeroPage,X */ CPU6502_INSTRUCTION(2, 4, ZeroPageX, Ora),
+	/* 16 ASL ZeroPage,X */ CPU6502_INSTRUCTION(2, 6, ZeroPageX, Asl),
+	/* 17 */ Kernels::Illegal(),
+	/* 18 CLC */ CPU6502_INSTRUCTION(1, 2, Implied, Clc),
+	/* 19 ORA Absolute,Y */ CPU6502_INSTRUCTION(3, 4, AbsoluteY, Ora),
+	/* 1A */ Kernels::Illegal(),
+	/* 1B */ Kernels::Illegal(),
+	/* 1C */ Kernels::Illegal(),
+	/* 1D ORA Absolute,X */ CPU6502_INSTRUCTION(3, 4, AbsoluteX, Ora),
+	/* 1E ASL Absolute,X */ CPU6502_INSTRUCTION(3, 7, AbsoluteX, Asl),
+	/* 1F */ Kernels::Illegal(),
+	/* 20 JSR Absolute */ CPU6502_INSTRUCTION(3, 6, Absolute, Jsr),
+	/* 21 AND (Indirect,X) */ CPU6502_INSTRUCTION(2, 6, IndexedIndirect, And),
+	/* 22 */ Kernels::Illegal(),
+	/* 23 */ Kernels::Illegal(),
+	/* 24 BIT ZeroPage */ CPU6502_INSTRUCTION(2, 3, ZeroPage, Bit),
+	/* 25 AND ZeroPage */ CPU6502_INSTRUCTION(2, 3, ZeroPage, And),
+	/* 26 ROL ZeroPage */ CPU6502_INSTRUCTION(2, 5, ZeroPage, Rol),
+	/* 27 */ Kernels::Illegal(),
+	/* 28 PLP */ CPU6502_INSTRUCTION(1, 4, Implied, Plp),
+	/* 29 AND Immediate */ CPU6502_INSTRUCTION(2, 2, Immediate, And),
+	/* 2A ROL A */ CPU6502_INSTRUCTION(1, 2, Accumulator, Rol),
+	/* 2B */ Kernels::Illegal(),
+	/* 2C BIT Absolute */ CPU6502_INSTRUCTION(3, 4, Absolute, Bit),
+	/* 2D AND Absolute */ CPU6502_INSTRUCTION(3, 4, Absolute, And),
+	/* 2E ROL Absolute */ CPU6502_INSTRUCTION(3, 6, Absolute, Rol),
+	/* 2F */ Kernels::Illegal(),
+	/* 30 BMI */ CPU6502_INSTRUCTION(2, 2, Relative, Bmi),
+	/* 31 AND (Indirect),Y */ CPU6502_INSTRUCTION(2, 5, IndirectIndexed, And),
+	/* 32 */ Kernels::Illegal(),
+	/* 33 */ Kernels::Illegal(),
+	/* 34 */ Kernels::Illegal(),
+	/* 35 AND ZeroPage,X */ CPU6502_INSTRUCTION(2, 4, ZeroPageX, And),
+	/* 36 ROL ZeroPage,X */ CPU6502_INSTRUCTION(2, 6, ZeroPageX, Rol),
+	/* 37 */ Kernels::Illegal(),
+	/* 38 SEC */ CPU6502_INSTRUCTION(1, 2, Implied, Sec),
+	/* 39 AND Absolute,Y */ CPU6502_INSTRUCTION(3, 4, AbsoluteY, And),
+	/* 3A */ Kernels::Illegal(),
+	/* 3B */ Kernels::Illegal(),
+	/* 3C */ Kernels::Illegal(),
+	/* 3D AND Absolute,X */ CPU6502_INSTRUCTION(3, 4, AbsoluteX, And),
+	/* 3E ROL Absolute,X */ CPU6502_INSTRUCTION(3, 7, AbsoluteX, Rol),
+	/* 3F */ Kernels::Illegal(),
+	/* 40 RTI */ CPU6502_INSTRUCTION(1, 6, Implied, Rti),
+	/* 41 EOR (Indirect,X) */ CPU6502_INSTRUCTION(2, 6, IndexedIndirect, Eor),
+	/* 42 */ Kernels::Illegal(),
+	/* 43 */ Kernels::Illegal(),
+	/* 44 */ Kernels::Illegal(),
+	/* 45 EOR ZeroPage */ CPU6502_INSTRUCTION(2, 3, ZeroPage, Eor),
+	/* 46 LSR ZeroPage */ CPU6502_INSTRUCTION(2, 5, ZeroPage, Lsr),
+	/* 47 */ Kernels::Illegal(),
+	/* 48 PHA */ CPU6502_INSTRUCTION(1, 3, Implied, Pha),
+	/* 49 EOR Immediate */ CPU6502_INSTRUCTION(2, 2, Immediate, Eor),
+	/* 4A LSR A */ CPU6502_INSTRUCTION(1, 2, Accumulator, Lsr),
+	/* 4B */ Kernels::Illegal(),
+	/* 4C JMP Absolute */ CPU6502_INSTRUCTION(3, 3, Absolute, Jmp),
+	/* 4D EOR Absolute */ CPU6502_INSTRUCTION(3, 4, Absolute, Eor),
+	/* 4E LSR Absolute */ CPU6502_INSTRUCTION(3, 6, Absolute, Lsr),
+	/* 4F */ Kernels::Illegal(),
+	/* 50 BVC */ CPU6502_INSTRUCTION(2, 2, Relative, Bvc),
+	/* 51 EOR (Indirect),Y */ CPU6502_INSTRUCTION(2, 5, IndirectIndexed, Eor),
+	/* 52 */ Kernels::Illegal(),
+	/* 53 */ Kernels::Illegal(),
+	/* 54 */ Kernels::Illegal(),
+	/* 55 EOR ZeroPage,X */ CPU6502_INSTRUCTION(2, 4, ZeroPageX, Eor),
+	/* 56 LSR ZeroPage,X */ CPU6502_INSTRUCTION(2, 6, ZeroPageX, Lsr),
+	/* 57 */ Kernels::Illegal(),
+	/* 58 CLI */ CPU6502_INSTRUCTION(1, 2, Implied, Cli),
+	/* 59 EOR Absolute,Y */ CPU6502_INSTRUCTION(3, 4, AbsoluteY, Eor),
+	/* 5A */ Kernels::Illegal(),
+	/* 5B */ Kernels::Illegal(),
+	/* 5C */ Kernels::Illegal(),
+	/* 5D EOR Absolute,X */ CPU6502_INSTRUCTION(3, 4, AbsoluteX, Eor),
+	/* 5E LSR Absolute,X */ CPU6502_INSTRUCTION(3, 7, AbsoluteX, Lsr),
+	/* 5F */ Kernels::Illegal(),
+	/* 60 RTS */ CPU6502_INSTRUCTION(1, 6, Implied, Rts),
+	/* 61 ADC (Indirect,X) */ CPU6502_INSTRUCTION(2, 6, IndexedIndirect, Adc),
+	/* 62 */ Kernels::Illegal(),
+	/* 63 */ Kernels::Illegal(),
+	/* 64 */ Kernels::Illegal(),
+	/* 65 ADC ZeroPage */ CPU6502_INSTRUCTION(2, 3, ZeroPage, Adc),
+	/* 66 ROR ZeroPage */ CPU6502_INSTRUCTION(2, 5, ZeroPage, Ror),
+	/* 67 */ Kernels::Illegal(),
+	/* 68 PLA */ CPU6502_INSTRUCTION(1, 4, Implied, Pla),
+	/* 69 ADC Immediate */ CPU6502_INSTRUCTION(2, 2, Immediate, Adc),
+	/* 6A ROR A */ CPU6502_INSTRUCTION(1, 2, Accumulator, Ror),
+	/* 6B */ Kernels::Illegal(),
+	/* 6C JMP Indirect */ CPU6502_INSTRUCTION(3, MODEL == Cpu6502Model::Original ? 5 : 6, Indirect<MODEL>, Jmp), // 65C02 takes a cycle to fix the page wrap
+	/* 6D ADC Absolute */ CPU6502_INSTRUCTION(3, 4, Absolute, Adc),
+	/* 6E ROR Absolute */ CPU6502_INSTRUCTION(3, 6, Absolute, Ror),
+	/* 6F */ Kernels::Illegal(),
+	/* 70 BVS */ CPU6502_INSTRUCTION(2, 2, Relative, Bvs),
+	/* 71 ADC (Indirect),Y */ CPU6502_INSTRUCTION(2, 5, IndirectIndexed, Adc),
+	/* 72 */ Kernels::Illegal(),
+	/* 73 */ Kernels::Illegal(),
+	/* 74 */ Kernels::Illegal(),
+	/* 75 ADC ZeroPage,X */ CPU6502_INSTRUCTION(2, 4, ZeroPageX, Adc),
+	/* 76 ROR ZeroPage,X */ CPU6502_INSTRUCTION(2, 6, ZeroPageX, Ror),
+	/* 77 */ Kernels::Illegal(),
+	/* 78 SEI */ CPU6502_INSTRUCTION(1, 2, Implied, Sei),
+	/* 79 ADC Absolute,Y */ CPU6502_INSTRUCTION(3, 4, AbsoluteY, Adc),
+	/* 7A */ Kernels::Illegal(),
+	/* 7B */ Kernels::Illegal(),
+	/* 7C */ Kernels::Illegal(),
+	/* 7D ADC Absolute,X */ CPU6502_INSTRUCTION(3, 4, AbsoluteX, Adc),
+	/* 7E ROR Absolute,X */ CPU6502_INSTRUCTION(3, 7, AbsoluteX, Ror),
+	/* 7F */ Kernels::Illegal(),
+	/* 80 */ Kernels::Illegal(),
+	/* 81 STA (Indirect,X) */ CPU6502_INSTRUCTION(2, 6, IndexedIndirect, Sta),
+	/* 82 */ Kernels::Illegal(),
+	/* 83 */ Kernels::Illegal(),
+	/* 84 STY ZeroPage */ CPU6502_INSTRUCTION(2, 3, ZeroPage, Sty),
+	/* 85 STA ZeroPage */ CPU6502_INSTRUCTION(2, 3, ZeroPage, Sta),
+	/* 86 STX ZeroPage */ CPU6502_INSTRUCTION(2, 3, ZeroPage, Stx),
+	/* 87 */ Kernels::Illegal(),
+	/* 88 DEY */ CPU6502_INSTRUCTION(1, 2, Implied, Dey),
+	/* 89 */ Kernels::Illegal(),
+	/* 8A TXA */ CPU6502_INSTRUCTION(1, 2, Implied, Txa),
+	/* 8B */ Kernels::Illegal(),
+	/* 8C STY Absolute */ CPU6502_INSTRUCTION(3, 4, Absolute, Sty),
+	/* 8D STA Absolute */ CPU6502_INSTRUCTION(3, 4, Absolute, Sta),
+	/* 8E STX Absolute */ CPU6502_INSTRUCTION(3, 4, Absolute, Stx),
+	/* 8F */ Kernels::Illegal(),
+	/* 90 BCC */ CPU6502_INSTRUCTION(2, 2, Relative, Bcc),
+	/* 91 STA (Indirect),Y */ CPU6502_INSTRUCTION(2, 6, IndirectIndexed, Sta),
+	/* 92 */ Kernels::Illegal(),
+	/* 93 */ Kernels::Illegal(),
+	/* 94 STY ZeroPage,X */ CPU6502_INSTRUCTION(2, 4, ZeroPageX, Sty),
+	/* 95 STA ZeroPage,X */ CPU6502_INSTRUCTION(2, 4, ZeroPageX, Sta),
+	/* 96 STX ZeroPage,Y */ CPU6502_INSTRUCTION(2, 4, ZeroPageY, Stx),
+	/* 97 */ Kernels::Illegal(),
+	/* 98 TYA */ CPU6502_INSTRUCTION(1, 2, Implied, Tya),
+	/* 99 STA Absolute,Y */ CPU6502_INSTRUCTION(3, 5, AbsoluteY, Sta),
+	/* 9A TXS */ CPU6502_INSTRUCTION(1, 2, Implied, Txs),
+	/* 9B */ Kernels::Illegal(),
+	/* 9C */ Kernels::Illegal(),
+	/* 9D STA Absolute,X */ CPU6502_INSTRUCTION(3, 5, AbsoluteX, Sta),
+	/* 9E */ Kernels::Illegal(),
+	/* 9F */ Kernels::Illegal(),
+	/* A0 LDY Immediate */ CPU6502_INSTRUCTION(2, 2, Immediate, Ldy),
+	/* A1 LDA (Indirect,X) */ CPU6502_INSTRUCTION(2, 6, IndexedIndirect, Lda),
+	/* A2 LDX Immediate */ CPU6502_INSTRUCTION(2, 2, Immediate, Ldx),
+	/* A3 */ Kernels::Illegal(),
+	/* A4 LDY ZeroPage */ CPU6502_INSTRUCTION(2, 3, ZeroPage, Ldy),
+	/* A5 LDA ZeroPage */ CPU6502_INSTRUCTION(2, 3, ZeroPage, Lda),
+	/* A6 LDX ZeroPage */ CPU6502_INSTRUCTION(2, 3, ZeroPage, Ldx),
+	/* A7 */ Kernels::Illegal(),
+	/* A8 TAY */ CPU6502_INSTRUCTION(1, 2, Implied, Tay),
+	/* A9 LDA Immediate */ CPU6502_INSTRUCTION(2, 2, Immediate, Lda),
+	/* AA TAX */ CPU6502_INSTRUCTION(1, 2, Implied, Tax),
+	/* AB */ Kernels::Illegal(),
+	/* AC LDY Absolute */ CPU6502_INSTRUCTION(3, 4, Absolute, Ldy),
+	/* AD LDA Absolute */ CPU6502_INSTRUCTION(3, 4, Absolute, Lda),
+	/* AE LDX Absolute */ CPU6502_INSTRUCTION(3, 4, Absolute, Ldx),
+	/* AF */ Kernels::Illegal(),
+	/* B0 BCS */ CPU6502_INSTRUCTION(2, 2, Relative, Bcs),
+	/* B1 LDA (Indirect),Y */ CPU6502_INSTRUCTION(2, 5, IndirectIndexed, Lda),
+	/* B2 */ Kernels::Illegal(),
+	/* B3 */ Kernels::Illegal(),
+	/* B4 LDY ZeroPage,X */ CPU6502_INSTRUCTION(2, 4, ZeroPageX, Ldy),
+	/* B5 LDA ZeroPage,X */ CPU6502_INSTRUCTION(2, 4, ZeroPageX, Lda),
+	/* B6 LDX ZeroPage,Y */ CPU6502_INSTRUCTION(2, 4, ZeroPageY, Ldx),
+	/* B7 */ Kernels::Illegal(),
+	/* B8 CLV */ CPU6502_INSTRUCTION(1, 2, Implied, Clv),
+	/* B9 LDA Absolute,Y */ CPU6502_INSTRUCTION(3, 4, AbsoluteY, Lda),
+	/* BA TSX */ CPU6502_INSTRUCTION(1, 2, Implied, Tsx),
+	/* BB */ Kernels::Illegal(),
+	/* BC LDY Absolute,X */ CPU6502_INSTRUCTION(3, 4, AbsoluteX, Ldy),
+	/* BD LDA Absolute,X */ CPU6502_INSTRUCTION(3, 4, AbsoluteX, Lda),
+	/* BE LDX Absolute,Y */ CPU6502_INSTRUCTION(3, 4, AbsoluteY, Ldx),
+	/* BF */ Kernels::Illegal(),
+	/* C0 CPY Immediate */ CPU6502_INSTRUCTION(2, 2, Immediate, Cpy),
+	/* C1 CMP (Indirect,X) */ CPU6502_INSTRUCTION(2, 6, IndexedIndirect, Cmp),
+	/* C2 */ Kernels::Illegal(),
+	/* C3 */ Kernels::Illegal(),
+	/* C4 CPY ZeroPage */ CPU6502_INSTRUCTION(2, 3, ZeroPage, Cpy),
+	/* C5 CMP ZeroPage */ CPU6502_INSTRUCTION(2, 3, ZeroPage, Cmp),
+	/* C6 DEC ZeroPage */ CPU6502_INSTRUCTION(2, 5, ZeroPage, Dec),
+	/* C7 */ Kernels::Illegal(),
+	/* C8 INY */ CPU6502_INSTRUCTION(1, 2, Implied, Iny),
+	/* C9 CMP Immediate */ CPU6502_INSTRUCTION(2, 2, Immediate, Cmp),
+	/* CA DEX */ CPU6502_INSTRUCTION(1, 2, Implied, Dex),
+	/* CB */ Kernels::Illegal(),
+	/* CC CPY Absolute */ CPU6502_INSTRUCTION(3, 4, Absolute, Cpy),
+	/* CD CMP Absolute */ CPU6502_INSTRUCTION(3, 4, Absolute, Cmp),
+	/* CE DEC Absolute */ CPU6502_INSTRUCTION(3, 6, Absolute, Dec),
+	/* CF */ Kernels::Illegal(),
+	/* D0 BNE */ CPU6502_INSTRUCTION(2, 2, Relative, Bne),
+	/* D1 CMP (Indirect),Y */ CPU6502_INSTRUCTION(2, 5, IndirectIndexed, Cmp),
+	/* D2 */ Kernels::Illegal(),
+	/* D3 */ Kernels::Illegal(),
+	/* D4 */ Kernels::Illegal(),
+	/* D5 CMP ZeroPage,X */ CPU6502_INSTRUCTION(2, 4, ZeroPageX, Cmp),
+	/* D6 DEC ZeroPage,X */ CPU6502_INSTRUCTION(2, 6, ZeroPageX, Dec),
+	/* D7 */ Kernels::Illegal(),
+	/* D8 CLD */ CPU6502_INSTRUCTION(1, 2, Implied, Cld),
+	/* D9 CMP Absolute,Y */ CPU6502_INSTRUCTION(3, 4, AbsoluteY, Cmp),
+	/* DA */ Kernels::Illegal(),
+	/* DB */ Kernels::Illegal(),
+	/* DC */ Kernels::Illegal(),
+	/* DD CMP Absolute,X */ CPU6502_INSTRUCTION(3, 4, AbsoluteX, Cmp),
+	/* DE DEC Absolute,X */ CPU6502_INSTRUCTION(3, 7, AbsoluteX, Dec),
+	/* DF */ Kernels::Illegal(),
+	/* E0 CPX Immediate */ CPU6502_INSTRUCTION(2, 2, Immediate, Cpx),
+	/* E1 SBC (Indirect,X) */ CPU6502_INSTRUCTION(2, 6, IndexedIndirect, Sbc),
+	/* E2 */ Kernels::Illegal(),
+	/* E3 */ Kernels::Illegal(),
+	/* E4 CPX ZeroPage */ CPU6502_INSTRUCTION(2, 3, ZeroPage, Cpx),
+	/* E5 SBC ZeroPage */ CPU6502_INSTRUCTION(2, 3, ZeroPage, Sbc),
+	/* E6 INC ZeroPage */ CPU6502_INSTRUCTION(2, 5, ZeroPage, Inc),
+	/* E7 */ Kernels::Illegal(),
+	/* E8 INX */ CPU6502_INSTRUCTION(1, 2, Implied, Inx),
+	/* E9 SBC Immediate */ CPU6502_INSTRUCTION(2, 2, Immediate, Sbc),
+	/* EA NOP */ CPU6502_INSTRUCTION(1, 2, Implied, Nop),
+	/* EB */ Kernels::Illegal(),
+	/* EC CPX Absolute */ CPU6502_INSTRUCTION(3, 4, Absolute, Cpx),
+	/* ED SBC Absolute */ CPU6502_INSTRUCTION(3, 4, Absolute, Sbc),
+	/* EE INC Absolute */ CPU6502_INSTRUCTION(3, 6, Absolute, Inc),
+	/* EF */ Kernels::Illegal(),
+	/* F0 BEQ */ CPU6502_INSTRUCTION(2, 2, Relative, Beq),
+	/* F1 SBC (Indirect),Y */ CPU6502_INSTRUCTION(2, 5, IndirectIndexed, Sbc),
+	/* F2 */ Kernels::Illegal(),
+	/* F3 */ Kernels::Illegal(),
+	/* F4 */ Kernels::Illegal(),
+	/* F5 SBC ZeroPage,X */ CPU6502_INSTRUCTION(2, 4, ZeroPageX, Sbc),
+	/* F6 INC ZeroPage,X */ CPU6502_INSTRUCTION(2, 6, ZeroPageX, Inc),
+	/* F7 */ Kernels::Illegal(),
+	/* F8 SED */ CPU6502_INSTRUCTION(1, 2, Implied, Sed),
+	/* F9 SBC Absolute,Y */ CPU6502_INSTRUCTION(3, 4, AbsoluteY, Sbc),
+	/* FA */ Kernels::Illegal(),
+	/* FB */ Kernels::Illegal(),
+	/* FC */ Kernels::Illegal(),
+	/* FD SBC Absolute,X */ CPU6502_INSTRUCTION(3, 4, AbsoluteX, Sbc),
+	/* FE INC Absolute,X */ CPU6502_INSTRUCTION(3, 7, AbsoluteX, Inc),
+	/* FF */ Kernels::Illegal(),
+};
+#undef CPU6502_INSTRUCTION
 
-			cpu->PC = combineAddr(mem[0xFFFE], mem[0xFFFF]);
-		},
-		[](Cpu6502* cpu, Memory64k& mem) ->uint8_t { return 0; }
-	},
-	/* 01 ORA (ind,X) */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t zpAddr = cpu->InstructionDecoding[1] + cpu->X;
-			uint16_t addr = combineAddr(mem[zpAddr], mem[(zpAddr + 1) & 0xFF]);// indirrect Zero Page
-			cpu->A = cpu->A | mem[addr];
-			cpu->N = (cpu->A & kBit7Mask);
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0;  }
-	},
-	/* 02 XXX*/			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 03 XXX*/			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 04 XXX*/			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 05 ORA Zero Page */
-	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->A = cpu->A | mem[cpu->InstructionDecoding[1]];
-			cpu->N = (cpu->A & kBit7Mask);
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 06 ASL ZeroPage */
-	{
-		2,
-		5,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = cpu->InstructionDecoding[1];
-			cpu->C = (mem[addr] & kBit7Mask) != 0;
-			mem[addr] <<= 1;
-			cpu->Z = mem[addr] == 0;
-			cpu->N = (mem[addr] & kBit7Mask);
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 07 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 08 PHP */
-	{
-		1, 
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			mem[cpu->SP--] = cpu->F;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 09 ORA Immediate */
-	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->A = cpu->A | cpu->InstructionDecoding[1];
-			cpu->N = (cpu->A & kBit7Mask);
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 0A ASL A */
-	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->C = (cpu->A & kBit7Mask) != 0;
-			cpu->A <<= 1;
-			cpu->Z = cpu->A == 0;
-			cpu->N = (cpu->A & kBit7Mask);
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 0B */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 0C */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 0D ORA Absolute */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			cpu->A = cpu->A | mem[addr];
-			cpu->N = (cpu->A & kBit7Mask);
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 0E ALS Absolute*/
-	{
-		3,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			cpu->C = (mem[addr] & kBit7Mask) != 0;
-			mem[addr] <<= 1;
-			cpu->Z = mem[addr] == 0;
-			cpu->N = (mem[addr] & kBit7Mask);
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 0F */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 10 BPL (branch if negative flag clear) */
-	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			if (cpu->N == 0)
-			{
-				cpu->PC += AsInt8(cpu->InstructionDecoding[1]);
-			}
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// Add 1 cycle if a the branch occurs and the destination address is on the same Page
-			// Add 2 cycle if a the branch occurs and the destination address is on a different Page
-			if (cpu->N != 0)
-				return 0;
-			return ((cpu->PC & 0xFF) + cpu->InstructionDecoding[1]) > 0xFF ? 2 : 1;
-		}
-	},
-	/* 11 ORA (Indirect), Y */
-	{
-		2,
-		5,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t zpAddr = cpu->InstructionDecoding[1];
-			uint16_t addr = combineAddr(mem[zpAddr], mem[(zpAddr + 1) & 0xFF]) + cpu->Y;// indirrect Zero Page
-			cpu->A = cpu->A | mem[addr];
-			cpu->N = (cpu->A & kBit7Mask);
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t 
-		{
-			return uint16_t(mem[cpu->InstructionDecoding[1]]) + cpu->Y > 0xFF ? 1 : 0;
-		}
-	},
-	/* 12 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 13 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 14 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 15 ORA Zero Page,X */
-	{
-		2,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = cpu->InstructionDecoding[1] + cpu->X;
-			cpu->A = cpu->A | mem[addr];
-			cpu->N = (cpu->A & kBit7Mask);
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 16 ASL ZeroPage,X */
-	{
-		2,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = cpu->InstructionDecoding[1] + cpu->X;
-			cpu->C = (mem[addr] & kBit7Mask) != 0;
-			mem[addr] <<= 1;
-			cpu->Z = mem[addr] == 0;
-			cpu->N = (mem[addr] & kBit7Mask);
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 17 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 18 CLC */
-	{
-		1, 
-		2, 
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->C = 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 19 ORA Absolute,Y */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->Y;
-			cpu->A = cpu->A | mem[addr];
-			cpu->N = (cpu->A & kBit7Mask);
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// ADD 1 cycle if page boundary crossed
-			return uint16_t(mem[cpu->InstructionDecoding[1]]) + cpu->Y > 0xFF ? 1 : 0;
-		}
-	},
-	/* 1A */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 1B */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 1C */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 1D ORA Absolute,X */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->X;
-			cpu->A = cpu->A | mem[addr];
-			cpu->N = (cpu->A & kBit7Mask);
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// ADD 1 cycle if page boundary crossed
-			return uint16_t(mem[cpu->InstructionDecoding[1]]) + cpu->X > 0xFF ? 1 : 0;
-		}
-	},
-	/* 1E */
-	{
-		3,
-		7,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->X;
-			cpu->C = (mem[addr] & kBit7Mask) != 0;
-			mem[addr] <<= 1;
-			cpu->Z = mem[addr] == 0;
-			cpu->N = (mem[addr] & kBit7Mask);
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 1F */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 20 JSR Absolute */
-	{
-		3,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = cpu->PC - 1;
-			mem[cpu->SP--] = (addr >> 8) & 0xFF;
-			mem[cpu->SP--] = addr & 0xFF;
-			cpu->PC = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-		},
-		[](Cpu6502* cpu, Memory64k& mem) ->uint8_t { return 0; }
-	},
-	/* 21 AND (Indirrect,X) */
-	{
-		2,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t zpAddr = cpu->InstructionDecoding[1] + cpu->X;
-			uint16_t addr = combineAddr(mem[zpAddr], mem[(zpAddr + 1) & 0xFF]);// indirrect Zero Page
-			cpu->C = (mem[addr] & kBit7Mask) != 0;
-			mem[addr] <<= 1;
-			cpu->Z = mem[addr] == 0;
-			cpu->N = (mem[addr] & kBit7Mask);
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 22 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 23 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 24 BIT ZeroPage*/
-	{
-		2,
-		3, 
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = cpu->InstructionDecoding[1];
-			uint8_t temp = cpu->A & mem[addr];
-			cpu->N = (temp & kBit7Mask) > 0;
-			cpu->V = (temp & kBit6Mask) > 0;
-			cpu->Z = temp == 0;
-		}, 
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 25 AND_ZeroPage*/
-	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = cpu->InstructionDecoding[1];
-			uint8_t data = cpu->A &= mem[addr];
-			cpu->N = data & kBit7Mask;
-			cpu->Z = data == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			return 0;
-		}
-	},
-	/* 26 ROL Zero Page */
-	{
-		2,
-		5,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t& data = mem[cpu->InstructionDecoding[1]];
-			uint8_t newCarry = data & kBit7Mask ? 1 : 0;
-			data = ((data << 1) & 0xFE) | cpu->C;
-			cpu->C = newCarry;
-			cpu->Z = data == 0;
-			cpu->N = data & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 27 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 28 PLA */
-	{
-		1,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->F = mem[++cpu->SP];
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 29 AND_IMMEDIATE */
-	{
-		2, 
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t data = cpu->A &= cpu->InstructionDecoding[1];
-			cpu->N = data & kBit7Mask;
-			cpu->Z = data == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 2A ROL Accumulator */
-	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t newCarry = cpu->A & kBit7Mask ? 1 : 0;
-			cpu->A = ((cpu->A << 1) & 0xFE) | cpu->C;
-			cpu->C = newCarry;
-			cpu->Z = cpu->A == 0;
-			cpu->N = cpu->A & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 2B */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 2C BIT Absolute*/
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			uint8_t temp = cpu->A & mem[addr];
-			cpu->N = (temp & kBit7Mask) > 0;
-			cpu->V = (temp & kBit6Mask) > 0;
-			cpu->Z = temp == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 2D AND_Absolute */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			uint8_t data = cpu->A &= mem[addr];
-			cpu->N = data & kBit7Mask;
-			cpu->Z = data == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 2E ROL Absolute */
-	{
-		3,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			uint8_t& data = mem[addr];
-			uint8_t newCarry = data & kBit7Mask ? 1 : 0;
-			data = ((data << 1) & 0xFE) | cpu->C;
-			cpu->C = newCarry;
-			cpu->Z = data == 0;
-			cpu->N = data & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 2F */			{ 0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 30 BMI (branch if negative flag set) */
-	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			if (cpu->N == 1)
-			{
-				cpu->PC += AsInt8(cpu->InstructionDecoding[1]);
-			}
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// Add 1 cycle if a the branch occurs and the destination address is on the same Page
-			// Add 2 cycle if a the branch occurs and the destination address is on a different Page
-			if (cpu->N != 1)
-				return 0;
-			return ((cpu->PC & 0xFF) + cpu->InstructionDecoding[1]) > 0xFF ? 2 : 1;
-		}
-	},
-	/* 31 AND (Indirrect),Y */
-	{
-		2,
-		5,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			// TODO : figure out that indirrection....
-			uint16_t addr = mem[cpu->InstructionDecoding[1]] + cpu->Y;
-			cpu->C = (mem[addr] & kBit7Mask) != 0;
-			mem[addr] <<= 1;
-			cpu->Z = mem[addr] == 0;
-			cpu->N = (mem[addr] & kBit7Mask);
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// ADD 1 cycle if page boundary crossed
-			return uint16_t(mem[cpu->InstructionDecoding[1]]) + cpu->Y > 0xFF ? 1 : 0;
-		}
-	},
-	/* 32 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 33 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 34 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 35 AND ZeroPage,X */
-	{
-		2,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = cpu->InstructionDecoding[1] + cpu->X;
-			uint8_t data = cpu->A &= mem[addr];
-			cpu->N = data & kBit7Mask;
-			cpu->Z = data == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 36 ROL Zero Page,X */
-	{
-		2,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = cpu->InstructionDecoding[1] + cpu->X;
-			uint8_t& data = mem[addr];
-			uint8_t newCarry = data & kBit7Mask ? 1 : 0;
-			data = ((data << 1) & 0xFE) | cpu->C;
-			cpu->C = newCarry;
-			cpu->Z = data == 0;
-			cpu->N = data & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 37 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 38 SEC */
-	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->C = 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 39 AND_Absolute,Y */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->Y;
-			uint8_t data = cpu->A &= mem[addr];
-			cpu->N = data & kBit7Mask;
-			cpu->Z = data == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// ADD 1 cycle if page boundary crossed
-			return cpu->InstructionDecoding[1] + cpu->Y > 0xFF ? 1 : 0;
-		}
-	},
-	/* 3A */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 3B */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 3C */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 3D AND_Absolute,X */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->X;
-			uint8_t data = cpu->A &= mem[addr];
-			cpu->N = data & kBit7Mask;
-			cpu->Z = data == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// ADD 1 cycle if page boundary crossed
-			return cpu->InstructionDecoding[1] + cpu->X > 0xFF ? 1 : 0;
-		}
-	},
-	/* 3E ROL Absolute */
-	{
-		3,
-		7,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->X;
-			uint8_t& data = mem[addr];
-			uint8_t newCarry = data & kBit7Mask ? 1 : 0;
-			data = ((data << 1) & 0xFE) | cpu->C;
-			cpu->C = newCarry;
-			cpu->Z = data == 0;
-			cpu->N = data & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 3F */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 40 RTI */
-	{
-		1,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem) 
-		{
-			cpu->F = mem[++cpu->SP];
-			cpu->PC = mem[++cpu->SP] | (mem[++cpu->SP] << 8);
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 41 EOR (Indirect,X) TODO */
-	{
-		2,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t zpAddr = cpu->InstructionDecoding[1] + cpu->X;
-			uint16_t addr = combineAddr(mem[zpAddr], mem[(zpAddr + 1) & 0xFF]);// indirrect Zero Page
-			cpu->A = cpu->A ^ mem[addr];
-			cpu->N = cpu->A & kBit7Mask;
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 42 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 43 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 44 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 45 EOR ZeroPage */
-	{
-		2,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->A = cpu->A ^ mem[cpu->InstructionDecoding[1]];
-			cpu->N = cpu->A & kBit7Mask;
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 46 LSR ZeroPage */
-	{
-		2,
-		5,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t& data = mem[cpu->InstructionDecoding[1]];
-			cpu->N = 0;
-			cpu->C = data & 1;
-			data = (data >> 1) & 0x7F;
-			cpu->Z = data == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 47 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 48 PHA */
-	{
-		1,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			mem[cpu->SP--] = cpu->A;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 49 EOR Immediate */
-	{
-		2, 
-		2, 
-		[](Cpu6502* cpu, Memory64k& mem) 
-		{
-			cpu->A = cpu->A ^ cpu->InstructionDecoding[1];
-			cpu->N = cpu->A & kBit7Mask;
-			cpu->Z = cpu->A == 0;
-		}, 
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } 
-	},
-	/* 4A LSR A */
-	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->N = 0;
-			cpu->C = cpu->A & 1;
-			cpu->A = (cpu->A >> 1) & 0x7F;
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 4B */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 4C JMP Absolute */
-	{
-		3,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			cpu->PC = addr;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 4D EOR Absolute */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			cpu->A = cpu->A ^ mem[addr];
-			cpu->N = cpu->A & kBit7Mask;
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 4E LSR Absolute */
-	{
-		3,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			uint8_t& data = mem[addr];
-			cpu->N = 0;
-			cpu->C = data & 1;
-			data = (data >> 1) & 0x7F;
-			cpu->Z = data == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 4F */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 50 BVC (branch if overflow flag clear) */
-	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			if (cpu->V == 0)
-			{
-				cpu->PC += AsInt8(cpu->InstructionDecoding[1]);
-			}
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// Add 1 cycle if a the branch occurs and the destination address is on the same Page
-			// Add 2 cycle if a the branch occurs and the destination address is on a different Page
-			if (cpu->V != 0)
-				return 0;
-			return ((cpu->PC & 0xFF) + cpu->InstructionDecoding[1]) > 0xFF ? 2 : 1;
-		}
-	},
-	/* 51 EOR (Indirrect),Y */
-	{
-		2,
-		5,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t zpAddr = cpu->InstructionDecoding[1];
-			uint16_t addr = combineAddr(mem[zpAddr], mem[(zpAddr + 1) & 0xFF]) + cpu->Y;// indirrect Zero Page
-			cpu->A = cpu->A ^ mem[addr];
-			cpu->N = cpu->A & kBit7Mask;
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			return uint16_t(mem[cpu->InstructionDecoding[1]]) + cpu->Y > 0xFF;
-		}
-	},
-	/* 52 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 53 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 54 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 55 EOR ZeroPage,X */
-	{
-		2,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->A = cpu->A ^ mem[cpu->InstructionDecoding[1] + cpu->X];
-			cpu->N = cpu->A & kBit7Mask;
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 56 LSR ZeroPage,X */
-	{
-		2,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t& data = mem[cpu->InstructionDecoding[1] + cpu->X];
-			cpu->N = 0;
-			cpu->C = data & 1;
-			data = (data >> 1) & 0x7F;
-			cpu->Z = data == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 57 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 58 CLI */
-	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->I = 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 59 EOR Absolute,Y */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->Y;
-			cpu->A = cpu->A ^ mem[addr];
-			cpu->N = cpu->A & kBit7Mask;
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			return uint16_t(cpu->InstructionDecoding[1]) + cpu->Y > 0xFF;
-		}
-	},
-	/* 5A */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 5B */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 5C */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 5D EOR Absolute,X */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->X;
-			cpu->A = cpu->A ^ mem[addr];
-			cpu->N = cpu->A & kBit7Mask;
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t 
-		{ 
-			return uint16_t(cpu->InstructionDecoding[1]) + cpu->X > 0xFF;
-		}
-	},
-	/* 5E LSR Absolute,X */
-	{
-		3,
-		7,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->X;
-			uint8_t& data = mem[addr];
-			cpu->N = 0;
-			cpu->C = data & 1;
-			data = (data >> 1) & 0x7F;
-			cpu->Z = data == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 5F */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 60 RTS */
-	{
-		1,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->PC = mem[++cpu->SP] | (mem[++cpu->SP] << 8) + 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 61 ADC (Indirrect,x) */
-	{
-		2,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t zpAddr = cpu->InstructionDecoding[1] + cpu->X;
-			uint16_t addr = combineAddr(mem[zpAddr], mem[(zpAddr + 1) & 0xFF]);// indirrect Zero Page
-			uint16_t result = cpu->A + mem[addr] + cpu->C;
-			cpu->Z = result == 0;
-			cpu->V = (cpu->A & kBit7Mask) != (result & kBit7Mask);
-			cpu->N = (cpu->A & kBit7Mask);
+void Cpu6502::Reset(Memory64k& mem)
+{
+	PC = combineAddr(mem.BusRead(0xFFFC), mem.BusRead(0xFFFD));
+	SP = 0x1FD; // Reset goes through the stack push sequence without writing, leaving SP at $FD
+	SetStatus(0); // Reset all flags
+	I = 1; // Interrupt flag should be set (this will ignore IRQ requests until user clear the flag)
+	A = X = Y = 0;
 
-			assert(cpu->D); // TODO: BCD
-			cpu->A = result & 0x7F;
-			cpu->C = result > 0xFF;
-		}, 
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 62 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 63 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 64 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 65 ADC_ZP */
-	{
-		2,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = cpu->InstructionDecoding[1]; //Zero Page
-			uint16_t result = cpu->A + mem[addr] + cpu->C;
-			cpu->Z = result == 0;
-			cpu->V = (cpu->A & kBit7Mask) != (result & kBit7Mask);
-			cpu->N = (cpu->A & kBit7Mask);
+	InterruptPending = false;
+	NextInstruction = true;
+	InterruptSequence = false;
+	InstructionCycle = 0;
+	InstructionExtraCycles = 0;
+	memset(InstructionDecoding, 0, sizeof(InstructionDecoding));
+}
 
-			assert(cpu->D); // TODO: BCD
-			cpu->A = result & 0x7F;
-			cpu->C = result > 0xFF;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 66 ROR ZeroPage */
-	{
-		2,
-		5,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = cpu->InstructionDecoding[1];
-			uint8_t& data = mem[addr];
-			uint8_t newCarry = data & 1;
-			data = ((data << 1) & 0x7F) | (cpu->C ? kBit7Mask : 0);
-			cpu->C = newCarry;
-			cpu->Z = data == 0;
-			cpu->N = data & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 67 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 68 PLA */
-	{
-		1,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->A = mem[++cpu->SP];
-			cpu->N = (cpu->A & kBit7Mask);
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 69 ADC_IM */
-	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t result = cpu->A + cpu->InstructionDecoding[1] + cpu->C;
-			cpu->Z = result == 0;
-			cpu->V = (cpu->A & kBit7Mask) != (result & kBit7Mask);
-			cpu->N = (cpu->A & kBit7Mask);
+Cpu6502::Snapshot Cpu6502::TakeSnapshot(Memory64k& mem) const
+{
+	assert(NextInstruction); // Only between instructions
+	return { mem.TakeSnapshot(), A, X, Y, SP, PC, GetStatus(), InterruptPending };
+}
 
-			assert(cpu->D); // TODO: BCD
-			cpu->A = result & 0x7F;
-			cpu->C = result > 0xFF;
-		}, 
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 6A ROR Accumulator */
-	{
-		2,
-		5,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t& data = cpu->A;
-			uint8_t newCarry = data & 1;
-			data = ((data << 1) & 0x7F) | (cpu->C ? kBit7Mask : 0);
-			cpu->C = newCarry;
-			cpu->Z = data == 0;
-			cpu->N = data & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 6B */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 6C JMP Indirect */
-	{
-		3,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			uint8_t data0 = mem[addr];
-			addr = cpu->Model == Cpu6502Model::Original 
-						? combineAddr((cpu->InstructionDecoding[1] + 1) & 0xFF, cpu->InstructionDecoding[2])
-						: addr + 1;
-			uint8_t data1 = mem[addr];
-			cpu->PC = combineAddr(data0, data1);;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 6D ADC_ABSOLUTE */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			uint16_t result = cpu->A + mem[addr] + cpu->C;
-			cpu->Z = result == 0;
-			cpu->V = (cpu->A & kBit7Mask) != (result & kBit7Mask);
-			cpu->N = (cpu->A & kBit7Mask);
+void Cpu6502::Restore(Memory64k& mem, const Snapshot& snapshot)
+{
+	// The restored pages may hold code already decoded or translated
+	mem.Restore(snapshot.memory, [this](uint32_t address) { InvalidateCode(uint16_t(address), Memory64k::kPageSize); });
+	A = snapshot.a;
+	X = snapshot.x;
+	Y = snapshot.y;
+	SP = snapshot.sp;
+	PC = snapshot.pc;
+	SetStatus(snapshot.status);
+	InterruptPending = snapshot.interruptPending;
+	NextInstruction = true;
+	InterruptSequence = false;
+	InstructionCycle = 0;
+	InstructionExtraCycles = 0;
+}
 
-			assert(cpu->D); // TODO: BCD
-			cpu->A = result & 0x7F;
-			cpu->C = result > 0xFF;
-		}, 
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 6E ROR Absolute */
-	{
-		3,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			uint8_t& data = mem[addr];
-			uint8_t newCarry = data & 1;
-			data = ((data << 1) & 0x7F) | (cpu->C ? kBit7Mask : 0);
-			cpu->C = newCarry;
-			cpu->Z = data == 0;
-			cpu->N = data & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 6F */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 70 BVS (branch if overflow flag set) */
+void Cpu6502::ExecuteCycle(Memory64k& mem)
+{
+	if (NextInstruction)
 	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			if (cpu->V == 1)
-			{
-				cpu->PC += AsInt8(cpu->InstructionDecoding[1]);
-			}
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
+		NextInstruction = false;
+		InstructionCycle = 0;
+		// A pending interrupt is taken before the next instruction, its sequence runs in place of one
+		InterruptSequence = InterruptPending;
+		InterruptPending = false;
+		if (!InterruptSequence)
 		{
-			// Add 1 cycle if a the branch occurs and the destination address is on the same Page
-			// Add 2 cycle if a the branch occurs and the destination address is on a different Page
-			if (cpu->V != 1)
-				return 0;
-			return ((cpu->PC & 0xFF) + cpu->InstructionDecoding[1]) > 0xFF ? 2 : 1;
+#if CPU6502_TRACE
+			TraceInstruction(CpuClock.Cycle());
+#endif
+			InstructionDecoding[0] = FetchProgramInstruction(mem);
 		}
-	},
-	/* 71 ADC (indirrect),Y */
-	{
-		2,
-		5,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = mem[cpu->InstructionDecoding[1]] + cpu->Y; // indirrect Zero Page
-			uint16_t result = cpu->A + mem[addr] + cpu->C;
-			cpu->Z = result == 0;
-			cpu->V = (cpu->A & kBit7Mask) != (result & kBit7Mask);
-			cpu->N = (cpu->A & kBit7Mask);
+	}
 
-			assert(cpu->D); // TODO: BCD
-			cpu->A = result & 0x7F;
-			cpu->C = result > 0xFF;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// Add 1 cycle if a Page Boundary is crossed
-			return uint16_t(mem[cpu->InstructionDecoding[1]]) + cpu->Y > 0xFF ? 1 : 0;
-		}
-	},
-	/* 72 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 73 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 74 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 75  ADC_ZP_X*/
+	if (InterruptSequence)
 	{
-		2,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
+		// Pushes PC and P and loads the vector on its last cycle, like the instructions execute on theirs
+		if (++InstructionCycle == kInterruptCycles)
 		{
-			uint16_t addr = cpu->InstructionDecoding[1] + cpu->X; //Zero Page
-			uint16_t result = cpu->A + mem[addr] + cpu->C;
-			cpu->Z = result == 0;
-			cpu->V = (cpu->A & kBit7Mask) != (result & kBit7Mask);
-			cpu->N = (cpu->A & kBit7Mask);
+#if CPU6502_TRACE
+			TraceInstruction(CpuClock.Cycle());
+#endif
+			uint8_t cycles = Kernels::Irq(this, mem);
+			assert(cycles == kInterruptCycles);
+			(void)cycles;
+			InterruptSequence = false;
+			NextInstruction = true;
+			InstructionCycle = 0;
+		}
+		return;
+	}
 
-			assert(cpu->D); // TODO: BCD
-			cpu->A = result & 0x7F;
-			cpu->C = result > 0xFF;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 76 ROR ZeroPage,X */
-	{
-		2,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = cpu->InstructionDecoding[1] + cpu->X;
-			uint8_t& data = mem[addr];
-			uint8_t newCarry = data & 1;
-			data = ((data << 1) & 0x7F) | (cpu->C ? kBit7Mask : 0);
-			cpu->C = newCarry;
-			cpu->Z = data == 0;
-			cpu->N = data & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 77 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 78 SEI */
-	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->I = 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 79 ADC ABSOLUTE,Y */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->Y;
-			uint16_t result = cpu->A + mem[addr] + cpu->C;
-			cpu->Z = result == 0;
-			cpu->V = (cpu->A & kBit7Mask) != (result & kBit7Mask);
-			cpu->N = (cpu->A & kBit7Mask);
+	const InstructionInformation& instruction = InstructionInfo[InstructionDecoding[0]];
+	assert(instruction.cycles > 0); // this would mean an invalid opcode was used
+	if (InstructionCycle != 0 && InstructionCycle < instruction.size)
+		InstructionDecoding[InstructionCycle] = FetchProgramInstruction(mem);
 
-			assert(cpu->D); // TODO: BCD
-			cpu->A = result & 0x7F;
-			cpu->C = result > 0xFF;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// ADD 1 cycle if page boundary crossed
-			return uint16_t(cpu->InstructionDecoding[1]) + cpu->Y > 0xFF ? 1 : 0;
-		}
-	},
-	/* 7A */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 7B */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 7C */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 7D ADC ABSOLUTE,X */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->X;
-			uint16_t result = cpu->A + mem[addr] + cpu->C;
-			cpu->Z = result == 0;
-			cpu->V = (cpu->A & kBit7Mask) != (result & kBit7Mask);
-			cpu->N = (cpu->A & kBit7Mask);
+	++InstructionCycle;
 
-			assert(cpu->D); // TODO: BCD
-			cpu->A = result & 0x7F;
-			cpu->C = result > 0xFF;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// ADD 1 cycle if page boundary crossed
-			return uint16_t(cpu->InstructionDecoding[1]) + cpu->X > 0xFF ? 1 : 0;
-		}
-	},
-	/* 7E ROR Absolute,X */
-	{
-		3,
-		7,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->X;
-			uint8_t& data = mem[addr];
-			uint8_t newCarry = data & 1;
-			data = ((data << 1) & 0x7F) | (cpu->C ? kBit7Mask : 0);
-			cpu->C = newCarry;
-			cpu->Z = data == 0;
-			cpu->N = data & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 7F */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 80 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 81 STA (Indirrect,X) */			
-	{
-		2,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t zpAddr = cpu->InstructionDecoding[1] + cpu->X;
-			uint16_t addr = combineAddr(mem[zpAddr], mem[(zpAddr + 1) & 0xFF]);// indirrect Zero Page
-			mem[addr] = cpu->A;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 82 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 83 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 84 STY ZeroPage */
-	{
-		2,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t addr = cpu->InstructionDecoding[1];
-			mem[addr] = cpu->Y;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 85 STA ZeroPage */
-	{
-		2,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t addr = cpu->InstructionDecoding[1];
-			mem[addr] = cpu->A;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 86 STX ZeroPage */
-	{
-		2,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t addr = cpu->InstructionDecoding[1];
-			mem[addr] = cpu->X;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 87 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 88 DEY */
+	// The instruction executes at its base cycle count, its extra cycles follow
+	if (InstructionCycle == instruction.cycles)
+		InstructionExtraCycles = instruction.execute(this, mem);
+	if (InstructionCycle >= instruction.cycles + InstructionExtraCycles)
 	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			--cpu->Y;
-			cpu->Z = cpu->Y == 0;
-			cpu->N = cpu->Y & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 89 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 8A TXA */
-	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->A = cpu->X;
-			cpu->N = cpu->A & kBit7Mask;
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 8B */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 8C STY Absolute */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			mem[addr] = cpu->Y;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 8D STA Absolute */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			mem[addr] = cpu->A;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 8E STX Absolute */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			mem[addr] = cpu->X;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 8F */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 90 BCC (branch if carry clear) */
-	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			if (cpu->C == 0)
-			{
-				cpu->PC += AsInt8(cpu->InstructionDecoding[1]);
-			}
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// Add 1 cycle if a the branch occurs and the destination address is on the same Page
-			// Add 2 cycle if a the branch occurs and the destination address is on a different Page
-			if (cpu->C != 0)
-				return 0;
-			return ((cpu->PC & 0xFF) + cpu->InstructionDecoding[1]) > 0xFF ? 2 : 1;
-		}
-	},
-	/* 91 STA (Indirrect),Y */			
-	{
-		2,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t zpAddr = cpu->InstructionDecoding[1];
-			uint16_t addr = combineAddr(mem[zpAddr], mem[(zpAddr + 1) & 0xFF]) + cpu->Y; // indirrect Zero Page
-			mem[addr] = cpu->A;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 92 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 93 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 94 STY ZeroPage,X */
-	{
-		2,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t addr = cpu->InstructionDecoding[1] + cpu->X;
-			mem[addr] = cpu->Y;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 95 STA ZeroPage,X */
-	{
-		2,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t addr = cpu->InstructionDecoding[1] + cpu->X;
-			mem[addr] = cpu->A;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 96 STX ZeroPage,Y */
-	{
-		2,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t addr = cpu->InstructionDecoding[1] + cpu->Y;
-			mem[addr] = cpu->X;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 97 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 98 TYA */
-	{
-		1, 
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->A = cpu->Y;
-			cpu->N = cpu->A & kBit7Mask;
-			cpu->Z = cpu->A == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 99 STA Absolute,Y */
-	{
-		3,
-		5,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->Y;
-			mem[addr] = cpu->A;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 9A TXS */
-	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->SP = (cpu->SP & 0xFF00) + cpu->X;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 9B */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 9C */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 9D STA Absolute,X */
-	{
-		3,
-		5,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->X;
-			mem[addr] = cpu->A;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* 9E */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* 9F */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* A0 LDY Immediate */  	
-	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t data = cpu->Y = cpu->InstructionDecoding[1];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* A1 LDA (Indirect,X) */
-	{
-		2,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem) 
-		{
-			uint8_t zpAddr = cpu->InstructionDecoding[1] + cpu->X;
-			uint16_t addr = combineAddr(mem[zpAddr], mem[(zpAddr + 1) & 0xFF]);// indirrect Zero Page
-			uint8_t data = cpu->A = mem[addr];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		}, 
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* A2 LDX Immediate */  	
-	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t data = cpu->X = cpu->InstructionDecoding[1];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* A3 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* A4 LDY ZeroPage */  	
-	{
-		2,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t data = cpu->Y = mem[cpu->InstructionDecoding[1]];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* A5 LDA ZeroPage */
-	{
-		2,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t data = cpu->A = mem[cpu->InstructionDecoding[1]];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* A6 LDX ZeroPage */
-	{
-		2,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t data = cpu->X = mem[cpu->InstructionDecoding[1]];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* A7 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* A8 TAY */
-	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->Y = cpu->A;
-			cpu->N = cpu->Y & kBit7Mask;
-			cpu->Z = cpu->Y == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* A9 LDA_IM */  	
-	{
-		2, 
-		2, 
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t data = cpu->A = cpu->InstructionDecoding[1];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* AA TAX */
-	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->X = cpu->A;
-			cpu->N = cpu->X & kBit7Mask;
-			cpu->Z = cpu->X == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } 
-	},
-	/* AB */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* AC LDY Absolute */  	
-	{
-		2,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			uint8_t data = cpu->Y = mem[addr];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* AD LDA Absolute */
-	{
-		3, 
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			uint8_t data = cpu->A = mem[addr];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* AE LDX Absolute */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			uint8_t data = cpu->X = mem[addr];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* AF */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* B0 BCS (branch if carry set) */
-	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			if (cpu->C == 1)
-			{
-				cpu->PC += AsInt8(cpu->InstructionDecoding[1]);
-			}
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// Add 1 cycle if a the branch occurs and the destination address is on the same Page
-			// Add 2 cycle if a the branch occurs and the destination address is on a different Page
-			if (cpu->C != 1)
-				return 0;
-			return ((cpu->PC & 0xFF) + cpu->InstructionDecoding[1]) > 0xFF ? 2 : 1;
-		}
-	},
-	/* B1 LDA (Indirect),Y */
-	{
-		2,
-		5,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t zpAddr = cpu->InstructionDecoding[1];
-			uint16_t addr = combineAddr(mem[zpAddr], mem[(zpAddr + 1) & 0xFF]) + cpu->Y; // indirrect Zero Page
-			uint8_t data = cpu->A = mem[addr];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			return uint16_t(mem[cpu->InstructionDecoding[1]]) + cpu->Y > 0xFF;
-		}
-	},
-	/* B2 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* B3 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* B4 LDY ZeroPage,X */  	
-	{
-		2,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t data = cpu->Y = mem[cpu->InstructionDecoding[1] + cpu->X];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* B5 LDA ZeroPage,X */
-	{
-		2,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t data = cpu->A = mem[cpu->InstructionDecoding[1] + cpu->X];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* B6 LDX ZeroPage,Y */
-	{
-		2,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t data = cpu->X = mem[cpu->InstructionDecoding[1] + cpu->Y];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* B7 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* B8 CLV */
-	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->V = 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* B9 LDA Absolute,Y */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->Y;
-			uint8_t data = cpu->A = mem[addr];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			return cpu->InstructionDecoding[1] + cpu->Y > 0xFF ? 1 : 0;
-		}
-	},
-	/* BA TSX */
-	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->X = cpu->SP & 0xFF;
-			cpu->N = cpu->X & kBit7Mask;
-			cpu->Z = cpu->X == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* BB */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* BC LDY Absolute,X */  	
-	{
-		2,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->X;
-			uint8_t data = cpu->Y = mem[addr];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			return cpu->InstructionDecoding[1] + cpu->X > 0xFF ? 1 : 0;
-		}
-	},
-	/* BD LDA Absolute,X */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->X;
-			uint8_t data = cpu->A = mem[addr];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			return cpu->InstructionDecoding[1] + cpu->X > 0xFF ? 1 : 0;
-		}
-	},
-	/* BE LDX Absolute,Y */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->Y;
-			uint8_t data = cpu->X = mem[addr];
-			cpu->Z = data == 0;
-			cpu->N = (data & 0b1000000) == 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			return cpu->InstructionDecoding[1] + cpu->Y > 0xFF ? 1 : 0;
-		}
-	},
-	/* BF */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* C0 CPY Immediate */
-	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			int16_t data = cpu->Y - cpu->InstructionDecoding[1];
-			cpu->C = data >= 0;
-			cpu->Z = data == 0;
-			cpu->N = (data & kBit7Mask) ? 1 : 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* C1 CMP (Indirect,X) */
-	{
-		2,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t zpAddr = cpu->InstructionDecoding[1] + cpu->X;
-			uint16_t addr = combineAddr(mem[zpAddr], mem[(zpAddr + 1) & 0xFF]);// indirrect Zero Page
-			int16_t data = cpu->A - mem[addr];
-			cpu->C = data >= 0;
-			cpu->Z = data == 0;
-			cpu->N = (data & kBit7Mask) ? 1 : 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* C2 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* C3 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* C4 CPY ZeroPage */
-	{
-		2,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			int16_t data = cpu->Y - mem[cpu->InstructionDecoding[1]];
-			cpu->C = data >= 0;
-			cpu->Z = data == 0;
-			cpu->N = (data & kBit7Mask) ? 1 : 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* C5 CMP ZeroPage */
-	{
-		2,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			int16_t data = cpu->A - mem[cpu->InstructionDecoding[1]];
-			cpu->C = data >= 0;
-			cpu->Z = data == 0;
-			cpu->N = (data & kBit7Mask) ? 1 : 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* C6 DEC ZeroPage */
-	{
-		2,
-		5,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = cpu->InstructionDecoding[1];
-			uint8_t& data = mem[addr];
-			data = (data - 1) & 0xFF;
-			cpu->Z = data == 0;
-			cpu->N = data & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* C7 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* C8 INY */
-	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->Y = (cpu->Y + 1) & 0xFF;
-			cpu->Z = cpu->Y == 0;
-			cpu->N = cpu->Y & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* C9 CMP Immediate */
-	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			int16_t data = cpu->A - cpu->InstructionDecoding[1];
-			cpu->C = data >= 0;
-			cpu->Z = data == 0;
-			cpu->N = (data & kBit7Mask) ? 1 : 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* CA DEX */
-	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			--cpu->X;
-			cpu->Z = cpu->X == 0;
-			cpu->N = cpu->X & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } 
-	},
-	/* CB */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* CC CPY Absolute */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			int16_t data = cpu->Y - mem[addr];
-			cpu->C = data >= 0;
-			cpu->Z = data == 0;
-			cpu->N = (data & kBit7Mask) ? 1 : 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* CD CMP Absolute */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			int16_t data = cpu->A - mem[addr];
-			cpu->C = data >= 0;
-			cpu->Z = data == 0;
-			cpu->N = (data & kBit7Mask) ? 1 : 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* CE DEC Absolute */
-	{
-		3,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			uint8_t& data = mem[addr];
-			data = (data - 1) & 0xFF;
-			cpu->Z = data == 0;
-			cpu->N = data & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* CF */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* D0 BNE (branch if zeroflag clear) */
-	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			if (cpu->Z == 0)
-			{
-				cpu->PC += AsInt8(cpu->InstructionDecoding[1]);
-			}
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// Add 1 cycle if a the branch occurs and the destination address is on the same Page
-			// Add 2 cycle if a the branch occurs and the destination address is on a different Page
-			if (cpu->Z != 0)
-				return 0;
-			return ((cpu->PC & 0xFF) + cpu->InstructionDecoding[1]) > 0xFF ? 2 : 1;
-		}
-	},
-	/* D1 CMP (Indirect,X) */
-	{
-		2,
-		5,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t zpAddr = cpu->InstructionDecoding[1];
-			uint16_t addr = combineAddr(mem[zpAddr], mem[(zpAddr + 1) & 0xFF]) + cpu->Y;// indirrect Zero Page
-			int16_t data = cpu->A - mem[addr];
-			cpu->C = data >= 0;
-			cpu->Z = data == 0;
-			cpu->N = (data & kBit7Mask) ? 1 : 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			return uint16_t(mem[cpu->InstructionDecoding[1]]) + cpu->Y > 0xFF;
-		}
-	},
-	/* D2 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* D3 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* D4 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* D5 CMP ZeroPage,X */
-	{
-		2,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			int16_t data = cpu->A - mem[cpu->InstructionDecoding[1] + cpu->X];
-			cpu->C = data >= 0;
-			cpu->Z = data == 0;
-			cpu->N = (data & kBit7Mask) ? 1 : 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* D6 DEC ZeroPage,X */
-	{
-		2,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = cpu->InstructionDecoding[1] + cpu->X;
-			uint8_t& data = mem[addr];
-			data = (data - 1) & 0xFF;
-			cpu->Z = data == 0;
-			cpu->N = data & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* D7 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* D8 CLD */
-	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->D = 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* D9 CMP Absolute,Y */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->Y;
-			int16_t data = cpu->A - mem[addr];
-			cpu->C = data >= 0;
-			cpu->Z = data == 0;
-			cpu->N = (data & kBit7Mask) ? 1 : 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// ADD 1 cycle if page boundary crossed
-			return uint16_t(cpu->InstructionDecoding[1]) + cpu->Y > 0xFF ? 1 : 0;
-		}
-	},
-	/* DA */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* DB */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* DC */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* DD CMP Absolute,X */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->X;
-			int16_t data = cpu->A - mem[addr];
-			cpu->C = data >= 0;
-			cpu->Z = data == 0;
-			cpu->N = (data & kBit7Mask) ? 1 : 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// ADD 1 cycle if page boundary crossed
-			return uint16_t(cpu->InstructionDecoding[1]) + cpu->X > 0xFF ? 1 : 0;
-		}
-	},
-	/* DE DEC Absolute,X */
-	{
-		3,
-		7,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->X;
-			uint8_t& data = mem[addr];
-			data = (data - 1) & 0xFF;
-			cpu->Z = data == 0;
-			cpu->N = data & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* DF */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* E0 CPX Immediate */
-	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			int16_t data = cpu->X - cpu->InstructionDecoding[1];
-			cpu->C = data >= 0;
-			cpu->Z = data == 0;
-			cpu->N = (data & kBit7Mask) ? 1 : 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* E1 SBC (Indirrect,X)*/
-	{
-		2, 
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t zpAddr = cpu->InstructionDecoding[1] + cpu->X;
-			uint16_t addr = combineAddr(mem[zpAddr], mem[(zpAddr + 1) & 0xFF]);// indirrect Zero Page
+		InstructionExtraCycles = 0;
+		NextInstruction = true;
+		InstructionCycle = 0;
+		memset(InstructionDecoding, 0, sizeof(InstructionDecoding));
+	}
+}
 
-			uint8_t data = 0;
-			assert(!cpu->D); // Decimal mode not implemented !!!
-			//if(cpu->D)
-			//{
-			// 	data = bcd(cpu->A) - bcd(mem[addr]) - - (1 - cpu->C);
-			//	P.V = (data > 99 || data < 0) ? 1 : 0;
-			//}
-			//else
-			{
-				data = int16_t(cpu->A) - mem[addr] - (1 - cpu->C);
-				cpu->V = (AsInt8(data) > 127 || AsInt8(data) < -128) ? 1 : 0;
-			}
-			cpu->C = (data >= 0) ? 1 : 0;
-			cpu->N = data & kBit7Mask;
-			cpu->Z = (data == 0) ? 1 : 0;
-			cpu->A = data & 0xFF;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* E2 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* E3 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* E4 CPX ZeroPage */
-	{
-		2,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			int16_t data = cpu->X - mem[cpu->InstructionDecoding[1]];
-			cpu->C = data >= 0;
-			cpu->Z = data == 0;
-			cpu->N = (data & kBit7Mask) ? 1 : 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* E5 SBC ZeroPage*/
-	{
-		2,
-		3,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = cpu->InstructionDecoding[1];
+uint8_t Cpu6502::ExecuteInstruction(Memory64k& mem)
+{
+	InstructionDecoding[0] = FetchProgramInstruction(mem);
+	const InstructionInformation& instruction = InstructionInfo[InstructionDecoding[0]];
+	assert(instruction.cycles > 0); // this would mean an invalid opcode was used
+	for (uint8_t i = 1; i < instruction.size; ++i)
+		InstructionDecoding[i] = FetchProgramInstruction(mem);
 
-			uint8_t data = 0;
-			assert(!cpu->D); // Decimal mode not implemented !!!
-			//if(cpu->D)
-			//{
-			// 	data = bcd(cpu->A) - bcd(mem[addr]) - - (1 - cpu->C);
-			//	P.V = (data > 99 || data < 0) ? 1 : 0;
-			//}
-			//else
-			{
-				data = int16_t(cpu->A) - mem[addr] - (1 - cpu->C);
-				cpu->V = (AsInt8(data) > 127 || AsInt8(data) < -128) ? 1 : 0;
-			}
-			cpu->C = (data >= 0) ? 1 : 0;
-			cpu->N = data & kBit7Mask;
-			cpu->Z = (data == 0) ? 1 : 0;
-			cpu->A = data & 0xFF;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* E6 INC ZeroPage */
-	{
-		2,
-		5,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t& data = mem[cpu->InstructionDecoding[1]];
-			data = (data+1) & 0xFF;
-			cpu->N = data & kBit7Mask;
-			cpu->Z = data == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* E7 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* E8 INX */
-	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			cpu->X = (cpu->X + 1) & 0xFF;
-			cpu->Z = cpu->X == 0;
-			cpu->N = cpu->X & kBit7Mask;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* E9 SBC Immediate */
-	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t data = 0;
-			assert(!cpu->D); // Decimal mode not implemented !!!
-			//if(cpu->D)
-			//{
-			// 	data = bcd(cpu->A) - bcd(cpu->InstructionDecoding[1]) - - (1 - cpu->C);
-			//	P.V = (data > 99 || data < 0) ? 1 : 0;
-			//}
-			//else
-			{
-				data = int16_t(cpu->A) - cpu->InstructionDecoding[1] - (1 - cpu->C);
-				cpu->V = (AsInt8(data) > 127 || AsInt8(data) < -128) ? 1 : 0;
-			}
-			cpu->C = (data >= 0) ? 1 : 0;
-			cpu->N = data & kBit7Mask;
-			cpu->Z = (data == 0) ? 1 : 0;
-			cpu->A = data & 0xFF;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } 
-	},
-	/* EA NOP */
-	{
-		1, 
-		2,
-		[](Cpu6502* cpu, Memory64k& mem) {}, 
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* EB */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* EC CPX Absolute */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			int16_t data = cpu->X - mem[addr];
-			cpu->C = data >= 0;
-			cpu->Z = data == 0;
-			cpu->N = (data & kBit7Mask) ? 1 : 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* ED SBC Absolute */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
+	return instruction.cycles + instruction.execute(this, mem);
+}
 
-			uint8_t data = 0;
-			assert(!cpu->D); // Decimal mode not implemented !!!
-			//if(cpu->D)
-			//{
-			// 	data = bcd(cpu->A) - bcd(mem[addr]) - - (1 - cpu->C);
-			//	P.V = (data > 99 || data < 0) ? 1 : 0;
-			//}
-			//else
-			{
-				data = int16_t(cpu->A) - mem[addr] - (1 - cpu->C);
-				cpu->V = (AsInt8(data) > 127 || AsInt8(data) < -128) ? 1 : 0;
-			}
-			cpu->C = (data >= 0) ? 1 : 0;
-			cpu->N = data & kBit7Mask;
-			cpu->Z = (data == 0) ? 1 : 0;
-			cpu->A = data & 0xFF;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* EE INC Absolute */
-	{
-		3,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
-			uint8_t& data = mem[addr];
-			data = (data + 1) & 0xFF;
-			cpu->N = data & kBit7Mask;
-			cpu->Z = data == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* EF */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* F0 BEQ (branch if zeroflag set) */
-	{
-		2,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			if (cpu->Z == 1)
-			{
-				cpu->PC += AsInt8(cpu->InstructionDecoding[1]);
-			}
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// Add 1 cycle if a the branch occurs and the destination address is on the same Page
-			// Add 2 cycle if a the branch occurs and the destination address is on a different Page
-			if (cpu->Z != 1)
-				return 0;
-			return ((cpu->PC & 0xFF) + cpu->InstructionDecoding[1]) > 0xFF ? 2 : 1;
-		}
-	},
-	/* F1 SBC (Indirect), Y */
-	{
-		2,
-		5,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint8_t zpAddr = cpu->InstructionDecoding[1];
-			uint16_t addr = combineAddr(mem[zpAddr], mem[(zpAddr + 1) & 0xFF]) + cpu->Y;// indirrect Zero Page
+template <Cpu6502Model MODEL, uint8_t OPCODE>
+MEMORY_FORCE_INLINE uint8_t Cpu6502::ExecuteOpcode(Memory64k& mem)
+{
+	// InstructionTable is constant, indexing it with constants lets the compiler call the handlers directly
+	const InstructionInformation& instruction = InstructionTable<MODEL>[OPCODE];
+	assert(instruction.cycles > 0); // this would mean an invalid opcode was used
+	InstructionDecoding[0] = OPCODE;
+	for (uint8_t i = 1; i < instruction.size; ++i)
+		InstructionDecoding[i] = FetchProgramInstruction(mem);
 
-			uint8_t data = 0;
-			assert(!cpu->D); // Decimal mode not implemented !!!
-			//if(cpu->D)
-			//{
-			// 	data = bcd(cpu->A) - bcd(mem[addr]) - - (1 - cpu->C);
-			//	P.V = (data > 99 || data < 0) ? 1 : 0;
-			//}
-			//else
-			{
-				data = int16_t(cpu->A) - mem[addr] - (1 - cpu->C);
-				cpu->V = (AsInt8(data) > 127 || AsInt8(data) < -128) ? 1 : 0;
-			}
-			cpu->C = (data >= 0) ? 1 : 0;
-			cpu->N = data & kBit7Mask;
-			cpu->Z = (data == 0) ? 1 : 0;
-			cpu->A = data & 0xFF;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			return uint16_t(mem[cpu->InstructionDecoding[1]]) + cpu->Y > 0xFF ? 1 : 0;
-		}
-	},
-	/* F2 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* F3 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* F4 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* F5 SBC ZeroPage,X */
-	{
-		2,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = cpu->InstructionDecoding[1] + cpu->Z;
+	return instruction.cycles + instruction.execute(this, mem);
+}
 
-			uint8_t data = 0;
-			assert(!cpu->D); // Decimal mode not implemented !!!
-			//if(cpu->D)
-			//{
-			// 	data = bcd(cpu->A) - bcd(mem[addr]) - - (1 - cpu->C);
-			//	P.V = (data > 99 || data < 0) ? 1 : 0;
-			//}
-			//else
-			{
-				data = int16_t(cpu->A) - mem[addr] - (1 - cpu->C);
-				cpu->V = (AsInt8(data) > 127 || AsInt8(data) < -128) ? 1 : 0;
-			}
-			cpu->C = (data >= 0) ? 1 : 0;
-			cpu->N = data & kBit7Mask;
-			cpu->Z = (data == 0) ? 1 : 0;
-			cpu->A = data & 0xFF;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* F6 INC ZeroPage,X */
-	{
-		2,
-		6,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = cpu->InstructionDecoding[1] + cpu->X;
-			uint8_t& data = mem[addr];
-			data = (data + 1) & 0xFF;
-			cpu->N = data & kBit7Mask;
-			cpu->Z = data == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* F7 */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* F8 SED */
-	{
-		1,
-		2,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			assert(false); // Decimal mode is not supported....
-			cpu->D = 1;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* F9 SBC Absolute,Y */
-	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->Y;
+uint64_t Cpu6502::RunFor(Memory64k& mem, uint64_t cycles)
+{
+	return Run(mem, cycles, UINT64_MAX);
+}
 
-			uint8_t data = 0;
-			assert(!cpu->D); // Decimal mode not implemented !!!
-			//if(cpu->D)
-			//{
-			// 	data = bcd(cpu->A) - bcd(mem[addr]) - - (1 - cpu->C);
-			//	P.V = (data > 99 || data < 0) ? 1 : 0;
-			//}
-			//else
-			{
-				data = int16_t(cpu->A) - mem[addr] - (1 - cpu->C);
-				cpu->V = (AsInt8(data) > 127 || AsInt8(data) < -128) ? 1 : 0;
-			}
-			cpu->C = (data >= 0) ? 1 : 0;
-			cpu->N = data & kBit7Mask;
-			cpu->Z = (data == 0) ? 1 : 0;
-			cpu->A = data & 0xFF;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
-		{
-			// ADD 1 cycle if page boundary crossed
-			return uint16_t(cpu->InstructionDecoding[1]) + cpu->Y > 0xFF ? 1 : 0;
-		}
-	},
-	/* FA */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* FB */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* FC */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-	/* FD SBC Absolute,X */
+uint64_t Cpu6502::RunInstructions(Memory64k& mem, uint64_t count)
+{
+	return Run(mem, UINT64_MAX, count);
+}
+
+uint64_t Cpu6502::Run(Memory64k& mem, uint64_t maxCycles, uint64_t maxInstructions)
+{
+	assert(NextInstruction); // Can't switch mode in the middle of a per cycle instruction
+
+	uint64_t executed = 0;
+	uint64_t count = 0;
+	// Up to the next clock event at a time, the clock fires it when the cycles are accounted
+	while (executed < maxCycles && count < maxInstructions)
 	{
-		3,
-		4,
-		[](Cpu6502* cpu, Memory64k& mem)
+		uint64_t cycles = 0;
+#if CPU6502_TRACE
+		TraceBase = CpuClock.Cycle();
+#endif
+		// A pending interrupt is taken before the next instruction
+		if (InterruptPending)
 		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->X;
+			InterruptPending = false;
+			CPU6502_TRACE_INSTRUCTION(this, 0);
+			cycles = Kernels::Irq(this, mem);
+		}
 
-			uint8_t data = 0;
-			assert(!cpu->D); // Decimal mode not implemented !!!
-			//if(cpu->D)
-			//{
-			// 	data = bcd(cpu->A) - bcd(mem[addr]) - - (1 - cpu->C);
-			//	P.V = (data > 99 || data < 0) ? 1 : 0;
-			//}
-			//else
-			{
-				data = int16_t(cpu->A) - mem[addr] - (1 - cpu->C);
-				cpu->V = (AsInt8(data) > 127 || AsInt8(data) < -128) ? 1 : 0;
-			}
-			cpu->C = (data >= 0) ? 1 : 0;
-			cpu->N = data & kBit7Mask;
-			cpu->Z = (data == 0) ? 1 : 0;
-			cpu->A = data & 0xFF;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t
+		const uint64_t limit = std::min(maxCycles - executed, CpuClock.CyclesUntilEvent());
+		if (cycles < limit)
 		{
-			// ADD 1 cycle if page boundary crossed
-			return uint16_t(cpu->InstructionDecoding[1]) + cpu->X > 0xFF ? 1 : 0;
+#if CPU6502_TRACE
+			TraceBase += cycles;
+#endif
+			uint64_t instructions = 0;
+			cycles += RunCore(mem, limit - cycles, maxInstructions - count, instructions);
+			count += instructions;
 		}
-	},
-	/* FE INC Absolute,X */
-	{
-		3,
-		7,
-		[](Cpu6502* cpu, Memory64k& mem)
-		{
-			uint16_t addr = combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]) + cpu->X;
-			uint8_t& data = mem[addr];
-			data = (data + 1) & 0xFF;
-			cpu->N = data & kBit7Mask;
-			cpu->Z = data == 0;
-		},
-		[](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; }
-	},
-	/* FF */			{0, 0, [](Cpu6502* cpu, Memory64k& mem) {}, [](Cpu6502* cpu, Memory64k& mem) -> uint8_t { return 0; } },
-};
 
-void Cpu6502::Reset(Memory64k& mem)
-{
-	PC = combineAddr(mem[0xFFFC], mem[0xFFFD]);
-	SP = 0x100;
-	F = 0; // Reset all flags
-	I = 1; // Interrupt flag should be set (this will ignore IRQ requests until user clear the flag)
-	A = X = Y = 0;
+		executed += cycles;
+		CpuClock.AdvanceCycles(cycles);
+	}
+	return executed;
+}
 
-	NextInstruction = true;
-	InstructionCycle = 0;
-	memset(InstructionDecoding, 0, 4);
+uint64_t Cpu6502::RunCore(Memory64k& mem, uint64_t maxCycles, uint64_t maxInstructions, uint64_t& instructions)
+{
+	switch (Core)
+	{
+	case Cpu6502Core::FunctionTable:
+		return RunFunctionTable(mem, maxCycles, maxInstructions, instructions);
+	case Cpu6502Core::Switch:
+		if (Model == Cpu6502Model::Original)
+			return RunSwitch<Cpu6502Model::Original>(mem, maxCycles, maxInstructions, instructions);
+		return RunSwitch<Cpu6502Model::Cpu65C02>(mem, maxCycles, maxInstructions, instructions);
+	case Cpu6502Core::BlockCache:
+		return RunBlockCache(mem, maxCycles, maxInstructions, instructions);
+	case Cpu6502Core::Jit:
+		return RunJit(mem, maxCycles, maxInstructions, instructions);
+	}
+	return 0;
 }
 
-void Cpu6502::ExecuteCycle(Memory64k& mem)
+uint64_t Cpu6502::RunFunctionTable(Memory64k& mem, uint64_t maxCycles, uint64_t maxInstructions, uint64_t& instructions)
 {
-	if (NextInstruction)
+	uint64_t executed = 0;
+	uint64_t count = 0;
+	for (; executed < maxCycles && count < maxInstructions; ++count)
 	{
-		InstructionDecoding[0] = FetchProgramInstruction(mem);
-		NextInstruction = false;
-		InstructionCycle = 0;
+		CPU6502_TRACE_INSTRUCTION(this, executed);
+		executed += ExecuteInstruction(mem);
 	}
+	instructions = count;
+	return executed;
+}
 
-	const InstructionInformation& instruction = InstructionInfo[InstructionDecoding[0]];
-	assert(instruction.cycles > 0); // this would mean an invalid opcode was used
-	if (InstructionCycle != 0 && InstructionCycle < instruction.size)
-		InstructionDecoding[InstructionCycle+1] = FetchProgramInstruction(mem);
+template <Cpu6502Model MODEL>
+uint64_t Cpu6502::RunSwitch(Memory64k& mem, uint64_t maxCycles, uint64_t maxInstructions, uint64_t& instructions)
+{
+	uint64_t executed = 0;
+	uint64_t count = 0;
+#if CPU6502_COMPUTED_GOTO
+	// One indirect jump per handler instead of a single shared one, which predicts a lot better
+#define CPU6502_LABEL_ADDRESS(op) &&Opcode_##op,
+	static void* const kDispatchTable[256] = { CPU6502_OPCODES(CPU6502_LABEL_ADDRESS) };
+#undef CPU6502_LABEL_ADDRESS
+
+#define CPU6502_DISPATCH() \
+	if (executed >= maxCycles || count >= maxInstructions) \
+	{ \
+		instructions = count; \
+		return executed; \
+	} \
+	++count; \
+	CPU6502_TRACE_INSTRUCTION(this, executed); \
+	goto *kDispatchTable[FetchProgramInstruction(mem)];
+
+	CPU6502_DISPATCH();
+#define CPU6502_LABEL(op) Opcode_##op: executed += ExecuteOpcode<MODEL, op>(mem); CPU6502_DISPATCH();
+	CPU6502_OPCODES(CPU6502_LABEL)
+#undef CPU6502_LABEL
+#undef CPU6502_DISPATCH
+#else
+	for (; executed < maxCycles && count < maxInstructions; ++count)
+	{
+		CPU6502_TRACE_INSTRUCTION(this, executed);
+		switch (FetchProgramInstruction(mem))
+		{
+#define CPU6502_CASE(op) case op: executed += ExecuteOpcode<MODEL, op>(mem); break;
+			CPU6502_OPCODES(CPU6502_CASE)
+#undef CPU6502_CASE
+		}
+	}
+	instructions = count;
+	return executed;
+#endif
+}
 
-	++InstructionCycle;
+void Cpu6502::InvalidateCode(uint16_t address, uint32_t size)
+{
+	if (!Blocks || size == 0)
+		return;
 
-	if (InstructionCycle >= instruction.cycles + instruction.extraCycle(this, mem))
+	uint32_t lastPage = (std::min<uint32_t>(address + size, 0x10000) - 1) >> 8;
+	for (uint32_t page = address >> 8; page <= lastPage; ++page)
 	{
-		instruction.func(this, mem);
-		NextInstruction = true;
-		InstructionCycle = 0;
-		memset(InstructionDecoding, 0, 4);
+		if (Blocks->IsCodePage(uint8_t(page)))
+			Blocks->InvalidatePage(uint8_t(page));
 	}
 }
 
@@ -2443,6 +608,7 @@ void Cpu6502::Interrupt()
 {
 	if (I) // If flag I is 1, IRQ requests are ignored
 		return;
-	// TODO simulate interrupt pin activation
+	// Taken between two instructions, by the next RunFor/RunInstructions or ExecuteCycle
+	InterruptPending = true;
 }
 
@@ -2,8 +2,10 @@
 
 #include "Clock.h"
 #include "Memory.h"
+#include "TraceRing.h"
 
 #include <cstdint>
+#include <memory>
 
 enum class Cpu6502Model
 {
@@ -14,22 +16,186 @@ enum class Cpu6502Model
 	// Simulate Newer 6502 with bugfixes
 	Cpu65C02
 };
+
+enum class Cpu6502Core
+{
+	// Dispatch through the InstructionInfo function pointers
+	FunctionTable,
+
+	// Single dispatch loop (switch, or computed goto with GCC/Clang) with the handlers inlined
+	Switch,
+
+	// Executes pre-decoded basic blocks, cached by start address
+	BlockCache,
+
+	// BlockCache with the hot blocks translated to x86-64 code, same as BlockCache on other hosts
+	Jit
+};
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CPU6502_JIT_SUPPORTED 1
+#else
+#define CPU6502_JIT_SUPPORTED 0
+#endif
+
+// Instruction pairs the BlockCache core runs as a single handler
+enum class Cpu6502Fusion
+{
+	LoadStore, // LDA/STA, any addressing modes
+	DecrementBranch, // DEX/BNE, DEY/BNE
+	CompareBranch, // CMP #imm/BEQ, CMP #imm/BNE
+	IncrementBranch, // INC zp/BNE
+	ClearCarryAdd, // CLC/ADC, any addressing mode
+	Count
+};
+
+// Core used when none is given at construction, can be overridden at build time
+#ifndef CPU6502_DEFAULT_CORE
+#define CPU6502_DEFAULT_CORE Cpu6502Core::Switch
+#endif
+
 class Cpu6502
 {
 public:
-	Cpu6502(Clock& clock, Cpu6502Model model);
+	Cpu6502(Clock& clock, Cpu6502Model model, Cpu6502Core core = CPU6502_DEFAULT_CORE);
+	~Cpu6502();
 
 	void Reset(Memory64k& mem);
 	void ExecuteCycle(Memory64k& mem);
+
+	// Interrupt request, ignored when the I flag is set. Not thread safe, other threads go through EventRecorder.
 	void Interrupt();
 
+	// Instruction granularity execution: each instruction is fetched and executed at once
+	// and its cycle cost is charged to the clock in bulk. Both return the number of cycles executed.
+	// RunFor stops at the first instruction boundary at or after the requested number of cycles.
+	uint64_t RunFor(Memory64k& mem, uint64_t cycles);
+	uint64_t RunInstructions(Memory64k& mem, uint64_t count);
+
+	// Writes done by the CPU are tracked, memory modified from outside while code in that range
+	// was already executed by the BlockCache core must be signaled here.
+	void InvalidateCode(uint16_t address, uint32_t size);
+
+	// Status register in the hardware bit order (NV-BDIZC) as pushed on the stack.
+	// The unused bit 5 always reads as 1, B only exists in the pushed copy.
+	uint8_t GetStatus(bool breakFlag = false) const
+	{
+		return (NResult & kStatusN) | (V ? kStatusV : 0) | kStatusUnused | (breakFlag ? kStatusB : 0)
+			| (D ? kStatusD : 0) | (I ? kStatusI : 0) | (ZResult == 0 ? kStatusZ : 0) | (C ? kStatusC : 0);
+	}
+
+	void SetStatus(uint8_t status)
+	{
+		NResult = status & kStatusN;
+		ZResult = (status & kStatusZ) ? 0 : 1;
+		C = (status & kStatusC) ? 1 : 0;
+		V = (status & kStatusV) ? 1 : 0;
+		D = (status & kStatusD) ? 1 : 0;
+		I = (status & kStatusI) ? 1 : 0;
+	}
+
+	static constexpr uint8_t kStatusN = 0x80; // Negative
+	static constexpr uint8_t kStatusV = 0x40; // Overflow
+	static constexpr uint8_t kStatusUnused = 0x20;
+	static constexpr uint8_t kStatusB = 0x10; // Break Command
+	static constexpr uint8_t kStatusD = 0x08; // Decimal Mode
+	static constexpr uint8_t kStatusI = 0x04; // Interrupt Disable
+	static constexpr uint8_t kStatusZ = 0x02; // Zero flag
+	static constexpr uint8_t kStatusC = 0x01; // Carry flag
+
+	// Registers and memory of the machine, taken and restored between instructions.
+	// The memory pages are shared copy-on-write with the live memory and the other snapshots.
+	struct Snapshot
+	{
+		Memory64k::Snapshot memory;
+		uint8_t a;
+		uint8_t x;
+		uint8_t y;
+		uint16_t sp;
+		uint16_t pc;
+		uint8_t status;
+		bool interruptPending;
+	};
+
+	Snapshot TakeSnapshot(Memory64k& mem) const;
+	// Can fork from a snapshot of another machine, only the pages differing from the current ones are copied
+	void Restore(Memory64k& mem, const Snapshot& snapshot);
+
+	// Debug helper, prints the implemented opcodes of the model as a 16x16 map to stdout
+	void PrintOpcodeMap() const;
+
+	// Number of times a fused instruction pair ran, always 0 with the FunctionTable and Switch cores
+	uint64_t FusionCount(Cpu6502Fusion fusion) const;
+
+#if CPU6502_TRACE
+	// Memory accesses of the instructions and interrupts go to the ring until it is detached with nullptr.
+	// The CPU thread is its only producer and it must outlive the runs. While tracing, every instruction
+	// goes through the interpreters: no polling loop fast forward, no fused pairs and no native code.
+	void SetTrace(TraceRing* ring)
+	{
+		Tracer = ring;
+	}
+
+	TraceRing* GetTrace() const
+	{
+		return Tracer;
+	}
+#endif
+
 private:
-	uint8_t FetchProgramInstruction(Memory64k& mem)
+	// Borrows the kernels and the instruction tables, and runs its scalar instructions through a Cpu6502
+	friend class Cpu6502Batch;
+
+	MEMORY_FORCE_INLINE uint8_t FetchProgramInstruction(Memory64k& mem)
 	{
 		assert(PC < 0xFFFF);
-		return mem[PC++];
+		return mem.BusRead(PC++);
 	}
 
+	bool IsTracing() const
+	{
+#if CPU6502_TRACE
+		return Tracer != nullptr;
+#else
+		return false;
+#endif
+	}
+
+#if CPU6502_TRACE
+	// The cores call it before each instruction, the accesses it does are recorded with its cycle and PC
+	void TraceInstruction(uint64_t cycle)
+	{
+		TraceCycle = cycle;
+		TracePC = PC;
+	}
+
+	void TraceMemory(uint16_t address, uint8_t value, TraceAccess access)
+	{
+		if (Tracer)
+			Tracer->Push({ TraceCycle, TracePC, address, value, access });
+	}
+#endif
+
+	// Cycles of the IRQ sequence, run by ExecuteCycle like an instruction
+	static constexpr uint8_t kInterruptCycles = 7;
+
+	// Fetch, decode and execute a whole instruction, returns its cycle count
+	uint8_t ExecuteInstruction(Memory64k& mem);
+
+	// Same as ExecuteInstruction once the model and opcode are known at compile time, so the handlers can be inlined
+	template <Cpu6502Model MODEL, uint8_t OPCODE>
+	uint8_t ExecuteOpcode(Memory64k& mem);
+
+	// Run until either limit is reached, returns the number of cycles executed
+	uint64_t Run(Memory64k& mem, uint64_t maxCycles, uint64_t maxInstructions);
+	// Cores run by Run, also return the number of instructions executed
+	uint64_t RunCore(Memory64k& mem, uint64_t maxCycles, uint64_t maxInstructions, uint64_t& instructions);
+	uint64_t RunFunctionTable(Memory64k& mem, uint64_t maxCycles, uint64_t maxInstructions, uint64_t& instructions);
+	template <Cpu6502Model MODEL>
+	uint64_t RunSwitch(Memory64k& mem, uint64_t maxCycles, uint64_t maxInstructions, uint64_t& instructions);
+	uint64_t RunBlockCache(Memory64k& mem, uint64_t maxCycles, uint64_t maxInstructions, uint64_t& instructions);
+	uint64_t RunJit(Memory64k& mem, uint64_t maxCycles, uint64_t maxInstructions, uint64_t& instructions);
+
 	Clock& CpuClock;
 
 	uint8_t A; // Accumulator register
@@ -37,34 +203,55 @@ private:
 	uint8_t Y; // Y index register
 	uint16_t SP; // Stack pointer
 	uint16_t PC; // Program Counter
-	union
-	{
-		uint8_t F;
-		struct {
-			uint8_t N : 1; // Negative
-			uint8_t V : 1; // Overflow
-			uint8_t ZZZ : 1; // Unused
-			uint8_t B : 1; // Break Command
-			uint8_t D : 1; // Decimal Mode
-			uint8_t I : 1; // Interrupt Disable
-			uint8_t Z : 1; // Zero flag
-			uint8_t C : 1; // Carry flag
-		};
-	};
+
+	// Flags. N and Z are only evaluated when read, from the result of the last instruction setting them,
+	// the others are plain 0/1 values. GetStatus/SetStatus convert from/to the hardware status register.
+	uint8_t NResult; // N is bit 7 of this value
+	uint8_t ZResult; // Z is set when this value is 0
+	uint8_t C; // Carry flag
+	uint8_t V; // Overflow
+	uint8_t D; // Decimal Mode
+	uint8_t I; // Interrupt Disable
 
 	struct InstructionInformation
 	{
 		uint8_t size;
 		uint8_t cycles;
+		bool changesFlow; // Branch, jump, call or return: ends a basic block
+		bool readOnly; // Only reads memory (loads, compares, branches, jumps), used to detect polling loops
 		void (*func)(Cpu6502* cpu, Memory64k& mem);
-		uint8_t(*extraCycle)(Cpu6502* cpu, Memory64k& mem);
+		uint8_t(*execute)(Cpu6502* cpu, Memory64k& mem); // func, returns the extra cycles (page crossing, branch taken)
 	};
 
+	bool InterruptPending; // IRQ raised, serviced at the start of the next run or the next per cycle instruction
 	uint8_t NextInstruction : 1; // Signal to fetch new intruction
+	uint8_t InterruptSequence : 1; // The per cycle path is running an interrupt instead of an instruction
 	uint8_t InstructionCycle : 3; // Current cycle in the instruction
-	uint8_t InstructionDecoding[4];
+	uint8_t InstructionExtraCycles : 2; // Extra cycles of the instruction, known once executed
+	uint8_t InstructionDecoding[6]; // Opcode and operands, of both instructions for fused pairs
 	Cpu6502Model Model;
+	Cpu6502Core Core;
+
+	// Information for instruction decoding, one table per model with its quirks built in
+	template <Cpu6502Model MODEL>
+	static const InstructionInformation InstructionTable[256];
+	const InstructionInformation* InstructionInfo; // Table of Model, chosen at construction
+
+	// Addressing mode and operation kernels the instructions are built from (6502Kernels.h)
+	struct Kernels;
+
+	// Pre-decoded basic blocks for the BlockCache core (6502BlockCache.h)
+	class BlockCache;
+	std::unique_ptr<BlockCache> Blocks;
+
+	// Host code translator for the Jit core (6502Jit.h)
+	class Jit;
+	std::unique_ptr<Jit> JitCompiler;
 
-	// Information for instruction decoding
-	static const InstructionInformation InstructionInfo[256];
+#if CPU6502_TRACE
+	TraceRing* Tracer;
+	uint64_t TraceBase; // Clock cycle the running core started at
+	uint64_t TraceCycle;
+	uint16_t TracePC;
+#endif
 };
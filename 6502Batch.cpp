@@ -0,0 +1,867 @@
+#include "6502Batch.h"
+#include "6502Kernels.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstring>
+
+// Per lane arrays of Cpu6502Batch::Group
+#define CPU6502_BATCH_GROUP_FIELDS(X) X(lanes) X(a) X(x) X(y) X(n) X(z) X(c) X(v)
+
+Cpu6502Batch::Cpu6502Batch(Cpu6502Model model, size_t laneCount)
+	: LaneCount(laneCount)
+	, A(laneCount)
+	, X(laneCount)
+	, Y(laneCount)
+	, SP(laneCount)
+	, PC(laneCount)
+	, NResult(laneCount)
+	, ZResult(laneCount, 1)
+	, C(laneCount)
+	, V(laneCount)
+	, D(laneCount)
+	, I(laneCount)
+	, Cycles(laneCount)
+	, Limit(laneCount)
+	, Memories(laneCount)
+	, Ram(laneCount)
+	, CodeSnapshot(kMemory64kSize)
+	, CodeSnapshotValid()
+	, CodeState(laneCount * 0x100, kCodeUnknown)
+	, SameLanes()
+	, LanesWithMemory(0)
+	, Groups(laneCount + 2)
+	, FreeGroups()
+	, GroupAt(kMemory64kSize)
+	, Occupied()
+	, OccupiedWords()
+	, Current(&Groups[laneCount])
+	, Split(&Groups[laneCount + 1])
+	, Address(laneCount)
+	, Value(laneCount)
+	, Extra(laneCount)
+	, Next(laneCount)
+	, ScalarClock(1000000)
+	, Scalar(ScalarClock, model, Cpu6502Core::Switch)
+	, Code()
+	, Decode()
+	, Dispatches(0)
+	, LaneInstructions(0)
+{
+	// A placed group has one lane at least
+	for (size_t group = 0; group < laneCount; ++group)
+		FreeGroups.push_back(&Groups[group]);
+
+	using K = Cpu6502::Kernels;
+#define CPU6502_BATCH_MATCH(mode, operation) Match<K::mode, K::operation>(opcode, Mode::mode, Operation::operation);
+#define CPU6502_BATCH_READ(operation) \
+	CPU6502_BATCH_MATCH(Immediate, operation) CPU6502_BATCH_MATCH(ZeroPage, operation) CPU6502_BATCH_MATCH(ZeroPageX, operation) \
+	CPU6502_BATCH_MATCH(ZeroPageY, operation) CPU6502_BATCH_MATCH(Absolute, operation) CPU6502_BATCH_MATCH(AbsoluteX, operation) \
+	CPU6502_BATCH_MATCH(AbsoluteY, operation) CPU6502_BATCH_MATCH(IndexedIndirect, operation) CPU6502_BATCH_MATCH(IndirectIndexed, operation)
+#define CPU6502_BATCH_WRITE(operation) \
+	CPU6502_BATCH_MATCH(ZeroPage, operation) CPU6502_BATCH_MATCH(ZeroPageX, operation) CPU6502_BATCH_MATCH(ZeroPageY, operation) \
+	CPU6502_BATCH_MATCH(Absolute, operation) CPU6502_BATCH_MATCH(AbsoluteX, operation) CPU6502_BATCH_MATCH(AbsoluteY, operation) \
+	CPU6502_BATCH_MATCH(IndexedIndirect, operation) CPU6502_BATCH_MATCH(IndirectIndexed, operation)
+#define CPU6502_BATCH_MODIFY(operation) \
+	CPU6502_BATCH_MATCH(Accumulator, operation) CPU6502_BATCH_MATCH(ZeroPage, operation) CPU6502_BATCH_MATCH(ZeroPageX, operation) \
+	CPU6502_BATCH_MATCH(Absolute, operation) CPU6502_BATCH_MATCH(AbsoluteX, operation)
+#define CPU6502_BATCH_BRANCH(operation) CPU6502_BATCH_MATCH(Relative, operation)
+#define CPU6502_BATCH_IMPLIED(operation) CPU6502_BATCH_MATCH(Implied, operation)
+
+	// The kernels are recognized from the handlers of the model table, so the batch follows its timings and quirks
+	for (int opcode = 0; opcode < 256; ++opcode)
+	{
+		const Cpu6502::InstructionInformation& instruction = Scalar.InstructionInfo[opcode];
+		Decode[opcode] = { Operation::Scalar, Mode::Implied, instruction.size, instruction.cycles };
+		if (instruction.size == 0)
+			continue;
+
+		CPU6502_BATCH_READ(Lda) CPU6502_BATCH_READ(Ldx) CPU6502_BATCH_READ(Ldy)
+		CPU6502_BATCH_READ(Ora) CPU6502_BATCH_READ(And) CPU6502_BATCH_READ(Eor)
+		CPU6502_BATCH_READ(Adc) CPU6502_BATCH_READ(Sbc)
+		CPU6502_BATCH_READ(Cmp) CPU6502_BATCH_READ(Cpx) CPU6502_BATCH_READ(Cpy) CPU6502_BATCH_READ(Bit)
+		CPU6502_BATCH_WRITE(Sta) CPU6502_BATCH_WRITE(Stx) CPU6502_BATCH_WRITE(Sty)
+		CPU6502_BATCH_MODIFY(Asl) CPU6502_BATCH_MODIFY(Lsr) CPU6502_BATCH_MODIFY(Rol) CPU6502_BATCH_MODIFY(Ror)
+		CPU6502_BATCH_MODIFY(Inc) CPU6502_BATCH_MODIFY(Dec)
+		CPU6502_BATCH_BRANCH(Bpl) CPU6502_BATCH_BRANCH(Bmi) CPU6502_BATCH_BRANCH(Bvc) CPU6502_BATCH_BRANCH(Bvs)
+		CPU6502_BATCH_BRANCH(Bcc) CPU6502_BATCH_BRANCH(Bcs) CPU6502_BATCH_BRANCH(Bne) CPU6502_BATCH_BRANCH(Beq)
+		CPU6502_BATCH_MATCH(Absolute, Jmp)
+		CPU6502_BATCH_IMPLIED(Clc) CPU6502_BATCH_IMPLIED(Sec) CPU6502_BATCH_IMPLIED(Cli) CPU6502_BATCH_IMPLIED(Sei)
+		CPU6502_BATCH_IMPLIED(Cld) CPU6502_BATCH_IMPLIED(Clv) CPU6502_BATCH_IMPLIED(Nop)
+		CPU6502_BATCH_IMPLIED(Tax) CPU6502_BATCH_IMPLIED(Tay) CPU6502_BATCH_IMPLIED(Txa) CPU6502_BATCH_IMPLIED(Tya)
+		CPU6502_BATCH_IMPLIED(Tsx) CPU6502_BATCH_IMPLIED(Txs)
+		CPU6502_BATCH_IMPLIED(Inx) CPU6502_BATCH_IMPLIED(Iny) CPU6502_BATCH_IMPLIED(Dex) CPU6502_BATCH_IMPLIED(Dey)
+	}
+
+#undef CPU6502_BATCH_IMPLIED
+#undef CPU6502_BATCH_BRANCH
+#undef CPU6502_BATCH_MODIFY
+#undef CPU6502_BATCH_WRITE
+#undef CPU6502_BATCH_READ
+#undef CPU6502_BATCH_MATCH
+}
+
+template <class MODE, class OPERATION>
+void Cpu6502Batch::Match(uint8_t opcode, Mode mode, Operation operation)
+{
+	if (Scalar.InstructionInfo[opcode].execute == &Cpu6502::Kernels::ExecuteWithExtraCycle<MODE, OPERATION>)
+	{
+		Decode[opcode].operation = operation;
+		Decode[opcode].mode = mode;
+	}
+}
+
+void Cpu6502Batch::Reset(size_t lane, Memory64k& mem)
+{
+	LanesWithMemory += Memories[lane] == nullptr;
+	Memories[lane] = &mem;
+	InvalidateCode(lane, 0, kMemory64kSize);
+	PC[lane] = combineAddr(mem.Read(0xFFFC), mem.Read(0xFFFD));
+	SP[lane] = 0x1FD;
+	A[lane] = X[lane] = Y[lane] = 0;
+	NResult[lane] = 0;
+	ZResult[lane] = 1;
+	C[lane] = V[lane] = D[lane] = 0;
+	I[lane] = 1;
+}
+
+Cpu6502Batch::Registers Cpu6502Batch::GetRegisters(size_t lane) const
+{
+	uint8_t status = (NResult[lane] & Cpu6502::kStatusN) | (V[lane] ? Cpu6502::kStatusV : 0) | Cpu6502::kStatusUnused
+		| (D[lane] ? Cpu6502::kStatusD : 0) | (I[lane] ? Cpu6502::kStatusI : 0) | (ZResult[lane] == 0 ? Cpu6502::kStatusZ : 0)
+		| (C[lane] ? Cpu6502::kStatusC : 0);
+	return { A[lane], X[lane], Y[lane], SP[lane], PC[lane], status };
+}
+
+void Cpu6502Batch::SetRegisters(size_t lane, const Registers& registers)
+{
+	A[lane] = registers.a;
+	X[lane] = registers.x;
+	Y[lane] = registers.y;
+	SP[lane] = registers.sp;
+	PC[lane] = registers.pc;
+	Scalar.SetStatus(registers.status);
+	NResult[lane] = Scalar.NResult;
+	ZResult[lane] = Scalar.ZResult;
+	C[lane] = Scalar.C;
+	V[lane] = Scalar.V;
+	D[lane] = Scalar.D;
+	I[lane] = Scalar.I;
+}
+
+
+size_t Cpu6502Batch::Group::Add()
+{
+	Resize(size + 1);
+	return size - 1;
+}
+
+void Cpu6502Batch::Group::Append(const Group& from, size_t index)
+{
+	const size_t to = Add();
+#define CPU6502_BATCH_APPEND(field) field[to] = from.field[index];
+	CPU6502_BATCH_GROUP_FIELDS(CPU6502_BATCH_APPEND)
+#undef CPU6502_BATCH_APPEND
+}
+
+void Cpu6502Batch::Group::Append(const Group& from)
+{
+	const size_t to = size;
+	Resize(size + from.size);
+#define CPU6502_BATCH_APPEND(field) std::copy_n(from.field.data(), from.size, field.data() + to);
+	CPU6502_BATCH_GROUP_FIELDS(CPU6502_BATCH_APPEND)
+#undef CPU6502_BATCH_APPEND
+}
+
+void Cpu6502Batch::Group::Move(size_t to, size_t from)
+{
+#define CPU6502_BATCH_MOVE(field) field[to] = field[from];
+	CPU6502_BATCH_GROUP_FIELDS(CPU6502_BATCH_MOVE)
+#undef CPU6502_BATCH_MOVE
+}
+
+void Cpu6502Batch::Group::Resize(size_t size)
+{
+	if (size > lanes.size())
+	{
+		const size_t capacity = std::max<size_t>(size, lanes.size() * 2);
+#define CPU6502_BATCH_RESIZE(field) field.resize(capacity);
+		CPU6502_BATCH_GROUP_FIELDS(CPU6502_BATCH_RESIZE)
+#undef CPU6502_BATCH_RESIZE
+	}
+	this->size = size;
+}
+
+uint64_t Cpu6502Batch::RunFor(uint64_t cycles)
+{
+	// Lanes without memory never run
+	for (uint32_t lane = 0; lane < uint32_t(LaneCount); ++lane)
+	{
+		Limit[lane] = Cycles[lane] + cycles;
+		// Only the bus can change the mapping, which the lanes of flat memories never reach
+		Ram[lane] = Memories[lane] && Memories[lane]->IsFlat() ? Memories[lane]->GetData() : nullptr;
+		if (Memories[lane] && cycles > 0)
+			PlaceLane(PC[lane], lane);
+	}
+
+	uint64_t instructions = 0;
+	uint16_t pc;
+	while (TakeLowestGroup(pc))
+	{
+		SelectGroup(pc);
+		const size_t size = Current->GetSize();
+		instructions += size;
+		++Dispatches;
+
+		const Decoded& decoded = Decode[Code[0]];
+		const bool store = decoded.operation >= Operation::Sta && decoded.operation <= Operation::Dec
+			&& decoded.mode != Mode::Accumulator;
+		if (size <= kScalarGroupSize && !store)
+			instructions += RunScalar(pc) - size;
+		else if (decoded.operation == Operation::Scalar)
+			ExecuteScalar(pc);
+		else
+			Execute(decoded, Code, pc);
+	}
+
+	LaneInstructions += instructions;
+	return instructions;
+}
+
+uint32_t Cpu6502Batch::GetLowestPC() const
+{
+	for (uint32_t summary = 0; summary < std::size(OccupiedWords); ++summary)
+	{
+		if (OccupiedWords[summary] != 0)
+		{
+			const uint32_t word = summary * 64 + std::countr_zero(OccupiedWords[summary]);
+			return word * 64 + std::countr_zero(Occupied[word]);
+		}
+	}
+	return 0x10000;
+}
+
+bool Cpu6502Batch::TakeLowestGroup(uint16_t& pc)
+{
+	const uint32_t lowest = GetLowestPC();
+	if (lowest == 0x10000)
+		return false;
+
+	pc = uint16_t(lowest);
+	uint64_t& word = Occupied[pc / 64];
+	word &= word - 1;
+	if (word == 0)
+		OccupiedWords[pc / 64 / 64] &= ~(uint64_t(1) << (pc / 64 % 64));
+
+	assert(Current->GetSize() == 0);
+	FreeGroups.push_back(Current);
+	Current = GroupAt[pc];
+	return true;
+}
+
+void Cpu6502Batch::Place(uint16_t pc, Group*& group)
+{
+	// The lanes which reached their limit are already out
+	if (group->GetSize() == 0)
+		return;
+
+	uint64_t& word = Occupied[pc / 64];
+	const uint64_t bit = uint64_t(1) << (pc % 64);
+	if (!(word & bit))
+	{
+		GroupAt[pc] = group;
+		word |= bit;
+		OccupiedWords[pc / 64 / 64] |= uint64_t(1) << (pc / 64 % 64);
+		group = FreeGroups.back();
+		FreeGroups.pop_back();
+		assert(group->GetSize() == 0);
+		return;
+	}
+
+	// Reconverged, the lanes join the group waiting there. The lanes of the group ahead get the
+	// difference of pending cycles.
+	Group& target = *GroupAt[pc];
+	Group& ahead = group->pending > target.pending ? *group : target;
+	const uint64_t pending = std::min(group->pending, target.pending);
+	for (size_t index = 0; index < ahead.size; ++index)
+		Cycles[ahead.lanes[index]] += ahead.pending - pending;
+	ahead.budget -= ahead.pending - pending;
+	target.pending = pending;
+	target.budget = std::min(group->budget, target.budget);
+	target.Append(*group);
+	group->Resize(0);
+}
+
+void Cpu6502Batch::PlaceLane(uint16_t pc, uint32_t lane)
+{
+	const size_t index = Split->Add();
+	Split->lanes[index] = lane;
+	Split->a[index] = A[lane];
+	Split->x[index] = X[lane];
+	Split->y[index] = Y[lane];
+	Split->n[index] = NResult[lane];
+	Split->z[index] = ZResult[lane];
+	Split->c[index] = C[lane];
+	Split->v[index] = V[lane];
+	Split->pending = 0;
+	Split->budget = Limit[lane] - Cycles[lane];
+	Place(pc, Split);
+}
+
+void Cpu6502Batch::StoreLane(const Group& group, size_t index, uint16_t pc)
+{
+	const uint32_t lane = group.lanes[index];
+	A[lane] = group.a[index];
+	X[lane] = group.x[index];
+	Y[lane] = group.y[index];
+	PC[lane] = pc;
+	NResult[lane] = group.n[index];
+	ZResult[lane] = group.z[index];
+	C[lane] = group.c[index];
+	V[lane] = group.v[index];
+}
+
+void Cpu6502Batch::Regroup()
+{
+	// Lanes at the Next PC of the first one stay in Current, the others are split again
+	while (Current->GetSize() > 0)
+	{
+		const uint16_t pc = Next[0];
+		size_t kept = 0;
+		size_t split = 0;
+		Split->pending = Current->pending;
+		Split->budget = Current->budget;
+		for (size_t index = 0; index < Current->GetSize(); ++index)
+		{
+			if (Next[index] != pc)
+			{
+				Split->Append(*Current, index);
+				Next[split++] = Next[index];
+			}
+			else if (kept++ != index)
+			{
+				Current->Move(kept - 1, index);
+			}
+		}
+		Current->Resize(kept);
+		Place(pc, Current);
+		std::swap(Current, Split);
+	}
+}
+
+void Cpu6502Batch::Charge(uint8_t cycles, uint16_t next)
+{
+	Current->pending += cycles;
+	if (Current->pending >= Current->budget)
+	{
+		std::fill_n(Next.data(), Current->GetSize(), next);
+		FlushCycles(false);
+	}
+	Place(next, Current);
+}
+
+void Cpu6502Batch::FlushCycles(bool extra)
+{
+	// Each lane stops at its first instruction boundary at or after its limit
+	Group& group = *Current;
+	uint64_t budget = UINT64_MAX;
+	size_t kept = 0;
+	for (size_t index = 0; index < group.size; ++index)
+	{
+		const uint32_t lane = group.lanes[index];
+		Cycles[lane] += group.pending + (extra ? Extra[index] : 0);
+		if (Cycles[lane] < Limit[lane])
+		{
+			budget = std::min(budget, Limit[lane] - Cycles[lane]);
+			if (kept != index)
+			{
+				Next[kept] = Next[index];
+				group.Move(kept, index);
+			}
+			++kept;
+		}
+		else
+		{
+			StoreLane(group, index, Next[index]);
+		}
+	}
+	group.Resize(kept);
+	group.pending = 0;
+	group.budget = budget;
+}
+
+void Cpu6502Batch::SelectGroup(uint16_t pc)
+{
+	// The instruction is decoded from the first lane of the group
+	Group& group = *Current;
+	const uint32_t leader = group.lanes[0];
+	Code[0] = Read(leader, pc);
+	const uint8_t size = std::max<uint8_t>(Decode[Code[0]].size, 1);
+	for (uint8_t i = 1; i < 3; ++i)
+		Code[i] = i < size ? Read(leader, uint16_t(pc + i)) : 0;
+
+	// Same PC does not mean same instruction, each lane has its own memory. Lanes whose code page
+	// still matches the snapshot have the same instruction as a leader in the same state.
+	const uint8_t page = pc >> 8;
+	const bool samePage = (pc & 0xFF) + size <= 0x100;
+	if (!CodeSnapshotValid[page] && Ram[leader])
+	{
+		memcpy(&CodeSnapshot[page << 8], Ram[leader] + (page << 8), 0x100);
+		CodeSnapshotValid[page] = true;
+	}
+	const uint8_t* state = &CodeState[page * LaneCount];
+	const bool leaderSame = samePage && CheckCode(leader, page) == kCodeSame;
+	if (leaderSame && SameLanes[page] == LanesWithMemory)
+		return;
+
+	uint8_t pending = leaderSame ? 0 : 0xFF;
+	for (size_t index = 0; index < group.size; ++index)
+		pending |= uint8_t(~state[group.lanes[index]]);
+	if (!pending)
+		return;
+
+	size_t kept = 1;
+	Split->pending = group.pending;
+	Split->budget = group.budget;
+	for (size_t index = 1; index < group.size; ++index)
+	{
+		const uint32_t lane = group.lanes[index];
+		bool same = leaderSame && (state[lane] == kCodeSame || CheckCode(lane, page) == kCodeSame);
+		for (uint8_t i = 0; i < size && !same; ++i)
+		{
+			if (Read(lane, uint16_t(pc + i)) != Code[i])
+				break;
+			same = i + 1 == size;
+		}
+		if (!same)
+			Split->Append(group, index);
+		else if (kept++ != index)
+			group.Move(kept - 1, index);
+	}
+	group.Resize(kept);
+	Place(pc, Split);
+}
+
+uint8_t Cpu6502Batch::CheckCode(size_t lane, uint8_t page)
+{
+	// The code of the lanes on the bus is always compared, it can come from a bank or a device
+	if (!Ram[lane] || !CodeSnapshotValid[page])
+		return kCodeDifferent;
+	if (CodeState[page * LaneCount + lane] == kCodeUnknown)
+		SetCodeState(lane, page, memcmp(Ram[lane] + (page << 8), &CodeSnapshot[page << 8], 0x100) == 0 ? kCodeSame : kCodeDifferent);
+	return CodeState[page * LaneCount + lane];
+}
+
+void Cpu6502Batch::InvalidateCode(size_t lane, uint16_t address, uint32_t size)
+{
+	if (size == 0)
+		return;
+	uint32_t last = std::min<uint32_t>(address + size - 1, 0xFFFF) >> 8;
+	for (uint32_t page = address >> 8; page <= last; ++page)
+		SetCodeState(lane, uint8_t(page), kCodeUnknown);
+}
+
+void Cpu6502Batch::LoadScalar(const Group& group, size_t index, uint16_t pc)
+{
+	const uint32_t lane = group.lanes[index];
+	Scalar.A = group.a[index];
+	Scalar.X = group.x[index];
+	Scalar.Y = group.y[index];
+	Scalar.SP = SP[lane];
+	Scalar.PC = pc;
+	Scalar.NResult = group.n[index];
+	Scalar.ZResult = group.z[index];
+	Scalar.C = group.c[index];
+	Scalar.V = group.v[index];
+	Scalar.D = D[lane];
+	Scalar.I = I[lane];
+}
+
+void Cpu6502Batch::StoreScalar(Group& group, size_t index)
+{
+	const uint32_t lane = group.lanes[index];
+	group.a[index] = Scalar.A;
+	group.x[index] = Scalar.X;
+	group.y[index] = Scalar.Y;
+	SP[lane] = Scalar.SP;
+	group.n[index] = Scalar.NResult;
+	group.z[index] = Scalar.ZResult;
+	group.c[index] = Scalar.C;
+	group.v[index] = Scalar.V;
+	D[lane] = Scalar.D;
+	I[lane] = Scalar.I;
+}
+
+void Cpu6502Batch::ExecuteScalar(uint16_t pc)
+{
+	Group& group = *Current;
+	for (size_t index = 0; index < group.size; ++index)
+	{
+		const uint32_t lane = group.lanes[index];
+		LoadScalar(group, index, pc);
+		Extra[index] = Scalar.ExecuteInstruction(*Memories[lane]);
+		// The scalar instructions only write to the stack (BRK, JSR, PHA, PHP)
+		if (!Scalar.InstructionInfo[Code[0]].readOnly)
+			InvalidateCode(lane, Cpu6502::Kernels::kStackPage, 0x100);
+		StoreScalar(group, index);
+		Next[index] = Scalar.PC;
+	}
+	FlushCycles(true);
+	Regroup();
+}
+
+uint64_t Cpu6502Batch::RunScalar(uint16_t pc)
+{
+	Group& group = *Current;
+	uint64_t instructions = 0;
+	for (size_t index = 0; index < group.size; ++index)
+	{
+		// The groups don't move meanwhile, the lane runs until it reaches the lowest one where it
+		// merges, or passes it and lets it run first
+		const uint32_t stop = GetLowestPC();
+		const uint32_t lane = group.lanes[index];
+		Memory64k& mem = *Memories[lane];
+		Cycles[lane] += group.pending;
+		LoadScalar(group, index, pc);
+		uint8_t opcode = Code[0];
+		for (;;)
+		{
+			Cycles[lane] += Scalar.ExecuteInstruction(mem);
+			++instructions;
+			if (!Scalar.InstructionInfo[opcode].readOnly)
+				InvalidateCode(lane, Cpu6502::Kernels::kStackPage, 0x100);
+			if (Cycles[lane] >= Limit[lane] || Scalar.PC >= stop)
+				break;
+
+			// The stores of the kernels keep the code states up to date, the lane goes back to them
+			opcode = Read(lane, Scalar.PC);
+			const Decoded& decoded = Decode[opcode];
+			if (decoded.operation >= Operation::Sta && decoded.operation <= Operation::Dec && decoded.mode != Mode::Accumulator)
+				break;
+		}
+
+		StoreScalar(group, index);
+		if (Cycles[lane] >= Limit[lane])
+		{
+			StoreLane(group, index, Scalar.PC);
+			continue;
+		}
+		Split->Append(group, index);
+		Split->pending = 0;
+		Split->budget = Limit[lane] - Cycles[lane];
+		Place(Scalar.PC, Split);
+	}
+	group.Resize(0);
+	return instructions;
+}
+
+bool Cpu6502Batch::LoadAddress(Mode mode, const uint8_t* bytes, bool pageCrossCycle)
+{
+	const Group& group = *Current;
+	const size_t count = group.size;
+	const uint32_t* lanes = group.lanes.data();
+	const uint8_t operand8 = bytes[1];
+	const uint16_t operand16 = combineAddr(bytes[1], bytes[2]);
+	uint16_t* address = Address.data();
+	uint8_t* extra = Extra.data();
+	const uint8_t* index = mode == Mode::ZeroPageX || mode == Mode::AbsoluteX || mode == Mode::IndexedIndirect
+		? group.x.data() : group.y.data();
+	uint8_t crossed = 0;
+	switch (mode)
+	{
+	case Mode::ZeroPage:
+		std::fill_n(address, count, operand8);
+		break;
+	case Mode::ZeroPageX:
+	case Mode::ZeroPageY:
+		for (size_t i = 0; i < count; ++i)
+			address[i] = uint8_t(operand8 + index[i]);
+		break;
+	case Mode::Absolute:
+		std::fill_n(address, count, operand16);
+		break;
+	case Mode::AbsoluteX:
+	case Mode::AbsoluteY:
+		for (size_t i = 0; i < count; ++i)
+			address[i] = uint16_t(operand16 + index[i]);
+		// Reads take 1 more cycle when the index crosses a page
+		if (pageCrossCycle)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				extra[i] = operand8 + index[i] > 0xFF ? 1 : 0;
+				crossed |= extra[i];
+			}
+		}
+		break;
+	case Mode::IndexedIndirect:
+		// Pointers are read from the zero page of each lane
+		for (size_t i = 0; i < count; ++i)
+		{
+			const uint8_t pointer = uint8_t(operand8 + index[i]);
+			address[i] = combineAddr(Read(lanes[i], pointer), Read(lanes[i], uint8_t(pointer + 1)));
+		}
+		break;
+	case Mode::IndirectIndexed:
+		for (size_t i = 0; i < count; ++i)
+		{
+			const uint8_t low = Read(lanes[i], operand8);
+			address[i] = uint16_t(combineAddr(low, Read(lanes[i], uint8_t(operand8 + 1))) + index[i]);
+			extra[i] = pageCrossCycle && low + index[i] > 0xFF ? 1 : 0;
+			crossed |= extra[i];
+		}
+		break;
+	default:
+		break;
+	}
+	return crossed != 0;
+}
+
+void Cpu6502Batch::LoadValue(Mode mode, const uint8_t* bytes)
+{
+	const Group& group = *Current;
+	const size_t count = group.size;
+	uint8_t* value = Value.data();
+	switch (mode)
+	{
+	case Mode::Immediate:
+		std::fill_n(value, count, bytes[1]);
+		break;
+	case Mode::Accumulator:
+		std::copy_n(group.a.data(), count, value);
+		break;
+	default:
+		for (size_t i = 0; i < count; ++i)
+			value[i] = Read(group.lanes[i], Address[i]);
+		break;
+	}
+}
+
+void Cpu6502Batch::StoreValue()
+{
+	const Group& group = *Current;
+	for (size_t i = 0; i < group.size; ++i)
+	{
+		const uint32_t lane = group.lanes[i];
+		const uint16_t address = Address[i];
+		if (uint8_t* ram = Ram[lane])
+		{
+			ram[address] = Value[i];
+			Memories[lane]->MarkWritten(address);
+		}
+		else
+		{
+			Memories[lane]->BusWrite(address, Value[i]);
+		}
+		// Only the pages with a snapshot have a code state
+		if (CodeSnapshotValid[address >> 8])
+			SetCodeState(lane, address >> 8, kCodeUnknown);
+	}
+}
+
+void Cpu6502Batch::Execute(const Decoded& decoded, const uint8_t* bytes, uint16_t pc)
+{
+	Group& group = *Current;
+	const size_t count = group.size;
+	const uint32_t* lanes = group.lanes.data();
+	uint8_t* value = Value.data();
+	uint8_t* a = group.a.data();
+	uint8_t* x = group.x.data();
+	uint8_t* y = group.y.data();
+	uint8_t* n = group.n.data();
+	uint8_t* z = group.z.data();
+	uint8_t* c = group.c.data();
+	uint8_t* v = group.v.data();
+	uint8_t* extra = Extra.data();
+	uint16_t next = uint16_t(pc + decoded.size);
+
+	bool crossed = false;
+	if (decoded.mode != Mode::Implied && decoded.mode != Mode::Relative)
+	{
+		// Only the reads take the page crossing cycle
+		bool read = decoded.operation <= Operation::Bit;
+		crossed = LoadAddress(decoded.mode, bytes, read);
+		if (read || (decoded.operation >= Operation::Asl && decoded.operation <= Operation::Dec))
+			LoadValue(decoded.mode, bytes);
+	}
+
+	// Register and flag updates, each case is a single pass over the lanes
+	auto load = [&](uint8_t* reg)
+	{
+		for (size_t i = 0; i < count; ++i)
+			reg[i] = n[i] = z[i] = value[i];
+	};
+	auto logic = [&](auto operation)
+	{
+		for (size_t i = 0; i < count; ++i)
+			a[i] = n[i] = z[i] = operation(a[i], value[i]);
+	};
+	auto compare = [&](const uint8_t* reg)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			c[i] = reg[i] >= value[i];
+			n[i] = z[i] = uint8_t(reg[i] - value[i]);
+		}
+	};
+	auto add = [&](uint8_t invert)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			assert(!D[lanes[i]]); // Decimal mode not implemented !!!
+			uint8_t operand = value[i] ^ invert;
+			uint16_t result = a[i] + operand + c[i];
+			v[i] = ((~(a[i] ^ operand) & (a[i] ^ result)) >> 7) & 1;
+			c[i] = uint8_t(result >> 8);
+			a[i] = n[i] = z[i] = uint8_t(result);
+		}
+	};
+	auto modify = [&](auto operation)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			uint8_t carry = c[i];
+			value[i] = n[i] = z[i] = operation(value[i], carry);
+			c[i] = carry;
+		}
+		if (decoded.mode == Mode::Accumulator)
+			std::copy_n(value, count, a);
+		else
+			StoreValue();
+	};
+	auto store = [&](const uint8_t* reg)
+	{
+		std::copy_n(reg, count, value);
+		StoreValue();
+	};
+	auto setFlag = [&](uint8_t* flag, uint8_t set)
+	{
+		std::fill_n(flag, count, set);
+	};
+	auto setHomeFlag = [&](uint8_t* flag, uint8_t set)
+	{
+		for (size_t i = 0; i < count; ++i)
+			flag[lanes[i]] = set;
+	};
+	auto transfer = [&](uint8_t* destination, const uint8_t* source)
+	{
+		for (size_t i = 0; i < count; ++i)
+			destination[i] = n[i] = z[i] = source[i];
+	};
+	auto increment = [&](uint8_t* reg, uint8_t delta)
+	{
+		for (size_t i = 0; i < count; ++i)
+			reg[i] = n[i] = z[i] = uint8_t(reg[i] + delta);
+	};
+	auto branch = [&](auto taken)
+	{
+		// Taken branches take 1 more cycle, 2 when the destination is in another page
+		const uint16_t destination = next + Cpu6502::Kernels::AsInt8(bytes[1]);
+		const uint8_t takenCycles = (destination & 0xFF00) != (next & 0xFF00) ? 2 : 1;
+		size_t takenCount = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			extra[i] = taken(i) ? takenCycles : 0;
+			takenCount += extra[i] != 0;
+		}
+
+		// Usually the whole group goes the same way and stays together
+		if (takenCount == 0 || takenCount == count)
+		{
+			Charge(decoded.cycles + (takenCount ? takenCycles : 0), takenCount ? destination : next);
+			return;
+		}
+		// The lanes taking it leave for a group of their own, both halves keep the pending cycles
+		Split->pending = group.pending;
+		Split->budget = group.budget;
+		size_t kept = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (extra[i])
+				Split->Append(group, i);
+			else if (kept++ != i)
+				group.Move(kept - 1, i);
+		}
+		group.Resize(kept);
+		Charge(decoded.cycles, next);
+		std::swap(Current, Split);
+		Charge(decoded.cycles + takenCycles, destination);
+		std::swap(Current, Split);
+	};
+
+	switch (decoded.operation)
+	{
+	case Operation::Lda: load(a); break;
+	case Operation::Ldx: load(x); break;
+	case Operation::Ldy: load(y); break;
+	case Operation::Ora: logic([](uint8_t a, uint8_t value) { return uint8_t(a | value); }); break;
+	case Operation::And: logic([](uint8_t a, uint8_t value) { return uint8_t(a & value); }); break;
+	case Operation::Eor: logic([](uint8_t a, uint8_t value) { return uint8_t(a ^ value); }); break;
+	case Operation::Adc: add(0); break;
+	case Operation::Sbc: add(0xFF); break;
+	case Operation::Cmp: compare(a); break;
+	case Operation::Cpx: compare(x); break;
+	case Operation::Cpy: compare(y); break;
+	case Operation::Bit:
+		for (size_t i = 0; i < count; ++i)
+		{
+			n[i] = value[i];
+			v[i] = (value[i] >> 6) & 1;
+			z[i] = a[i] & value[i];
+		}
+		break;
+	case Operation::Sta: store(a); break;
+	case Operation::Stx: store(x); break;
+	case Operation::Sty: store(y); break;
+	case Operation::Asl: modify([](uint8_t value, uint8_t& carry) { carry = value >> 7; return uint8_t(value << 1); }); break;
+	case Operation::Lsr: modify([](uint8_t value, uint8_t& carry) { carry = value & 1; return uint8_t(value >> 1); }); break;
+	case Operation::Rol: modify([](uint8_t value, uint8_t& carry) { uint8_t in = carry; carry = value >> 7; return uint8_t((value << 1) | in); }); break;
+	case Operation::Ror: modify([](uint8_t value, uint8_t& carry) { uint8_t in = carry; carry = value & 1; return uint8_t((value >> 1) | (in << 7)); }); break;
+	case Operation::Inc: modify([](uint8_t value, uint8_t& carry) { return uint8_t(value + 1); }); break;
+	case Operation::Dec: modify([](uint8_t value, uint8_t& carry) { return uint8_t(value - 1); }); break;
+	case Operation::Bpl: branch([&](size_t i) { return (n[i] & 0x80) == 0; }); return;
+	case Operation::Bmi: branch([&](size_t i) { return (n[i] & 0x80) != 0; }); return;
+	case Operation::Bvc: branch([&](size_t i) { return v[i] == 0; }); return;
+	case Operation::Bvs: branch([&](size_t i) { return v[i] != 0; }); return;
+	case Operation::Bcc: branch([&](size_t i) { return c[i] == 0; }); return;
+	case Operation::Bcs: branch([&](size_t i) { return c[i] != 0; }); return;
+	case Operation::Bne: branch([&](size_t i) { return z[i] != 0; }); return;
+	case Operation::Beq: branch([&](size_t i) { return z[i] == 0; }); return;
+	case Operation::Jmp: next = combineAddr(bytes[1], bytes[2]); break;
+	case Operation::Clc: setFlag(c, 0); break;
+	case Operation::Sec: setFlag(c, 1); break;
+	case Operation::Cli: setHomeFlag(I.data(), 0); break;
+	case Operation::Sei: setHomeFlag(I.data(), 1); break;
+	case Operation::Cld: setHomeFlag(D.data(), 0); break;
+	case Operation::Clv: setFlag(v, 0); break;
+	case Operation::Tax: transfer(x, a); break;
+	case Operation::Tay: transfer(y, a); break;
+	case Operation::Txa: transfer(a, x); break;
+	case Operation::Tya: transfer(a, y); break;
+	case Operation::Tsx:
+		for (size_t i = 0; i < count; ++i)
+			x[i] = n[i] = z[i] = uint8_t(SP[lanes[i]]);
+		break;
+	case Operation::Txs:
+		for (size_t i = 0; i < count; ++i)
+			SP[lanes[i]] = uint16_t(Cpu6502::Kernels::kStackPage | x[i]);
+		break;
+	case Operation::Inx: increment(x, 1); break;
+	case Operation::Iny: increment(y, 1); break;
+	case Operation::Dex: increment(x, 0xFF); break;
+	case Operation::Dey: increment(y, 0xFF); break;
+	default: break;
+	}
+
+	// The other instructions all continue at next, the group stays together
+	if (!crossed)
+	{
+		Charge(decoded.cycles, next);
+		return;
+	}
+	std::fill_n(Next.data(), count, next);
+	group.pending += decoded.cycles;
+	FlushCycles(true);
+	Place(next, Current);
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+// Runs many independent 6502 instances of the same program in lockstep.
+// Every lane has its own memory. The running lanes are grouped by PC, each group holds the registers
+// of its lanes as structure of arrays. Each step takes the group at the lowest PC, decodes its
+// instruction once and executes it with plain loops over the arrays of the group, which the compiler
+// vectorizes with the ISA of the build (6502Batch.cpp alone gets AVX2, in the x64 Release configuration).
+// Lanes left behind by a branch run first until they catch up with the others, where their groups merge
+// again, and the lanes left alone run through the scalar CPU until then. Memory operands are
+// gathered/scattered per lane, instructions without a batch kernel (stack, calls, interrupts, indirect
+// jump) run through the scalar CPU one lane at a time.
+
+#include "6502.h"
+
+#include <cstdint>
+#include <vector>
+
+class Cpu6502Batch
+{
+public:
+	struct Registers
+	{
+		uint8_t a;
+		uint8_t x;
+		uint8_t y;
+		uint16_t sp;
+		uint16_t pc;
+		uint8_t status; // Hardware bit order, see Cpu6502::GetStatus
+	};
+
+	Cpu6502Batch(Cpu6502Model model, size_t laneCount);
+
+	Cpu6502Batch(const Cpu6502Batch&) = delete;
+	Cpu6502Batch& operator = (const Cpu6502Batch&) = delete;
+
+	size_t GetLaneCount() const
+	{
+		return LaneCount;
+	}
+
+	// Attach the memory of a lane and reset its registers from the reset vector.
+	// The kernels access the RAM of flat memories directly. The lanes whose memory has ROM, device or lazy
+	// sparse pages go through the bus, a lot slower.
+	void Reset(size_t lane, Memory64k& mem);
+
+	// Memory of a lane modified from outside while it holds code already executed must be signaled here,
+	// same as Cpu6502::InvalidateCode
+	void InvalidateCode(size_t lane, uint16_t address, uint32_t size);
+
+	// Every lane runs until its own first instruction boundary at or after the given number of cycles,
+	// exactly like Cpu6502::RunFor on each lane. Returns the number of instructions executed by all lanes.
+	uint64_t RunFor(uint64_t cycles);
+
+	Registers GetRegisters(size_t lane) const;
+	void SetRegisters(size_t lane, const Registers& registers);
+
+	uint64_t GetCycles(size_t lane) const
+	{
+		return Cycles[lane];
+	}
+
+	// Instructions decoded and dispatched for a whole group, LaneInstructions / Dispatches is the average group size.
+	// A run of a small group through the scalar CPU counts as one dispatch.
+	uint64_t GetDispatches() const
+	{
+		return Dispatches;
+	}
+
+	uint64_t GetLaneInstructions() const
+	{
+		return LaneInstructions;
+	}
+
+private:
+	// Instructions with a batch kernel, Scalar for the others
+	enum class Operation : uint8_t
+	{
+		Scalar,
+		Lda, Ldx, Ldy, Ora, And, Eor, Adc, Sbc, Cmp, Cpx, Cpy, Bit,
+		Sta, Stx, Sty,
+		Asl, Lsr, Rol, Ror, Inc, Dec,
+		Bpl, Bmi, Bvc, Bvs, Bcc, Bcs, Bne, Beq,
+		Jmp,
+		Clc, Sec, Cli, Sei, Cld, Clv, Nop,
+		Tax, Tay, Txa, Tya, Tsx, Txs, Inx, Iny, Dex, Dey,
+	};
+
+	enum class Mode : uint8_t
+	{
+		Implied, Accumulator, Immediate, Relative,
+		ZeroPage, ZeroPageX, ZeroPageY, Absolute, AbsoluteX, AbsoluteY,
+		IndexedIndirect, IndirectIndexed,
+	};
+
+	struct Decoded
+	{
+		Operation operation;
+		Mode mode;
+		uint8_t size;
+		uint8_t cycles;
+	};
+
+	// Lanes of a group and their registers, compacted so the kernels run plain loops over them.
+	// The lanes in no group hold these registers in the per lane arrays of Cpu6502Batch, SP, D and I
+	// always stay there.
+	struct Group
+	{
+		std::vector<uint32_t> lanes;
+		std::vector<uint8_t> a;
+		std::vector<uint8_t> x;
+		std::vector<uint8_t> y;
+		std::vector<uint8_t> n;
+		std::vector<uint8_t> z;
+		std::vector<uint8_t> c;
+		std::vector<uint8_t> v;
+		// Cycles run by all the lanes and not added to Cycles yet, and a lower bound of the cycles
+		// the lanes have left before their limit. No lane stops while pending is below budget.
+		uint64_t pending;
+		uint64_t budget;
+		size_t size; // The arrays only grow, their size is the capacity
+
+		size_t GetSize() const
+		{
+			return size;
+		}
+
+		size_t Add(); // Returns the index of a new entry
+		void Append(const Group& from, size_t index);
+		void Append(const Group& from); // All the lanes
+		void Move(size_t to, size_t from); // Entry from to index to
+		void Resize(size_t size);
+	};
+
+	// Fills Decode[opcode] when the handler of the opcode is the kernel composition MODE/OPERATION
+	template <class MODE, class OPERATION>
+	void Match(uint8_t opcode, Mode mode, Operation operation);
+
+	// Decode the instruction at pc from the first lane of Current and keep the lanes with the same
+	// instruction, the others wait at pc for a group of their own
+	void SelectGroup(uint16_t pc);
+	void Execute(const Decoded& decoded, const uint8_t* bytes, uint16_t pc);
+	void ExecuteScalar(uint16_t pc);
+	// Groups of up to kScalarGroupSize lanes run each lane through the scalar CPU until it reaches
+	// the PC of another group or a batch store. Returns the number of instructions executed.
+	static constexpr size_t kScalarGroupSize = 2;
+	uint64_t RunScalar(uint16_t pc);
+	void LoadScalar(const Group& group, size_t index, uint16_t pc);
+	void StoreScalar(Group& group, size_t index);
+
+	// Compare the code page of the lane with the snapshot when not known, returns its CodeState
+	uint8_t CheckCode(size_t lane, uint8_t page);
+	void SetCodeState(size_t lane, uint8_t page, uint8_t state)
+	{
+		uint8_t& old = CodeState[page * LaneCount + lane];
+		SameLanes[page] += (state == kCodeSame) - (old == kCodeSame);
+		old = state;
+	}
+
+	// Flat lanes read their RAM directly, the others go through the bus
+	uint8_t Read(uint32_t lane, uint16_t address)
+	{
+		const uint8_t* ram = Ram[lane];
+		return ram ? ram[address] : Memories[lane]->BusRead(address);
+	}
+
+	// Operand address (and page crossing cycle) and operand value of Current. LoadAddress returns
+	// true when a lane takes the page crossing cycle.
+	bool LoadAddress(Mode mode, const uint8_t* bytes, bool pageCrossCycle);
+	void LoadValue(Mode mode, const uint8_t* bytes);
+	void StoreValue();
+
+	// PC of the lowest group, 0x10000 when no lane is waiting
+	uint32_t GetLowestPC() const;
+	// Move the group at the lowest PC to Current, false when no lane is running
+	bool TakeLowestGroup(uint16_t& pc);
+	// Move a group to pc, merging with the lanes already there. group gets an empty one.
+	void Place(uint16_t pc, Group*& group);
+	// Place a lane from its registers in the per lane arrays, and the other way
+	void PlaceLane(uint16_t pc, uint32_t lane);
+	void StoreLane(const Group& group, size_t index, uint16_t pc);
+	// Place the lanes of Current at their Next PC
+	void Regroup();
+	// Charge the same cycles to all the lanes of Current and place them at next
+	void Charge(uint8_t cycles, uint16_t next);
+	// Add the pending (and Extra) cycles of Current to its lanes. The lanes reaching their limit
+	// leave the group and get their registers back, with Next as PC.
+	void FlushCycles(bool extra);
+
+	size_t LaneCount;
+
+	// Registers of the lanes in no group, one entry per lane
+	std::vector<uint8_t> A;
+	std::vector<uint8_t> X;
+	std::vector<uint8_t> Y;
+	std::vector<uint16_t> SP;
+	std::vector<uint16_t> PC;
+	std::vector<uint8_t> NResult;
+	std::vector<uint8_t> ZResult;
+	std::vector<uint8_t> C;
+	std::vector<uint8_t> V;
+	std::vector<uint8_t> D;
+	std::vector<uint8_t> I;
+	std::vector<uint64_t> Cycles;
+	std::vector<uint64_t> Limit;
+	std::vector<Memory64k*> Memories;
+	std::vector<uint8_t*> Ram; // Data of the flat memories at the start of the run, nullptr for the lanes on the bus
+
+	// Copy of each code page as first executed. CodeState tells, per page and lane, whether the
+	// memory of the lane still holds the same code, so only the lanes which modified it compare
+	// their instruction bytes with the leader's ones.
+	static constexpr uint8_t kCodeUnknown = 0;
+	static constexpr uint8_t kCodeDifferent = 1;
+	static constexpr uint8_t kCodeSame = 0xFF;
+	std::vector<uint8_t> CodeSnapshot;
+	bool CodeSnapshotValid[256];
+	std::vector<uint8_t> CodeState; // [page * LaneCount + lane], see SetCodeState
+	uint32_t SameLanes[256]; // Lanes in kCodeSame per page, when all of them are the code needs no check
+	uint32_t LanesWithMemory;
+
+	// Groups of running lanes by PC, they keep their capacity between runs
+	std::vector<Group> Groups;
+	std::vector<Group*> FreeGroups;
+	std::vector<Group*> GroupAt; // [pc] when the bit of pc is set in Occupied
+	uint64_t Occupied[kMemory64kSize / 64]; // 1 bit per PC with a group
+	uint64_t OccupiedWords[kMemory64kSize / 64 / 64]; // 1 bit per non zero word of Occupied
+	Group* Current; // Group executed
+	Group* Split; // Lanes leaving Current
+
+	// Per step scratch, indexed like Current: operand address/value, extra cycles, next PC
+	std::vector<uint16_t> Address;
+	std::vector<uint8_t> Value;
+	std::vector<uint8_t> Extra;
+	std::vector<uint16_t> Next;
+
+	// Runs the instructions without a batch kernel
+	Clock ScalarClock;
+	Cpu6502 Scalar;
+
+	uint8_t Code[3]; // Instruction of the current group
+	Decoded Decode[256];
+	uint64_t Dispatches;
+	uint64_t LaneInstructions;
+};
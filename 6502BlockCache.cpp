@@ -0,0 +1,308 @@
+#include "6502BlockCache.h"
+#include "6502Kernels.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+Cpu6502::BlockCache::BlockCache()
+	: Invalidations(0)
+	, Fusions()
+{
+}
+
+Cpu6502::BlockCache::Page& Cpu6502::BlockCache::GetPage(uint8_t page)
+{
+	if (!Pages[page])
+		Pages[page] = std::make_unique<Page>();
+	return *Pages[page];
+}
+
+Cpu6502::BlockCache::Block& Cpu6502::BlockCache::Decode(Cpu6502* cpu, Memory64k& mem, uint16_t pc)
+{
+	auto block = std::make_unique<Block>();
+	block->start = pc;
+	block->maxCycles = 0;
+	block->native = nullptr;
+	block->nativeGeneration = 0;
+	block->executions = 0;
+	block->nativeRejected = false;
+	block->nativeCode[0] = block->nativeCode[1] = nullptr;
+	block->nativeMapping = 0;
+	block->nativeOwnRam = false;
+	block->spin = false;
+
+	bool readOnly = true;
+	uint32_t addr = pc;
+	while (block->instructions.size() < kMaxBlockInstructions && !OnDevicePage(mem, uint16_t(addr)))
+	{
+		const InstructionInformation& instruction = cpu->InstructionInfo[mem.BusRead(addr)];
+		if (instruction.size == 0 || addr + instruction.size > 0x10000)
+			break;
+
+		DecodedInstruction decoded = { instruction.execute, {}, instruction.size, instruction.cycles, 1, 0 };
+		for (uint8_t i = 0; i < instruction.size; ++i)
+			decoded.bytes[i] = mem.BusRead(addr + i);
+		block->instructions.push_back(decoded);
+		block->maxCycles += instruction.cycles + kMaxExtraCycles;
+		readOnly = readOnly && instruction.readOnly;
+
+		addr += instruction.size;
+		if (instruction.changesFlow)
+			break;
+	}
+	block->end = uint16_t(addr);
+
+	// Polling loop candidate: only reads and ends with a branch or JMP absolute back to the start
+	if (readOnly && !block->instructions.empty())
+	{
+		const DecodedInstruction& last = block->instructions.back();
+		if ((last.bytes[0] & 0x1F) == 0x10)
+			block->spin = uint16_t(block->end + Kernels::AsInt8(last.bytes[1])) == pc;
+		else if (last.bytes[0] == 0x4C)
+			block->spin = combineAddr(last.bytes[1], last.bytes[2]) == pc;
+	}
+
+	// An invalid opcode still gets its own single instruction block, so it asserts when executed
+	if (block->instructions.empty())
+	{
+		const InstructionInformation& instruction = cpu->InstructionInfo[mem.BusRead(pc)];
+		block->instructions.push_back({ instruction.execute, { mem.BusRead(pc) }, 1, instruction.cycles, 1, 0 });
+		block->end = pc + 1;
+		block->maxCycles = kMaxExtraCycles;
+	}
+
+	// Fuse the common pairs, the unfused instructions stay for the runs stopping inside the block
+	for (size_t i = 0; i < block->instructions.size(); ++i)
+	{
+		DecodedInstruction fused;
+		if (i + 1 < block->instructions.size() && Fuse(block->instructions[i], block->instructions[i + 1], pc < 0x100, fused))
+		{
+			if (block->fused.empty())
+				block->fused.assign(block->instructions.begin(), block->instructions.begin() + i);
+			block->fused.push_back(fused);
+			++i;
+		}
+		else if (!block->fused.empty())
+		{
+			block->fused.push_back(block->instructions[i]);
+		}
+	}
+
+	// Register the block in the pages it overlaps, blocks are short enough to span two pages at most
+	uint8_t firstPage = pc >> 8;
+	uint8_t lastPage = (block->end - 1) >> 8;
+	if (lastPage != firstPage)
+		GetPage(lastPage).spilled.push_back(pc);
+
+	std::unique_ptr<Block>& slot = GetPage(firstPage).blocks[pc & 0xFF];
+	slot = std::move(block);
+	return *slot;
+}
+
+bool Cpu6502::BlockCache::Fuse(const DecodedInstruction& first, const DecodedInstruction& second, bool zeroPageCode, DecodedInstruction& fused)
+{
+	uint8_t(*execute)(Cpu6502* cpu, Memory64k& mem) = nullptr;
+
+#define CPU6502_FUSED(mode1, operation1, size1, mode2, operation2) \
+	&Kernels::ExecuteFused<Kernels::mode1, Kernels::operation1, size1, Kernels::mode2, Kernels::operation2>
+#define CPU6502_FUSE(opcode1, opcode2, mode1, operation1, size1, mode2, operation2) \
+	case opcode1 << 8 | opcode2: execute = CPU6502_FUSED(mode1, operation1, size1, mode2, operation2); break;
+#define CPU6502_FUSE_LDA_STA(opcode, mode, size) \
+	CPU6502_FUSE(opcode, 0x85, mode, Lda, size, ZeroPage, Sta) \
+	CPU6502_FUSE(opcode, 0x95, mode, Lda, size, ZeroPageX, Sta) \
+	CPU6502_FUSE(opcode, 0x8D, mode, Lda, size, Absolute, Sta) \
+	CPU6502_FUSE(opcode, 0x9D, mode, Lda, size, AbsoluteX, Sta) \
+	CPU6502_FUSE(opcode, 0x99, mode, Lda, size, AbsoluteY, Sta) \
+	CPU6502_FUSE(opcode, 0x81, mode, Lda, size, IndexedIndirect, Sta) \
+	CPU6502_FUSE(opcode, 0x91, mode, Lda, size, IndirectIndexed, Sta)
+
+	switch (first.bytes[0] << 8 | second.bytes[0])
+	{
+	CPU6502_FUSE_LDA_STA(0xA9, Immediate, 2)
+	CPU6502_FUSE_LDA_STA(0xA5, ZeroPage, 2)
+	CPU6502_FUSE_LDA_STA(0xB5, ZeroPageX, 2)
+	CPU6502_FUSE_LDA_STA(0xAD, Absolute, 3)
+	CPU6502_FUSE_LDA_STA(0xBD, AbsoluteX, 3)
+	CPU6502_FUSE_LDA_STA(0xB9, AbsoluteY, 3)
+	CPU6502_FUSE_LDA_STA(0xA1, IndexedIndirect, 2)
+	CPU6502_FUSE_LDA_STA(0xB1, IndirectIndexed, 2)
+	CPU6502_FUSE(0xCA, 0xD0, Implied, Dex, 1, Relative, Bne)
+	CPU6502_FUSE(0x88, 0xD0, Implied, Dey, 1, Relative, Bne)
+	CPU6502_FUSE(0xC9, 0xF0, Immediate, Cmp, 2, Relative, Beq)
+	CPU6502_FUSE(0xC9, 0xD0, Immediate, Cmp, 2, Relative, Bne)
+	CPU6502_FUSE(0xE6, 0xD0, ZeroPage, Inc, 2, Relative, Bne)
+	CPU6502_FUSE(0x18, 0x69, Implied, Clc, 1, Immediate, Adc)
+	CPU6502_FUSE(0x18, 0x65, Implied, Clc, 1, ZeroPage, Adc)
+	CPU6502_FUSE(0x18, 0x75, Implied, Clc, 1, ZeroPageX, Adc)
+	CPU6502_FUSE(0x18, 0x6D, Implied, Clc, 1, Absolute, Adc)
+	CPU6502_FUSE(0x18, 0x7D, Implied, Clc, 1, AbsoluteX, Adc)
+	CPU6502_FUSE(0x18, 0x79, Implied, Clc, 1, AbsoluteY, Adc)
+	CPU6502_FUSE(0x18, 0x61, Implied, Clc, 1, IndexedIndirect, Adc)
+	CPU6502_FUSE(0x18, 0x71, Implied, Clc, 1, IndirectIndexed, Adc)
+	default:
+		return false;
+	}
+
+#undef CPU6502_FUSE_LDA_STA
+#undef CPU6502_FUSE
+#undef CPU6502_FUSED
+
+	Cpu6502Fusion fusion;
+	switch (first.bytes[0])
+	{
+	case 0xCA:
+	case 0x88:
+		fusion = Cpu6502Fusion::DecrementBranch;
+		break;
+	case 0xC9:
+		fusion = Cpu6502Fusion::CompareBranch;
+		break;
+	case 0xE6:
+		// The increment could rewrite the branch when the code sits in the zero page
+		if (zeroPageCode)
+			return false;
+		fusion = Cpu6502Fusion::IncrementBranch;
+		break;
+	case 0x18:
+		fusion = Cpu6502Fusion::ClearCarryAdd;
+		break;
+	default:
+		fusion = Cpu6502Fusion::LoadStore;
+		break;
+	}
+
+	fused = first;
+	fused.execute = execute;
+	memcpy(fused.bytes + first.size, second.bytes, second.size);
+	fused.size = first.size + second.size;
+	fused.cycles = first.cycles + second.cycles;
+	fused.count = 2;
+	fused.fusion = uint8_t(fusion) + 1;
+	return true;
+}
+
+void Cpu6502::BlockCache::InvalidatePage(uint8_t page)
+{
+	std::unique_ptr<Page> dropped = std::move(Pages[page]);
+	if (!dropped)
+		return;
+
+	++Invalidations;
+
+	// Blocks starting in this page
+	for (std::unique_ptr<Block>& block : dropped->blocks)
+	{
+		if (block)
+		{
+			uint8_t lastPage = (block->end - 1) >> 8;
+			if (lastPage != page && Pages[lastPage])
+			{
+				std::vector<uint16_t>& spilled = Pages[lastPage]->spilled;
+				spilled.erase(std::remove(spilled.begin(), spilled.end(), block->start), spilled.end());
+			}
+			Retired.push_back(std::move(block));
+		}
+	}
+
+	// Blocks from the previous page overlapping this one
+	uint8_t previousPage = page - 1;
+	if (Pages[previousPage])
+	{
+		for (uint16_t start : dropped->spilled)
+		{
+			std::unique_ptr<Block>& block = Pages[previousPage]->blocks[start & 0xFF];
+			if (block)
+				Retired.push_back(std::move(block));
+		}
+	}
+}
+
+void Cpu6502::BlockCache::Interpret(Cpu6502* cpu, Memory64k& mem, const Block& block, uint64_t& executed, uint64_t& count, uint64_t maxCycles, uint64_t maxInstructions)
+{
+	const uint64_t invalidations = Invalidations;
+	const bool checkLimits = executed + block.maxCycles >= maxCycles || count + block.instructions.size() > maxInstructions;
+
+	// Fused pairs could step over a limit, close to them the instructions run one by one, and when tracing
+	// so that the accesses get the PC of their instruction
+	const std::vector<DecodedInstruction>& instructions = checkLimits || block.fused.empty() || cpu->IsTracing() ? block.instructions : block.fused;
+	for (const DecodedInstruction& instruction : instructions)
+	{
+		assert(instruction.cycles > 0); // this would mean an invalid opcode was used
+		CPU6502_TRACE_INSTRUCTION(cpu, executed);
+		memcpy(cpu->InstructionDecoding, instruction.bytes, sizeof(instruction.bytes));
+		cpu->PC += instruction.size;
+		executed += instruction.cycles + instruction.execute(cpu, mem);
+		count += instruction.count;
+		if (instruction.fusion)
+			++Fusions[instruction.fusion];
+
+		// Stop when the instruction wrote into code that was decoded already, or on the limits
+		if (invalidations != Invalidations)
+			break;
+		if (checkLimits && (executed >= maxCycles || count >= maxInstructions))
+			break;
+	}
+}
+
+void Cpu6502::BlockCache::Spin(Cpu6502* cpu, Memory64k& mem, const Block& block, uint64_t& executed, uint64_t& count, uint64_t maxCycles, uint64_t maxInstructions)
+{
+	assert(block.spin);
+	const uint8_t a = cpu->A;
+	const uint8_t x = cpu->X;
+	const uint8_t y = cpu->Y;
+	const uint8_t status = cpu->GetStatus();
+	const uint64_t startCycles = executed;
+	const uint64_t startCount = count;
+	const uint64_t deviceAccesses = mem.GetDeviceAccesses();
+	Interpret(cpu, mem, block, executed, count, maxCycles, maxInstructions);
+
+	// Stopped inside the iteration, left the loop or still converging
+	if (cpu->PC != block.start || cpu->A != a || cpu->X != x || cpu->Y != y || cpu->GetStatus() != status)
+		return;
+	// Polling a device, its reads can change or have side effects
+	if (mem.GetDeviceAccesses() != deviceAccesses)
+		return;
+	if (executed >= maxCycles || count >= maxInstructions)
+		return;
+	// The skipped iterations would be missing from the trace
+	if (cpu->IsTracing())
+		return;
+
+	// Whole iterations ending at or before the limits, the interpreter would stop at the same boundary
+	const uint64_t iterationCycles = executed - startCycles;
+	const uint64_t iterationCount = count - startCount;
+	uint64_t iterations = std::min((maxCycles - executed) / iterationCycles, (maxInstructions - count) / iterationCount);
+	executed += iterations * iterationCycles;
+	count += iterations * iterationCount;
+}
+
+uint64_t Cpu6502::RunBlockCache(Memory64k& mem, uint64_t maxCycles, uint64_t maxInstructions, uint64_t& instructions)
+{
+	uint64_t executed = 0;
+	uint64_t count = 0;
+	while (executed < maxCycles && count < maxInstructions)
+	{
+		if (BlockCache::OnDevicePage(mem, PC))
+		{
+			CPU6502_TRACE_INSTRUCTION(this, executed);
+			executed += ExecuteInstruction(mem);
+			++count;
+			continue;
+		}
+
+		Blocks->ReleaseRetired();
+		const BlockCache::Block& block = Blocks->Get(this, mem, PC);
+		if (block.spin)
+			Blocks->Spin(this, mem, block, executed, count, maxCycles, maxInstructions);
+		else
+			Blocks->Interpret(this, mem, block, executed, count, maxCycles, maxInstructions);
+	}
+	instructions = count;
+	return executed;
+}
+
+uint64_t Cpu6502::FusionCount(Cpu6502Fusion fusion) const
+{
+	return Blocks ? Blocks->FusionCount(fusion) : 0;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+// Cache of pre-decoded basic blocks used by Cpu6502Core::BlockCache.
+// A block starts at any address the PC reached and ends after the first instruction changing
+// the flow (branch, jump, call, return, BRK). Blocks are indexed by start address and registered
+// in every page they overlap, so a write into a page drops the blocks decoded from it.
+
+#include "6502.h"
+
+#include <array>
+#include <vector>
+
+class Cpu6502::BlockCache
+{
+public:
+	struct DecodedInstruction
+	{
+		uint8_t(*execute)(Cpu6502* cpu, Memory64k& mem); // Returns the extra cycles
+		uint8_t bytes[6]; // Opcode and operands, as expected in InstructionDecoding
+		uint8_t size;
+		uint8_t cycles; // Static cycle count
+		uint8_t count; // Number of 6502 instructions, 2 when fused
+		uint8_t fusion; // Cpu6502Fusion + 1, 0 when not fused
+	};
+
+	struct Block
+	{
+		uint16_t start;
+		uint16_t end; // Address following the last instruction
+		uint32_t maxCycles; // Upper bound of the cycles taken by the whole block
+		std::vector<DecodedInstruction> instructions;
+		std::vector<DecodedInstruction> fused; // Same with the pairs fused, empty if there is none
+		bool spin; // Read only loop branching back to its own start, see Spin
+
+		// Translation state for the Jit core
+		void* native;
+		uint32_t nativeGeneration;
+		uint16_t executions;
+		bool nativeRejected;
+		// Pages the native code depends on: the host memory the code pages were read from when translated,
+		// and the pages its loads read from the RAM directly. Checked again when the mapping changed.
+		const uint8_t* nativeCode[2];
+		std::vector<uint8_t> nativeReads;
+		uint64_t nativeMapping; // Memory::GetMappingGeneration of the last check
+		bool nativeOwnRam; // The nativeReads pages read their own RAM at the last check
+	};
+
+	// Longest run of instructions decoded in one block
+	static constexpr size_t kMaxBlockInstructions = 64;
+	// Most extra cycles an instruction can take (taken branch to another page)
+	static constexpr uint32_t kMaxExtraCycles = 2;
+
+	BlockCache();
+
+	// Return the block starting at pc, decoding it first if needed
+	Block& Get(Cpu6502* cpu, Memory64k& mem, uint16_t pc)
+	{
+		Page* page = Pages[pc >> 8].get();
+		if (page)
+		{
+			if (Block* block = page->blocks[pc & 0xFF].get())
+				return *block;
+		}
+		return Decode(cpu, mem, pc);
+	}
+
+	// Instructions on device pages are never decoded ahead, a device can return something else on each
+	// fetch. True when the instruction at pc may have a byte on one, it runs through ExecuteInstruction.
+	static bool OnDevicePage(const Memory64k& mem, uint16_t pc)
+	{
+		return !mem.GetReadPage(pc >> 8) || !mem.GetReadPage(uint16_t(pc + 2) >> 8);
+	}
+
+	bool IsCodePage(uint8_t page) const
+	{
+		return Pages[page] != nullptr;
+	}
+
+	void InvalidatePage(uint8_t page);
+
+	// Incremented on each invalidation, a block being executed stops when it changes
+	uint64_t InvalidationCount() const
+	{
+		return Invalidations;
+	}
+
+	// Free the blocks invalidated while they were potentially executing
+	void ReleaseRetired()
+	{
+		Retired.clear();
+	}
+
+	uint64_t FusionCount(Cpu6502Fusion fusion) const
+	{
+		return Fusions[size_t(fusion) + 1];
+	}
+
+	// Interpret a block, stops early on the limits or when the block got invalidated
+	void Interpret(Cpu6502* cpu, Memory64k& mem, const Block& block, uint64_t& executed, uint64_t& count, uint64_t maxCycles, uint64_t maxInstructions);
+
+	// Interpret a spin block once. An iteration leaving the registers unchanged without accessing a device
+	// can only be followed by identical ones until something else writes memory, which can't happen before
+	// the end of the run (runs stop at clock events), so the whole iterations left before the limits are
+	// accounted at once.
+	void Spin(Cpu6502* cpu, Memory64k& mem, const Block& block, uint64_t& executed, uint64_t& count, uint64_t maxCycles, uint64_t maxInstructions);
+
+private:
+	struct Page
+	{
+		std::unique_ptr<Block> blocks[256]; // Blocks starting in this page
+		std::vector<uint16_t> spilled; // Start of the blocks from the previous page reaching into this one
+	};
+
+	Block& Decode(Cpu6502* cpu, Memory64k& mem, uint16_t pc);
+	Page& GetPage(uint8_t page);
+	static bool Fuse(const DecodedInstruction& first, const DecodedInstruction& second, bool zeroPageCode, DecodedInstruction& fused);
+
+	std::array<std::unique_ptr<Page>, 256> Pages;
+	std::vector<std::unique_ptr<Block>> Retired;
+	uint64_t Invalidations;
+	std::array<uint64_t, size_t(Cpu6502Fusion::Count) + 1> Fusions; // Indexed by DecodedInstruction::fusion, slot 0 unused
+};
@@ -0,0 +1,870 @@
+#include "6502Jit.h"
+
+#if CPU6502_JIT_SUPPORTED
+
+#include "6502Kernels.h"
+#include "X64Emitter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+	using Reg = X64Emitter::Reg;
+
+	// Host registers holding the 6502 state, all callee saved
+	constexpr Reg kRegA = X64Emitter::RBX;
+	constexpr Reg kRegX = X64Emitter::RBP;
+	constexpr Reg kRegY = X64Emitter::R12;
+	constexpr Reg kRegNZ = X64Emitter::R13;
+	constexpr Reg kRegMemory = X64Emitter::R14;
+	constexpr Reg kRegState = X64Emitter::R15;
+
+#ifdef _WIN32
+	constexpr Reg kArg0 = X64Emitter::RCX;
+	constexpr Reg kArg1 = X64Emitter::RDX;
+	constexpr Reg kArg2 = X64Emitter::R8;
+#else
+	constexpr Reg kArg0 = X64Emitter::RDI;
+	constexpr Reg kArg1 = X64Emitter::RSI;
+	constexpr Reg kArg2 = X64Emitter::RDX;
+#endif
+
+	// 6 pushes + 40 keeps the stack 16 bytes aligned and leaves the Win64 shadow space
+	constexpr uint8_t kFrameSize = 40;
+	constexpr size_t kCodeSize = 4 * 1024 * 1024;
+	constexpr size_t kProtectionGranularity = 4096; // Host page size
+
+	enum class JitMode
+	{
+		Implied,
+		Immediate,
+		ZeroPage,
+		ZeroPageX,
+		ZeroPageY,
+		Absolute,
+		AbsoluteX,
+		AbsoluteY,
+	};
+
+	enum class JitOp
+	{
+		Unsupported,
+		Lda, Ldx, Ldy,
+		Ora, And, Eor, Adc, Sbc,
+		Cmp, Cpx, Cpy,
+		Sta, Stx, Sty,
+		Asl, Lsr, Rol, Ror, Inc, Dec,
+		Tax, Tay, Txa, Tya,
+		Inx, Iny, Dex, Dey,
+		Clc, Sec, Clv, Nop,
+		Bpl, Bmi, Bvc, Bvs, Bcc, Bcs, Bne, Beq,
+		Jmp,
+	};
+
+	struct JitOpcode
+	{
+		JitOp op;
+		JitMode mode;
+	};
+
+	// Pages the loads of the mode can read
+	void AddReadPages(JitMode mode, const uint8_t* bytes, std::vector<uint8_t>& pages)
+	{
+		uint8_t first;
+		uint8_t last;
+		switch (mode)
+		{
+		case JitMode::ZeroPage:
+		case JitMode::ZeroPageX:
+		case JitMode::ZeroPageY:
+			first = last = 0;
+			break;
+		case JitMode::Absolute:
+			first = last = bytes[2];
+			break;
+		case JitMode::AbsoluteX:
+		case JitMode::AbsoluteY:
+			first = bytes[2];
+			last = uint8_t(uint16_t(combineAddr(bytes[1], bytes[2]) + 0xFF) >> 8);
+			break;
+		default:
+			return;
+		}
+		for (uint8_t page : { first, last })
+		{
+			if (std::find(pages.begin(), pages.end(), page) == pages.end())
+				pages.push_back(page);
+		}
+	}
+
+	// Opcodes the translator handles, all have a static cycle count except the branches.
+	// Reads with page crossing penalties, the stack and BIT are left to the interpreter.
+	JitOpcode Describe(uint8_t opcode)
+	{
+		switch (opcode)
+		{
+		case 0xA9: return { JitOp::Lda, JitMode::Immediate };
+		case 0xA5: return { JitOp::Lda, JitMode::ZeroPage };
+		case 0xB5: return { JitOp::Lda, JitMode::ZeroPageX };
+		case 0xAD: return { JitOp::Lda, JitMode::Absolute };
+		case 0xA2: return { JitOp::Ldx, JitMode::Immediate };
+		case 0xA6: return { JitOp::Ldx, JitMode::ZeroPage };
+		case 0xB6: return { JitOp::Ldx, JitMode::ZeroPageY };
+		case 0xAE: return { JitOp::Ldx, JitMode::Absolute };
+		case 0xA0: return { JitOp::Ldy, JitMode::Immediate };
+		case 0xA4: return { JitOp::Ldy, JitMode::ZeroPage };
+		case 0xB4: return { JitOp::Ldy, JitMode::ZeroPageX };
+		case 0xAC: return { JitOp::Ldy, JitMode::Absolute };
+
+		case 0x09: return { JitOp::Ora, JitMode::Immediate };
+		case 0x05: return { JitOp::Ora, JitMode::ZeroPage };
+		case 0x15: return { JitOp::Ora, JitMode::ZeroPageX };
+		case 0x0D: return { JitOp::Ora, JitMode::Absolute };
+		case 0x29: return { JitOp::And, JitMode::Immediate };
+		case 0x25: return { JitOp::And, JitMode::ZeroPage };
+		case 0x35: return { JitOp::And, JitMode::ZeroPageX };
+		case 0x2D: return { JitOp::And, JitMode::Absolute };
+		case 0x49: return { JitOp::Eor, JitMode::Immediate };
+		case 0x45: return { JitOp::Eor, JitMode::ZeroPage };
+		case 0x55: return { JitOp::Eor, JitMode::ZeroPageX };
+		case 0x4D: return { JitOp::Eor, JitMode::Absolute };
+		case 0x69: return { JitOp::Adc, JitMode::Immediate };
+		case 0x65: return { JitOp::Adc, JitMode::ZeroPage };
+		case 0x75: return { JitOp::Adc, JitMode::ZeroPageX };
+		case 0x6D: return { JitOp::Adc, JitMode::Absolute };
+		case 0xE9: return { JitOp::Sbc, JitMode::Immediate };
+		case 0xE5: return { JitOp::Sbc, JitMode::ZeroPage };
+		case 0xF5: return { JitOp::Sbc, JitMode::ZeroPageX };
+		case 0xED: return { JitOp::Sbc, JitMode::Absolute };
+		case 0xC9: return { JitOp::Cmp, JitMode::Immediate };
+		case 0xC5: return { JitOp::Cmp, JitMode::ZeroPage };
+		case 0xD5: return { JitOp::Cmp, JitMode::ZeroPageX };
+		case 0xCD: return { JitOp::Cmp, JitMode::Absolute };
+		case 0xE0: return { JitOp::Cpx, JitMode::Immediate };
+		case 0xE4: return { JitOp::Cpx, JitMode::ZeroPage };
+		case 0xEC: return { JitOp::Cpx, JitMode::Absolute };
+		case 0xC0: return { JitOp::Cpy, JitMode::Immediate };
+		case 0xC4: return { JitOp::Cpy, JitMode::ZeroPage };
+		case 0xCC: return { JitOp::Cpy, JitMode::Absolute };
+
+		case 0x85: return { JitOp::Sta, JitMode::ZeroPage };
+		case 0x95: return { JitOp::Sta, JitMode::ZeroPageX };
+		case 0x8D: return { JitOp::Sta, JitMode::Absolute };
+		case 0x9D: return { JitOp::Sta, JitMode::AbsoluteX };
+		case 0x99: return { JitOp::Sta, JitMode::AbsoluteY };
+		case 0x86: return { JitOp::Stx, JitMode::ZeroPage };
+		case 0x96: return { JitOp::Stx, JitMode::ZeroPageY };
+		case 0x8E: return { JitOp::Stx, JitMode::Absolute };
+		case 0x84: return { JitOp::Sty, JitMode::ZeroPage };
+		case 0x94: return { JitOp::Sty, JitMode::ZeroPageX };
+		case 0x8C: return { JitOp::Sty, JitMode::Absolute };
+
+		case 0x0A: return { JitOp::Asl, JitMode::Implied };
+		case 0x06: return { JitOp::Asl, JitMode::ZeroPage };
+		case 0x16: return { JitOp::Asl, JitMode::ZeroPageX };
+		case 0x0E: return { JitOp::Asl, JitMode::Absolute };
+		case 0x1E: return { JitOp::Asl, JitMode::AbsoluteX };
+		case 0x4A: return { JitOp::Lsr, JitMode::Implied };
+		case 0x46: return { JitOp::Lsr, JitMode::ZeroPage };
+		case 0x56: return { JitOp::Lsr, JitMode::ZeroPageX };
+		case 0x4E: return { JitOp::Lsr, JitMode::Absolute };
+		case 0x5E: return { JitOp::Lsr, JitMode::AbsoluteX };
+		case 0x2A: return { JitOp::Rol, JitMode::Implied };
+		case 0x26: return { JitOp::Rol, JitMode::ZeroPage };
+		case 0x36: return { JitOp::Rol, JitMode::ZeroPageX };
+		case 0x2E: return { JitOp::Rol, JitMode::Absolute };
+		case 0x3E: return { JitOp::Rol, JitMode::AbsoluteX };
+		case 0x6A: return { JitOp::Ror, JitMode::Implied };
+		case 0x66: return { JitOp::Ror, JitMode::ZeroPage };
+		case 0x76: return { JitOp::Ror, JitMode::ZeroPageX };
+		case 0x6E: return { JitOp::Ror, JitMode::Absolute };
+		case 0x7E: return { JitOp::Ror, JitMode::AbsoluteX };
+		case 0xE6: return { JitOp::Inc, JitMode::ZeroPage };
+		case 0xF6: return { JitOp::Inc, JitMode::ZeroPageX };
+		case 0xEE: return { JitOp::Inc, JitMode::Absolute };
+		case 0xFE: return { JitOp::Inc, JitMode::AbsoluteX };
+		case 0xC6: return { JitOp::Dec, JitMode::ZeroPage };
+		case 0xD6: return { JitOp::Dec, JitMode::ZeroPageX };
+		case 0xCE: return { JitOp::Dec, JitMode::Absolute };
+		case 0xDE: return { JitOp::Dec, JitMode::AbsoluteX };
+
+		case 0xAA: return { JitOp::Tax, JitMode::Implied };
+		case 0xA8: return { JitOp::Tay, JitMode::Implied };
+		case 0x8A: return { JitOp::Txa, JitMode::Implied };
+		case 0x98: return { JitOp::Tya, JitMode::Implied };
+		case 0xE8: return { JitOp::Inx, JitMode::Implied };
+		case 0xC8: return { JitOp::Iny, JitMode::Implied };
+		case 0xCA: return { JitOp::Dex, JitMode::Implied };
+		case 0x88: return { JitOp::Dey, JitMode::Implied };
+		case 0x18: return { JitOp::Clc, JitMode::Implied };
+		case 0x38: return { JitOp::Sec, JitMode::Implied };
+		case 0xB8: return { JitOp::Clv, JitMode::Implied };
+		case 0xEA: return { JitOp::Nop, JitMode::Implied };
+
+		case 0x10: return { JitOp::Bpl, JitMode::Implied };
+		case 0x30: return { JitOp::Bmi, JitMode::Implied };
+		case 0x50: return { JitOp::Bvc, JitMode::Implied };
+		case 0x70: return { JitOp::Bvs, JitMode::Implied };
+		case 0x90: return { JitOp::Bcc, JitMode::Implied };
+		case 0xB0: return { JitOp::Bcs, JitMode::Implied };
+		case 0xD0: return { JitOp::Bne, JitMode::Implied };
+		case 0xF0: return { JitOp::Beq, JitMode::Implied };
+		case 0x4C: return { JitOp::Jmp, JitMode::Absolute };
+		}
+		return { JitOp::Unsupported, JitMode::Implied };
+	}
+}
+
+// Translates a single block, the emitter works on the free part of the code buffer
+class Cpu6502::Jit::BlockTranslator
+{
+public:
+	BlockTranslator(X64Emitter& emitter, uint16_t start, uint32_t blockMaxCycles, void* writeMemory)
+		: E(emitter)
+		, Start(start)
+		, BlockMaxCycles(blockMaxCycles)
+		, WriteMemory(writeMemory)
+	{
+	}
+
+	void Prologue()
+	{
+		E.Push(X64Emitter::RBX);
+		E.Push(X64Emitter::RBP);
+		E.Push(X64Emitter::R12);
+		E.Push(X64Emitter::R13);
+		E.Push(X64Emitter::R14);
+		E.Push(X64Emitter::R15);
+		E.SubRsp(kFrameSize);
+		E.Mov64(kRegState, kArg0);
+		E.Mov64(kRegMemory, kArg1);
+		E.MovzxLoad8(kRegA, kRegState, offsetof(State, a));
+		E.MovzxLoad8(kRegX, kRegState, offsetof(State, x));
+		E.MovzxLoad8(kRegY, kRegState, offsetof(State, y));
+		E.MovzxLoad8(kRegNZ, kRegState, offsetof(State, nz));
+		LoopTop = E.Here();
+	}
+
+	void Epilogue()
+	{
+		for (X64Emitter::Label exit : Exits)
+			E.Bind(exit);
+		E.Store8(kRegState, offsetof(State, a), kRegA);
+		E.Store8(kRegState, offsetof(State, x), kRegX);
+		E.Store8(kRegState, offsetof(State, y), kRegY);
+		E.Store8(kRegState, offsetof(State, nz), kRegNZ);
+		E.AddRsp(kFrameSize);
+		E.Pop(X64Emitter::R15);
+		E.Pop(X64Emitter::R14);
+		E.Pop(X64Emitter::R13);
+		E.Pop(X64Emitter::R12);
+		E.Pop(X64Emitter::RBP);
+		E.Pop(X64Emitter::RBX);
+		E.Ret();
+	}
+
+	// Leave the native code, resuming at pc after the given number of cycles and instructions
+	void Exit(uint16_t pc, uint32_t cycles, uint32_t instructions)
+	{
+		E.Store16Imm(kRegState, offsetof(State, pc), pc);
+		if (cycles)
+			E.Add64MemImm(kRegState, offsetof(State, cycles), int32_t(cycles));
+		if (instructions)
+			E.Add64MemImm(kRegState, offsetof(State, instructions), int32_t(instructions));
+		Exits.push_back(E.Jmp());
+	}
+
+	// Jump back to the block start while the next iteration stays within the limits
+	void Loop(uint32_t cycles, uint32_t instructions)
+	{
+		E.Add64MemImm(kRegState, offsetof(State, cycles), int32_t(cycles));
+		E.Add64MemImm(kRegState, offsetof(State, instructions), int32_t(instructions));
+		E.Load64(X64Emitter::RAX, kRegState, offsetof(State, cycles));
+		E.Alu64Imm(X64Emitter::kAdd, X64Emitter::RAX, int32_t(BlockMaxCycles));
+		E.Cmp64Mem(X64Emitter::RAX, kRegState, offsetof(State, maxCycles));
+		X64Emitter::Label cyclesReached = E.Jcc(X64Emitter::kNotCarry);
+		E.Load64(X64Emitter::RAX, kRegState, offsetof(State, instructions));
+		E.Alu64Imm(X64Emitter::kAdd, X64Emitter::RAX, int32_t(instructions));
+		E.Cmp64Mem(X64Emitter::RAX, kRegState, offsetof(State, maxInstructions));
+		X64Emitter::Label instructionsReached = E.Jcc(X64Emitter::kAbove);
+		E.Jmp(LoopTop);
+		E.Bind(cyclesReached);
+		E.Bind(instructionsReached);
+		Exit(Start, 0, 0);
+	}
+
+	// Returns false when the instruction has to be left to the interpreter
+	bool Emit(const BlockCache::DecodedInstruction& instruction, JitOpcode opcode, uint16_t next, uint32_t cycles, uint32_t instructions)
+	{
+		const uint8_t zp = instruction.bytes[1];
+		const uint16_t abs = combineAddr(instruction.bytes[1], instruction.bytes[2]);
+
+		switch (opcode.op)
+		{
+		case JitOp::Lda: LoadRegister(kRegA, opcode.mode, instruction); break;
+		case JitOp::Ldx: LoadRegister(kRegX, opcode.mode, instruction); break;
+		case JitOp::Ldy: LoadRegister(kRegY, opcode.mode, instruction); break;
+
+		case JitOp::Ora: Logic(X64Emitter::kOr, opcode.mode, instruction); break;
+		case JitOp::And: Logic(X64Emitter::kAnd, opcode.mode, instruction); break;
+		case JitOp::Eor: Logic(X64Emitter::kXor, opcode.mode, instruction); break;
+
+		case JitOp::Adc:
+			Alu(X64Emitter::kAdc, kRegA, opcode.mode, instruction, false);
+			E.SetccMem(X64Emitter::kCarry, kRegState, offsetof(State, c));
+			E.SetccMem(X64Emitter::kOverflow, kRegState, offsetof(State, v));
+			E.Mov32(kRegNZ, kRegA);
+			break;
+		case JitOp::Sbc:
+			// The 6502 carry is the inverse of the x86 borrow
+			Alu(X64Emitter::kSbb, kRegA, opcode.mode, instruction, true);
+			E.SetccMem(X64Emitter::kNotCarry, kRegState, offsetof(State, c));
+			E.SetccMem(X64Emitter::kOverflow, kRegState, offsetof(State, v));
+			E.Mov32(kRegNZ, kRegA);
+			break;
+
+		case JitOp::Cmp: Compare(kRegA, opcode.mode, instruction); break;
+		case JitOp::Cpx: Compare(kRegX, opcode.mode, instruction); break;
+		case JitOp::Cpy: Compare(kRegY, opcode.mode, instruction); break;
+
+		case JitOp::Sta: Store(kRegA, opcode.mode, instruction, next, cycles, instructions); break;
+		case JitOp::Stx: Store(kRegX, opcode.mode, instruction, next, cycles, instructions); break;
+		case JitOp::Sty: Store(kRegY, opcode.mode, instruction, next, cycles, instructions); break;
+
+		case JitOp::Asl: Shift(X64Emitter::kShl, false, opcode.mode, instruction, next, cycles, instructions); break;
+		case JitOp::Lsr: Shift(X64Emitter::kShr, false, opcode.mode, instruction, next, cycles, instructions); break;
+		case JitOp::Rol: Shift(X64Emitter::kRcl, true, opcode.mode, instruction, next, cycles, instructions); break;
+		case JitOp::Ror: Shift(X64Emitter::kRcr, true, opcode.mode, instruction, next, cycles, instructions); break;
+
+		case JitOp::Inc:
+		case JitOp::Dec:
+			Address(kArg1, opcode.mode, zp, abs);
+			E.MovzxLoad8Indexed(kArg2, kRegMemory, kArg1);
+			if (opcode.op == JitOp::Inc)
+				E.Inc8(kArg2);
+			else
+				E.Dec8(kArg2);
+			E.Movzx8(kRegNZ, kArg2);
+			CallWrite(next, cycles, instructions);
+			break;
+
+		case JitOp::Tax: Transfer(kRegX, kRegA); break;
+		case JitOp::Tay: Transfer(kRegY, kRegA); break;
+		case JitOp::Txa: Transfer(kRegA, kRegX); break;
+		case JitOp::Tya: Transfer(kRegA, kRegY); break;
+
+		case JitOp::Inx: E.Inc8(kRegX); E.Mov32(kRegNZ, kRegX); break;
+		case JitOp::Iny: E.Inc8(kRegY); E.Mov32(kRegNZ, kRegY); break;
+		case JitOp::Dex: E.Dec8(kRegX); E.Mov32(kRegNZ, kRegX); break;
+		case JitOp::Dey: E.Dec8(kRegY); E.Mov32(kRegNZ, kRegY); break;
+
+		case JitOp::Clc: E.Store8Imm(kRegState, offsetof(State, c), 0); break;
+		case JitOp::Sec: E.Store8Imm(kRegState, offsetof(State, c), 1); break;
+		case JitOp::Clv: E.Store8Imm(kRegState, offsetof(State, v), 0); break;
+		case JitOp::Nop: break;
+
+		default:
+			return false;
+		}
+		return true;
+	}
+
+	// Block ending branch, cycles and instructions include the branch itself
+	void Branch(JitOp op, uint16_t target, uint16_t next, uint32_t cycles, uint32_t instructions)
+	{
+		X64Emitter::Condition taken;
+		switch (op)
+		{
+		case JitOp::Bpl: E.TestImm32(kRegNZ, 0x80); taken = X64Emitter::kZero; break;
+		case JitOp::Bmi: E.TestImm32(kRegNZ, 0x80); taken = X64Emitter::kNotZero; break;
+		case JitOp::Bne: E.Test32(kRegNZ, kRegNZ); taken = X64Emitter::kNotZero; break;
+		case JitOp::Beq: E.Test32(kRegNZ, kRegNZ); taken = X64Emitter::kZero; break;
+		case JitOp::Bcc: E.Cmp8MemImm(kRegState, offsetof(State, c), 0); taken = X64Emitter::kZero; break;
+		case JitOp::Bcs: E.Cmp8MemImm(kRegState, offsetof(State, c), 0); taken = X64Emitter::kNotZero; break;
+		case JitOp::Bvc: E.Cmp8MemImm(kRegState, offsetof(State, v), 0); taken = X64Emitter::kZero; break;
+		default: E.Cmp8MemImm(kRegState, offsetof(State, v), 0); taken = X64Emitter::kNotZero; break;
+		}
+
+		X64Emitter::Label notTaken = E.Jcc(taken, true);
+		uint32_t takenCycles = cycles + 1 + ((target >> 8) != (next >> 8) ? 1 : 0);
+		Jump(target, takenCycles, instructions);
+		E.Bind(notTaken);
+		Exit(next, cycles, instructions);
+	}
+
+	void Jump(uint16_t target, uint32_t cycles, uint32_t instructions)
+	{
+		if (target == Start)
+			Loop(cycles, instructions);
+		else
+			Exit(target, cycles, instructions);
+	}
+
+private:
+	// Effective address of a memory operand into dst
+	void Address(Reg dst, JitMode mode, uint8_t zp, uint16_t abs)
+	{
+		switch (mode)
+		{
+		case JitMode::ZeroPage:
+			E.MovImm32(dst, zp);
+			break;
+		case JitMode::ZeroPageX:
+		case JitMode::ZeroPageY:
+			E.Mov32(dst, mode == JitMode::ZeroPageX ? kRegX : kRegY);
+			E.Alu32Imm(X64Emitter::kAdd, dst, zp);
+			E.Movzx8(dst, dst);
+			break;
+		case JitMode::Absolute:
+			E.MovImm32(dst, abs);
+			break;
+		case JitMode::AbsoluteX:
+		case JitMode::AbsoluteY:
+			E.Mov32(dst, mode == JitMode::AbsoluteX ? kRegX : kRegY);
+			E.Alu32Imm(X64Emitter::kAdd, dst, abs);
+			E.Alu32Imm(X64Emitter::kAnd, dst, 0xFFFF);
+			break;
+		default:
+			assert(false);
+			break;
+		}
+	}
+
+	// Operand value into eax, not used for immediates
+	void LoadOperand(JitMode mode, const BlockCache::DecodedInstruction& instruction)
+	{
+		const uint8_t zp = instruction.bytes[1];
+		const uint16_t abs = combineAddr(instruction.bytes[1], instruction.bytes[2]);
+		if (mode == JitMode::ZeroPage || mode == JitMode::Absolute)
+		{
+			E.MovzxLoad8(X64Emitter::RAX, kRegMemory, mode == JitMode::ZeroPage ? zp : abs);
+		}
+		else
+		{
+			Address(X64Emitter::RAX, mode, zp, abs);
+			E.MovzxLoad8Indexed(X64Emitter::RAX, kRegMemory, X64Emitter::RAX);
+		}
+	}
+
+	void Alu(X64Emitter::AluOp op, Reg dst, JitMode mode, const BlockCache::DecodedInstruction& instruction)
+	{
+		if (mode == JitMode::Immediate)
+		{
+			E.Alu8Imm(op, dst, instruction.bytes[1]);
+		}
+		else
+		{
+			LoadOperand(mode, instruction);
+			E.Alu8(op, dst, X64Emitter::RAX);
+		}
+	}
+
+	// ADC/SBC, the carry is loaded once the operand address computation can't clobber it anymore
+	void Alu(X64Emitter::AluOp op, Reg dst, JitMode mode, const BlockCache::DecodedInstruction& instruction, bool invertCarry)
+	{
+		if (mode != JitMode::Immediate)
+			LoadOperand(mode, instruction);
+		E.BitTestMem(kRegState, offsetof(State, c), 0);
+		if (invertCarry)
+			E.Cmc();
+		if (mode == JitMode::Immediate)
+			E.Alu8Imm(op, dst, instruction.bytes[1]);
+		else
+			E.Alu8(op, dst, X64Emitter::RAX);
+	}
+
+	void LoadRegister(Reg dst, JitMode mode, const BlockCache::DecodedInstruction& instruction)
+	{
+		if (mode == JitMode::Immediate)
+		{
+			E.MovImm32(dst, instruction.bytes[1]);
+		}
+		else
+		{
+			LoadOperand(mode, instruction);
+			E.Mov32(dst, X64Emitter::RAX);
+		}
+		E.Mov32(kRegNZ, dst);
+	}
+
+	void Logic(X64Emitter::AluOp op, JitMode mode, const BlockCache::DecodedInstruction& instruction)
+	{
+		Alu(op, kRegA, mode, instruction);
+		E.Mov32(kRegNZ, kRegA);
+	}
+
+	void Compare(Reg reg, JitMode mode, const BlockCache::DecodedInstruction& instruction)
+	{
+		E.Mov32(kRegNZ, reg);
+		Alu(X64Emitter::kSub, kRegNZ, mode, instruction);
+		E.SetccMem(X64Emitter::kNotCarry, kRegState, offsetof(State, c));
+	}
+
+	void Transfer(Reg dst, Reg src)
+	{
+		E.Mov32(dst, src);
+		E.Mov32(kRegNZ, dst);
+	}
+
+	void Store(Reg src, JitMode mode, const BlockCache::DecodedInstruction& instruction, uint16_t next, uint32_t cycles, uint32_t instructions)
+	{
+		Address(kArg1, mode, instruction.bytes[1], combineAddr(instruction.bytes[1], instruction.bytes[2]));
+		E.Mov32(kArg2, src);
+		CallWrite(next, cycles, instructions);
+	}
+
+	void Shift(X64Emitter::ShiftOp op, bool throughCarry, JitMode mode, const BlockCache::DecodedInstruction& instruction, uint16_t next, uint32_t cycles, uint32_t instructions)
+	{
+		Reg value = kRegA;
+		if (mode != JitMode::Implied)
+		{
+			value = kArg2;
+			Address(kArg1, mode, instruction.bytes[1], combineAddr(instruction.bytes[1], instruction.bytes[2]));
+			E.MovzxLoad8Indexed(kArg2, kRegMemory, kArg1);
+		}
+		if (throughCarry)
+			E.BitTestMem(kRegState, offsetof(State, c), 0);
+		E.Shift8(op, value);
+		E.SetccMem(X64Emitter::kCarry, kRegState, offsetof(State, c));
+		E.Movzx8(kRegNZ, value);
+		if (mode != JitMode::Implied)
+			CallWrite(next, cycles, instructions);
+	}
+
+	// Write kArg2 at kArg1 through the interpreter, leaving if it hit translated code
+	void CallWrite(uint16_t next, uint32_t cycles, uint32_t instructions)
+	{
+		E.Mov64(kArg0, kRegState);
+		E.MovImm64(X64Emitter::RAX, reinterpret_cast<uint64_t>(WriteMemory));
+		E.Call(X64Emitter::RAX);
+		E.Test32(X64Emitter::RAX, X64Emitter::RAX);
+		X64Emitter::Label unchanged = E.Jcc(X64Emitter::kZero);
+		Exit(next, cycles, instructions);
+		E.Bind(unchanged);
+	}
+
+	X64Emitter& E;
+	uint16_t Start;
+	uint32_t BlockMaxCycles;
+	void* WriteMemory;
+	size_t LoopTop = 0;
+	std::vector<X64Emitter::Label> Exits;
+};
+
+Cpu6502::Jit::Jit()
+	: CodeSize(kCodeSize)
+	, CodeUsed(0)
+	, CodeExecutable(0)
+	, CurrentGeneration(1)
+#if CPU6502_JIT_LOCKSTEP
+	, ShadowClock(1000000)
+#endif
+{
+	// Writable only, the translated code is switched to executable once emitted, see Protect
+#ifdef _WIN32
+	Code = reinterpret_cast<uint8_t*>(VirtualAlloc(nullptr, CodeSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+#else
+	void* code = mmap(nullptr, CodeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	Code = code == MAP_FAILED ? nullptr : reinterpret_cast<uint8_t*>(code);
+#endif
+	// Without a code buffer nothing gets translated and the core behaves like BlockCache
+	if (!Code)
+		CodeSize = 0;
+}
+
+Cpu6502::Jit::~Jit()
+{
+	if (!Code)
+		return;
+#ifdef _WIN32
+	VirtualFree(Code, 0, MEM_RELEASE);
+#else
+	munmap(Code, CodeSize);
+#endif
+}
+
+void Cpu6502::Jit::Flush()
+{
+	Protect(0, CodeExecutable, false);
+	CodeExecutable = 0;
+	CodeUsed = 0;
+	++CurrentGeneration;
+}
+
+void Cpu6502::Jit::ProtectUsedCode()
+{
+	Protect(CodeExecutable, CodeUsed, true);
+	CodeExecutable = (CodeUsed + kProtectionGranularity - 1) & ~(kProtectionGranularity - 1);
+}
+
+void Cpu6502::Jit::Protect(size_t begin, size_t end, bool executable)
+{
+	begin &= ~(kProtectionGranularity - 1);
+	end = (end + kProtectionGranularity - 1) & ~(kProtectionGranularity - 1);
+	if (begin >= end)
+		return;
+#ifdef _WIN32
+	DWORD previous;
+	BOOL protectedCode = VirtualProtect(Code + begin, end - begin, executable ? PAGE_EXECUTE_READ : PAGE_READWRITE, &previous);
+	assert(protectedCode);
+	(void)protectedCode;
+#else
+	int result = mprotect(Code + begin, end - begin, executable ? PROT_READ | PROT_EXEC : PROT_READ | PROT_WRITE);
+	assert(result == 0);
+	(void)result;
+#endif
+}
+
+Cpu6502::Jit::NativeBlock Cpu6502::Jit::Translate(const BlockCache::Block& block, std::vector<uint8_t>& readPages)
+{
+	if (!Code)
+		return nullptr;
+
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		// The last executable page may hold the start of the free space
+		if (CodeUsed < CodeExecutable)
+		{
+			Protect(CodeUsed, CodeExecutable, false);
+			CodeExecutable = CodeUsed & ~(kProtectionGranularity - 1);
+		}
+
+		X64Emitter emitter(Code + CodeUsed, CodeSize - CodeUsed);
+		BlockTranslator translator(emitter, block.start, block.maxCycles, reinterpret_cast<void*>(&WriteMemory));
+		translator.Prologue();
+		readPages.clear();
+
+		uint16_t pc = block.start;
+		uint32_t cycles = 0;
+		uint32_t count = 0;
+		bool closed = false;
+		for (const BlockCache::DecodedInstruction& instruction : block.instructions)
+		{
+			JitOpcode opcode = Describe(instruction.bytes[0]);
+			if (opcode.op == JitOp::Unsupported)
+				break;
+
+			uint16_t next = pc + instruction.size;
+			if (opcode.op == JitOp::Jmp)
+			{
+				translator.Jump(combineAddr(instruction.bytes[1], instruction.bytes[2]), cycles + instruction.cycles, count + 1);
+				closed = true;
+				break;
+			}
+			if (opcode.op >= JitOp::Bpl)
+			{
+				uint16_t target = next + Kernels::AsInt8(instruction.bytes[1]);
+				translator.Branch(opcode.op, target, next, cycles + instruction.cycles, count + 1);
+				closed = true;
+				break;
+			}
+			if (!translator.Emit(instruction, opcode, next, cycles + instruction.cycles, count + 1))
+				break;
+			// The stores go through the bus
+			if (opcode.op < JitOp::Sta || opcode.op > JitOp::Sty)
+				AddReadPages(opcode.mode, instruction.bytes, readPages);
+
+			cycles += instruction.cycles;
+			++count;
+			pc = next;
+		}
+
+		if (count == 0 && !closed)
+		{
+			ProtectUsedCode();
+			return nullptr;
+		}
+		if (!closed)
+			translator.Exit(pc, cycles, count);
+		translator.Epilogue();
+
+		if (!emitter.HasOverflowed())
+		{
+			NativeBlock native = reinterpret_cast<NativeBlock>(Code + CodeUsed);
+			CodeUsed = (CodeUsed + emitter.GetSize() + 15) & ~size_t(15);
+			ProtectUsedCode();
+			return native;
+		}
+
+		// Buffer full: drop every translation and start over
+		Flush();
+	}
+	return nullptr;
+}
+
+uint32_t Cpu6502::Jit::WriteMemory(State* state, uint32_t addr, uint32_t value)
+{
+	Cpu6502* cpu = state->cpu;
+	uint64_t invalidations = cpu->Blocks->InvalidationCount();
+	Kernels::Write(cpu, *state->mem, uint16_t(addr), uint8_t(value));
+	return cpu->Blocks->InvalidationCount() != invalidations ? 1 : 0;
+}
+
+bool Cpu6502::Jit::HasSameCode(const BlockCache::Block& block, const Memory64k& mem)
+{
+	return mem.GetReadPage(block.start >> 8) == block.nativeCode[0] && mem.GetReadPage(uint16_t(block.end - 1) >> 8) == block.nativeCode[1];
+}
+
+bool Cpu6502::Jit::ReadsOwnRam(const BlockCache::Block& block, const Memory64k& mem)
+{
+	for (uint8_t page : block.nativeReads)
+	{
+		if (!mem.ReadsOwnRam(page))
+			return false;
+	}
+	return true;
+}
+
+void Cpu6502::Jit::LoadState(State& state, Cpu6502* cpu, Memory64k& mem)
+{
+	state.a = cpu->A;
+	state.x = cpu->X;
+	state.y = cpu->Y;
+	state.nz = cpu->ZResult == 0 ? 0 : ((cpu->NResult & 0x80) | 1);
+	state.c = cpu->C;
+	state.v = cpu->V;
+	state.pc = cpu->PC;
+	state.cycles = 0;
+	state.instructions = 0;
+	state.cpu = cpu;
+	state.mem = &mem;
+}
+
+void Cpu6502::Jit::StoreState(const State& state, Cpu6502* cpu)
+{
+	cpu->A = state.a;
+	cpu->X = state.x;
+	cpu->Y = state.y;
+	cpu->NResult = state.nz;
+	cpu->ZResult = state.nz;
+	cpu->C = state.c;
+	cpu->V = state.v;
+	cpu->PC = state.pc;
+}
+
+#if CPU6502_JIT_LOCKSTEP
+void Cpu6502::Jit::LockstepBegin(const Cpu6502* cpu, Memory64k& mem)
+{
+	if (!Shadow)
+		Shadow = std::make_unique<Cpu6502>(ShadowClock, cpu->Model, Cpu6502Core::FunctionTable);
+	for (uint32_t i = 0; i < kMemory64kSize; ++i)
+		ShadowMemory[i] = mem.Read(i);
+	Shadow->A = cpu->A;
+	Shadow->X = cpu->X;
+	Shadow->Y = cpu->Y;
+	Shadow->SP = cpu->SP;
+	Shadow->PC = cpu->PC;
+	Shadow->SetStatus(cpu->GetStatus());
+	Shadow->NextInstruction = cpu->NextInstruction;
+}
+
+void Cpu6502::Jit::LockstepCheck(const Cpu6502* cpu, Memory64k& mem, uint64_t instructions, uint64_t cycles)
+{
+	uint64_t shadowCycles = Shadow->RunInstructions(ShadowMemory, instructions);
+	assert(shadowCycles == cycles);
+	assert(Shadow->A == cpu->A && Shadow->X == cpu->X && Shadow->Y == cpu->Y);
+	assert(Shadow->SP == cpu->SP && Shadow->PC == cpu->PC && Shadow->GetStatus() == cpu->GetStatus());
+	for (uint32_t i = 0; i < kMemory64kSize; ++i)
+		assert(ShadowMemory[i] == mem.Read(i));
+	(void)shadowCycles;
+}
+#endif
+
+uint64_t Cpu6502::RunJit(Memory64k& mem, uint64_t maxCycles, uint64_t maxInstructions, uint64_t& instructions)
+{
+	uint64_t executed = 0;
+	uint64_t count = 0;
+	while (executed < maxCycles && count < maxInstructions)
+	{
+		if (BlockCache::OnDevicePage(mem, PC))
+		{
+			CPU6502_TRACE_INSTRUCTION(this, executed);
+			executed += ExecuteInstruction(mem);
+			++count;
+			continue;
+		}
+
+		Blocks->ReleaseRetired();
+		BlockCache::Block& block = Blocks->Get(this, mem, PC);
+		if (block.spin)
+		{
+			Blocks->Spin(this, mem, block, executed, count, maxCycles, maxInstructions);
+			continue;
+		}
+
+		if (block.native && block.nativeGeneration != JitCompiler->Generation())
+			block.native = nullptr;
+		if (!block.native && !block.nativeRejected && ++block.executions >= Jit::kTranslationThreshold)
+		{
+			block.native = reinterpret_cast<void*>(JitCompiler->Translate(block, block.nativeReads));
+			block.nativeGeneration = JitCompiler->Generation();
+			block.nativeRejected = block.native == nullptr;
+			block.nativeCode[0] = mem.GetReadPage(block.start >> 8);
+			block.nativeCode[1] = mem.GetReadPage(uint16_t(block.end - 1) >> 8);
+			block.nativeMapping = 0;
+		}
+
+		// Check the pages again when the mapping changed. Some other bank under the code, mapped without an
+		// InvalidateCode, gets decoded and translated again. The loads from pages which don't read their own
+		// RAM leave the block to the interpreter until they do again.
+		if (block.native && block.nativeMapping != mem.GetMappingGeneration())
+		{
+			if (!Jit::HasSameCode(block, mem))
+			{
+				InvalidateCode(block.start, uint16_t(block.end - block.start));
+				continue;
+			}
+			block.nativeOwnRam = Jit::ReadsOwnRam(block, mem);
+			block.nativeMapping = mem.GetMappingGeneration();
+		}
+
+		// The native code only checks the limits before looping, so the whole block has to fit.
+		// Its loads don't go through Kernels::Read, traced runs stay in the interpreter.
+		bool fits = executed + block.maxCycles < maxCycles && count + block.instructions.size() <= maxInstructions;
+		bool native = block.native && block.nativeOwnRam && fits && !IsTracing() && Jit::CanRun(this);
+#if CPU6502_JIT_LOCKSTEP
+		// The shadow CPU runs on a flat copy of the memory
+		native = native && mem.IsFlat();
+#endif
+		if (native)
+		{
+			Jit::State state;
+			Jit::LoadState(state, this, mem);
+			state.maxCycles = maxCycles - executed;
+			state.maxInstructions = maxInstructions - count;
+#if CPU6502_JIT_LOCKSTEP
+			JitCompiler->LockstepBegin(this, mem);
+#endif
+			reinterpret_cast<Jit::NativeBlock>(block.native)(&state, mem.GetData());
+			Jit::StoreState(state, this);
+			executed += state.cycles;
+			count += state.instructions;
+#if CPU6502_JIT_LOCKSTEP
+			JitCompiler->LockstepCheck(this, mem, state.instructions, state.cycles);
+#endif
+			continue;
+		}
+
+		Blocks->Interpret(this, mem, block, executed, count, maxCycles, maxInstructions);
+	}
+	instructions = count;
+	return executed;
+}
+
+#else
+
+uint64_t Cpu6502::RunJit(Memory64k& mem, uint64_t maxCycles, uint64_t maxInstructions, uint64_t& instructions)
+{
+	return RunBlockCache(mem, maxCycles, maxInstructions, instructions);
+}
+
+#endif
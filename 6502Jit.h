@@ -0,0 +1,113 @@
+#pragma once
+
+// x86-64 dynamic translator used by Cpu6502Core::Jit.
+// Hot blocks of the BlockCache are translated to host code keeping A/X/Y and the N/Z source in host
+// registers. Only instructions with a static cycle count are translated, a block is cut at the first
+// one that is not and the interpreter runs the rest. Stores go back through Kernels::Write, so self
+// modifying code invalidates the blocks exactly like with the interpreter and exits the native code.
+// Loads read the RAM directly, so a native block only runs while the pages it loads from map their own
+// RAM, checked again each time the memory mapping changes.
+// Build with CPU6502_JIT_LOCKSTEP=1 to check every native run against the FunctionTable core.
+
+#include "6502.h"
+#include "6502BlockCache.h"
+
+#if CPU6502_JIT_SUPPORTED
+
+#ifndef CPU6502_JIT_LOCKSTEP
+#define CPU6502_JIT_LOCKSTEP 0
+#endif
+
+class Cpu6502::Jit
+{
+public:
+	// Interface between the C++ side and the native code
+	struct State
+	{
+		uint8_t a;
+		uint8_t x;
+		uint8_t y;
+		uint8_t nz; // N is bit 7, Z is set when 0
+		uint8_t c;
+		uint8_t v;
+		uint16_t pc; // Out: where to resume
+		uint64_t cycles; // Out: cycles executed
+		uint64_t instructions; // Out: instructions executed
+		uint64_t maxCycles; // Self loops only iterate while staying below those
+		uint64_t maxInstructions;
+		Cpu6502* cpu;
+		Memory64k* mem;
+	};
+
+	using NativeBlock = void (*)(State* state, uint8_t* memory);
+
+	// Blocks are translated once they ran that many times in the interpreter
+	static constexpr uint16_t kTranslationThreshold = 8;
+
+	Jit();
+	~Jit();
+
+	// Returns nullptr when not even the first instruction of the block can be translated.
+	// readPages gets the pages the loads of the native code read directly.
+	NativeBlock Translate(const BlockCache::Block& block, std::vector<uint8_t>& readPages);
+
+	// Translations from a previous generation were thrown away when the code buffer was full
+	uint32_t Generation() const
+	{
+		return CurrentGeneration;
+	}
+
+	// Native blocks can't represent N and Z set together, nor decimal mode
+	static bool CanRun(const Cpu6502* cpu)
+	{
+		return !cpu->D && !((cpu->NResult & 0x80) && cpu->ZResult == 0);
+	}
+
+	// The code pages of the block still map the host memory it was translated from
+	static bool HasSameCode(const BlockCache::Block& block, const Memory64k& mem);
+	// The loads of the native block can read the RAM directly
+	static bool ReadsOwnRam(const BlockCache::Block& block, const Memory64k& mem);
+
+	static void LoadState(State& state, Cpu6502* cpu, Memory64k& mem);
+	static void StoreState(const State& state, Cpu6502* cpu);
+
+#if CPU6502_JIT_LOCKSTEP
+	// Replays what the native code just did with the FunctionTable core and compares the results
+	void LockstepBegin(const Cpu6502* cpu, Memory64k& mem);
+	void LockstepCheck(const Cpu6502* cpu, Memory64k& mem, uint64_t instructions, uint64_t cycles);
+#endif
+
+private:
+	// Called by the native code for every store, returns non zero if code was invalidated
+	static uint32_t WriteMemory(State* state, uint32_t addr, uint32_t value);
+
+	void Flush();
+	// The code buffer is never writable and executable at once: the pages of [begin, end) become
+	// executable and read only, or writable again to emit more code
+	void Protect(size_t begin, size_t end, bool executable);
+	// Makes the code emitted since the last call executable
+	void ProtectUsedCode();
+
+	class BlockTranslator;
+
+	uint8_t* Code;
+	size_t CodeSize;
+	size_t CodeUsed;
+	size_t CodeExecutable; // Pages of the buffer up to there are executable
+	uint32_t CurrentGeneration;
+
+#if CPU6502_JIT_LOCKSTEP
+	Clock ShadowClock;
+	Memory64k ShadowMemory;
+	std::unique_ptr<Cpu6502> Shadow;
+#endif
+};
+
+#else
+
+// Never instantiated, the constructor falls back to the BlockCache core
+class Cpu6502::Jit
+{
+};
+
+#endif
@@ -0,0 +1,658 @@
+#pragma once
+
+// Addressing mode and operation kernels used to build Cpu6502::InstructionTable.
+// Each opcode is the composition of one addressing mode and one operation, so a family
+// (all the ADC, all the LDA, ...) shares the same code and the same timing rules.
+// Only meant to be included by the Cpu6502 implementation files.
+
+#include "6502.h"
+#include "6502BlockCache.h"
+
+#include <type_traits>
+
+// Start of an instruction for the trace, executed is the number of cycles the core ran before it
+#if CPU6502_TRACE
+#define CPU6502_TRACE_INSTRUCTION(cpu, executed) (cpu)->TraceInstruction((cpu)->TraceBase + (executed))
+#else
+#define CPU6502_TRACE_INSTRUCTION(cpu, executed) ((void)0)
+#endif
+
+struct Cpu6502::Kernels
+{
+	static constexpr uint8_t kBit7Mask = 0b10000000;
+	static constexpr uint8_t kBit6Mask = 0b01000000;
+	static constexpr uint16_t kStackPage = 0x100;
+
+	static int8_t AsInt8(uint8_t value)
+	{
+		return static_cast<int8_t>(value);
+	}
+
+	// N and Z are evaluated from the value when read
+	static void SetNZ(Cpu6502* cpu, uint8_t value)
+	{
+		cpu->NResult = value;
+		cpu->ZResult = value;
+	}
+
+	static uint8_t Operand8(Cpu6502* cpu)
+	{
+		return cpu->InstructionDecoding[1];
+	}
+
+	static uint16_t Operand16(Cpu6502* cpu)
+	{
+		return combineAddr(cpu->InstructionDecoding[1], cpu->InstructionDecoding[2]);
+	}
+
+	// All the memory accesses of the instructions go through Read/Write, and the bus
+	MEMORY_FORCE_INLINE static uint8_t Read(Cpu6502* cpu, Memory64k& mem, uint16_t addr)
+	{
+#if CPU6502_TRACE
+		const uint8_t value = mem.BusRead(addr);
+		cpu->TraceMemory(addr, value, TraceAccess::Read);
+		return value;
+#else
+		return mem.BusRead(addr);
+#endif
+	}
+
+	MEMORY_FORCE_INLINE static void Write(Cpu6502* cpu, Memory64k& mem, uint16_t addr, uint8_t value)
+	{
+		mem.BusWrite(addr, value);
+#if CPU6502_TRACE
+		cpu->TraceMemory(addr, value, TraceAccess::Write);
+#endif
+		// Self modifying code: drop the pre-decoded blocks of that page
+		if (cpu->Blocks && cpu->Blocks->IsCodePage(addr >> 8))
+			cpu->Blocks->InvalidatePage(addr >> 8);
+	}
+
+	// Stack lives in page 1, SP holds the full address and wraps inside that page
+	static void Push(Cpu6502* cpu, Memory64k& mem, uint8_t value)
+	{
+		Write(cpu, mem, cpu->SP, value);
+		cpu->SP = kStackPage | ((cpu->SP - 1) & 0xFF);
+	}
+
+	static uint8_t Pull(Cpu6502* cpu, Memory64k& mem)
+	{
+		cpu->SP = kStackPage | ((cpu->SP + 1) & 0xFF);
+		return Read(cpu, mem, cpu->SP);
+	}
+
+	// The break flag only exists in the stack version of the flags
+	static void PushStatus(Cpu6502* cpu, Memory64k& mem)
+	{
+		Push(cpu, mem, cpu->GetStatus(true));
+	}
+
+	static void PullStatus(Cpu6502* cpu, Memory64k& mem)
+	{
+		cpu->SetStatus(Pull(cpu, mem));
+	}
+
+	//
+	// Addressing modes
+	// Memory modes provide Address(), PageCrossed() returns the extra cycle taken by read operations
+	// when it doesn't depend on memory
+	//
+
+	struct Implied
+	{
+	};
+
+	struct Accumulator
+	{
+	};
+
+	struct Immediate
+	{
+		static uint8_t PageCrossed(Cpu6502* cpu, Memory64k& mem) { return 0; }
+	};
+
+	struct Relative
+	{
+	};
+
+	struct ZeroPage
+	{
+		static uint16_t Address(Cpu6502* cpu, Memory64k& mem) { return Operand8(cpu); }
+		static uint8_t PageCrossed(Cpu6502* cpu, Memory64k& mem) { return 0; }
+	};
+
+	struct ZeroPageX
+	{
+		static uint16_t Address(Cpu6502* cpu, Memory64k& mem) { return (Operand8(cpu) + cpu->X) & 0xFF; }
+		static uint8_t PageCrossed(Cpu6502* cpu, Memory64k& mem) { return 0; }
+	};
+
+	struct ZeroPageY
+	{
+		static uint16_t Address(Cpu6502* cpu, Memory64k& mem) { return (Operand8(cpu) + cpu->Y) & 0xFF; }
+		static uint8_t PageCrossed(Cpu6502* cpu, Memory64k& mem) { return 0; }
+	};
+
+	struct Absolute
+	{
+		static uint16_t Address(Cpu6502* cpu, Memory64k& mem) { return Operand16(cpu); }
+		static uint8_t PageCrossed(Cpu6502* cpu, Memory64k& mem) { return 0; }
+	};
+
+	struct AbsoluteX
+	{
+		static uint16_t Address(Cpu6502* cpu, Memory64k& mem) { return Operand16(cpu) + cpu->X; }
+		static uint8_t PageCrossed(Cpu6502* cpu, Memory64k& mem) { return Operand8(cpu) + cpu->X > 0xFF ? 1 : 0; }
+	};
+
+	struct AbsoluteY
+	{
+		static uint16_t Address(Cpu6502* cpu, Memory64k& mem) { return Operand16(cpu) + cpu->Y; }
+		static uint8_t PageCrossed(Cpu6502* cpu, Memory64k& mem) { return Operand8(cpu) + cpu->Y > 0xFF ? 1 : 0; }
+	};
+
+	// (Indirect,X): pointer read from the zero page at operand + X
+	struct IndexedIndirect
+	{
+		static uint16_t Address(Cpu6502* cpu, Memory64k& mem)
+		{
+			uint8_t zpAddr = Operand8(cpu) + cpu->X;
+			return combineAddr(Read(cpu, mem, zpAddr), Read(cpu, mem, (zpAddr + 1) & 0xFF));
+		}
+		static uint8_t PageCrossed(Cpu6502* cpu, Memory64k& mem) { return 0; }
+	};
+
+	// (Indirect),Y: pointer read from the zero page at operand, then + Y
+	// The page crossing depends on the pointer, it comes with the address so the pointer is read once
+	struct IndirectIndexed
+	{
+		static uint16_t Address(Cpu6502* cpu, Memory64k& mem, uint8_t& pageCrossed)
+		{
+			uint8_t zpAddr = Operand8(cpu);
+			uint8_t low = Read(cpu, mem, zpAddr);
+			pageCrossed = low + cpu->Y > 0xFF ? 1 : 0;
+			return combineAddr(low, Read(cpu, mem, (zpAddr + 1) & 0xFF)) + cpu->Y;
+		}
+		static uint16_t Address(Cpu6502* cpu, Memory64k& mem)
+		{
+			uint8_t pageCrossed;
+			return Address(cpu, mem, pageCrossed);
+		}
+	};
+
+	// Only used by JMP
+	template <Cpu6502Model MODEL>
+	struct Indirect
+	{
+		static uint16_t Address(Cpu6502* cpu, Memory64k& mem)
+		{
+			uint16_t addr = Operand16(cpu);
+			// The original 6502 only increments the LSB, so the MSB is read from the same page
+			uint16_t addrHigh = MODEL == Cpu6502Model::Original
+				? combineAddr((Operand8(cpu) + 1) & 0xFF, cpu->InstructionDecoding[2])
+				: addr + 1;
+			return combineAddr(Read(cpu, mem, addr), Read(cpu, mem, addrHigh));
+		}
+	};
+
+	template <class MODE>
+	static uint8_t Load(Cpu6502* cpu, Memory64k& mem)
+	{
+		if constexpr (std::is_same_v<MODE, Immediate>)
+			return Operand8(cpu);
+		else if constexpr (std::is_same_v<MODE, Accumulator>)
+			return cpu->A;
+		else
+			return Read(cpu, mem, MODE::Address(cpu, mem));
+	}
+
+	//
+	// Operations
+	//
+
+	enum class OperationType
+	{
+		Read, // Apply(value) on the operand
+		Write, // Value() is stored at the operand address
+		ReadModifyWrite, // Modify(value) on the operand, result written back
+		Branch, // Condition() taken jumps relative to the PC
+		Jump, // PC set to the operand address
+		Control, // Execute() does everything, including changing the PC
+		Other, // Execute() does everything
+	};
+
+	struct Lda
+	{
+		static constexpr OperationType kType = OperationType::Read;
+		static void Apply(Cpu6502* cpu, uint8_t value) { cpu->A = value; SetNZ(cpu, value); }
+	};
+
+	struct Ldx
+	{
+		static constexpr OperationType kType = OperationType::Read;
+		static void Apply(Cpu6502* cpu, uint8_t value) { cpu->X = value; SetNZ(cpu, value); }
+	};
+
+	struct Ldy
+	{
+		static constexpr OperationType kType = OperationType::Read;
+		static void Apply(Cpu6502* cpu, uint8_t value) { cpu->Y = value; SetNZ(cpu, value); }
+	};
+
+	struct Ora
+	{
+		static constexpr OperationType kType = OperationType::Read;
+		static void Apply(Cpu6502* cpu, uint8_t value) { cpu->A |= value; SetNZ(cpu, cpu->A); }
+	};
+
+	struct And
+	{
+		static constexpr OperationType kType = OperationType::Read;
+		static void Apply(Cpu6502* cpu, uint8_t value) { cpu->A &= value; SetNZ(cpu, cpu->A); }
+	};
+
+	struct Eor
+	{
+		static constexpr OperationType kType = OperationType::Read;
+		static void Apply(Cpu6502* cpu, uint8_t value) { cpu->A ^= value; SetNZ(cpu, cpu->A); }
+	};
+
+	struct Adc
+	{
+		static constexpr OperationType kType = OperationType::Read;
+		static void Apply(Cpu6502* cpu, uint8_t value)
+		{
+			assert(!cpu->D); // Decimal mode not implemented !!!
+			uint16_t result = cpu->A + value + cpu->C;
+			cpu->V = ((~(cpu->A ^ value) & (cpu->A ^ result)) & kBit7Mask) != 0;
+			cpu->C = result > 0xFF;
+			cpu->A = result & 0xFF;
+			SetNZ(cpu, cpu->A);
+		}
+	};
+
+	// Subtraction is an addition of the one's complement
+	struct Sbc
+	{
+		static constexpr OperationType kType = OperationType::Read;
+		static void Apply(Cpu6502* cpu, uint8_t value) { Adc::Apply(cpu, value ^ 0xFF); }
+	};
+
+	template <uint8_t Cpu6502::* REGISTER>
+	struct Compare
+	{
+		static constexpr OperationType kType = OperationType::Read;
+		static void Apply(Cpu6502* cpu, uint8_t value)
+		{
+			uint8_t reg = cpu->*REGISTER;
+			cpu->C = reg >= value;
+			SetNZ(cpu, uint8_t(reg - value));
+		}
+	};
+	using Cmp = Compare<&Cpu6502::A>;
+	using Cpx = Compare<&Cpu6502::X>;
+	using Cpy = Compare<&Cpu6502::Y>;
+
+	struct Bit
+	{
+		static constexpr OperationType kType = OperationType::Read;
+		static void Apply(Cpu6502* cpu, uint8_t value)
+		{
+			cpu->NResult = value;
+			cpu->V = (value & kBit6Mask) != 0;
+			cpu->ZResult = cpu->A & value;
+		}
+	};
+
+	template <uint8_t Cpu6502::* REGISTER>
+	struct Store
+	{
+		static constexpr OperationType kType = OperationType::Write;
+		static uint8_t Value(Cpu6502* cpu) { return cpu->*REGISTER; }
+	};
+	using Sta = Store<&Cpu6502::A>;
+	using Stx = Store<&Cpu6502::X>;
+	using Sty = Store<&Cpu6502::Y>;
+
+	struct Asl
+	{
+		static constexpr OperationType kType = OperationType::ReadModifyWrite;
+		static uint8_t Modify(Cpu6502* cpu, uint8_t value)
+		{
+			cpu->C = (value & kBit7Mask) != 0;
+			value <<= 1;
+			SetNZ(cpu, value);
+			return value;
+		}
+	};
+
+	struct Lsr
+	{
+		static constexpr OperationType kType = OperationType::ReadModifyWrite;
+		static uint8_t Modify(Cpu6502* cpu, uint8_t value)
+		{
+			cpu->C = value & 1;
+			value >>= 1;
+			SetNZ(cpu, value);
+			return value;
+		}
+	};
+
+	struct Rol
+	{
+		static constexpr OperationType kType = OperationType::ReadModifyWrite;
+		static uint8_t Modify(Cpu6502* cpu, uint8_t value)
+		{
+			uint8_t newCarry = (value & kBit7Mask) != 0;
+			value = (value << 1) | cpu->C;
+			cpu->C = newCarry;
+			SetNZ(cpu, value);
+			return value;
+		}
+	};
+
+	struct Ror
+	{
+		static constexpr OperationType kType = OperationType::ReadModifyWrite;
+		static uint8_t Modify(Cpu6502* cpu, uint8_t value)
+		{
+			uint8_t newCarry = value & 1;
+			value = (value >> 1) | (cpu->C ? kBit7Mask : 0);
+			cpu->C = newCarry;
+			SetNZ(cpu, value);
+			return value;
+		}
+	};
+
+	struct Inc
+	{
+		static constexpr OperationType kType = OperationType::ReadModifyWrite;
+		static uint8_t Modify(Cpu6502* cpu, uint8_t value) { SetNZ(cpu, ++value); return value; }
+	};
+
+	struct Dec
+	{
+		static constexpr OperationType kType = OperationType::ReadModifyWrite;
+		static uint8_t Modify(Cpu6502* cpu, uint8_t value) { SetNZ(cpu, --value); return value; }
+	};
+
+	// FLAG is a pointer to a function reading the flag, bitfields can't be template arguments
+	template <uint8_t (*FLAG)(Cpu6502* cpu), uint8_t VALUE>
+	struct BranchIf
+	{
+		static constexpr OperationType kType = OperationType::Branch;
+		static bool Condition(Cpu6502* cpu) { return FLAG(cpu) == VALUE; }
+	};
+	static uint8_t FlagN(Cpu6502* cpu) { return cpu->NResult >> 7; }
+	static uint8_t FlagV(Cpu6502* cpu) { return cpu->V; }
+	static uint8_t FlagC(Cpu6502* cpu) { return cpu->C; }
+	static uint8_t FlagZ(Cpu6502* cpu) { return cpu->ZResult == 0; }
+	using Bpl = BranchIf<&FlagN, 0>;
+	using Bmi = BranchIf<&FlagN, 1>;
+	using Bvc = BranchIf<&FlagV, 0>;
+	using Bvs = BranchIf<&FlagV, 1>;
+	using Bcc = BranchIf<&FlagC, 0>;
+	using Bcs = BranchIf<&FlagC, 1>;
+	using Bne = BranchIf<&FlagZ, 0>;
+	using Beq = BranchIf<&FlagZ, 1>;
+
+	struct Jmp
+	{
+		static constexpr OperationType kType = OperationType::Jump;
+	};
+
+	struct Jsr
+	{
+		static constexpr OperationType kType = OperationType::Control;
+		static void Execute(Cpu6502* cpu, Memory64k& mem)
+		{
+			// Pushes the address of the last byte of the instruction
+			uint16_t addr = cpu->PC - 1;
+			Push(cpu, mem, (addr >> 8) & 0xFF);
+			Push(cpu, mem, addr & 0xFF);
+			cpu->PC = Operand16(cpu);
+		}
+	};
+
+	struct Rts
+	{
+		static constexpr OperationType kType = OperationType::Control;
+		static void Execute(Cpu6502* cpu, Memory64k& mem)
+		{
+			uint8_t low = Pull(cpu, mem);
+			uint8_t high = Pull(cpu, mem);
+			cpu->PC = combineAddr(low, high) + 1;
+		}
+	};
+
+	struct Brk
+	{
+		static constexpr OperationType kType = OperationType::Control;
+		static void Execute(Cpu6502* cpu, Memory64k& mem)
+		{
+			// The BRK instruction forces the generation of an interrupt request.
+			// The program counter and processor status are pushed on the stack then the
+			// IRQ interrupt vector at $FFFE/F is loaded into the PC.
+			cpu->PC += 1;
+			Push(cpu, mem, (cpu->PC >> 8) & 0xFF);
+			Push(cpu, mem, cpu->PC & 0xFF);
+			PushStatus(cpu, mem);
+			cpu->PC = combineAddr(Read(cpu, mem, 0xFFFE), Read(cpu, mem, 0xFFFF));
+		}
+	};
+
+	// Hardware interrupt request, same sequence as BRK without the break flag and the skipped byte
+	static uint8_t Irq(Cpu6502* cpu, Memory64k& mem)
+	{
+		Push(cpu, mem, (cpu->PC >> 8) & 0xFF);
+		Push(cpu, mem, cpu->PC & 0xFF);
+		Push(cpu, mem, cpu->GetStatus());
+		cpu->I = 1;
+		cpu->PC = combineAddr(Read(cpu, mem, 0xFFFE), Read(cpu, mem, 0xFFFF));
+		return 7;
+	}
+
+	struct Rti
+	{
+		static constexpr OperationType kType = OperationType::Control;
+		static void Execute(Cpu6502* cpu, Memory64k& mem)
+		{
+			PullStatus(cpu, mem);
+			uint8_t low = Pull(cpu, mem);
+			uint8_t high = Pull(cpu, mem);
+			cpu->PC = combineAddr(low, high);
+		}
+	};
+
+	struct Php
+	{
+		static constexpr OperationType kType = OperationType::Other;
+		static void Execute(Cpu6502* cpu, Memory64k& mem) { PushStatus(cpu, mem); }
+	};
+
+	struct Plp
+	{
+		static constexpr OperationType kType = OperationType::Other;
+		static void Execute(Cpu6502* cpu, Memory64k& mem) { PullStatus(cpu, mem); }
+	};
+
+	struct Pha
+	{
+		static constexpr OperationType kType = OperationType::Other;
+		static void Execute(Cpu6502* cpu, Memory64k& mem) { Push(cpu, mem, cpu->A); }
+	};
+
+	struct Pla
+	{
+		static constexpr OperationType kType = OperationType::Other;
+		static void Execute(Cpu6502* cpu, Memory64k& mem) { cpu->A = Pull(cpu, mem); SetNZ(cpu, cpu->A); }
+	};
+
+	struct Clc { static constexpr OperationType kType = OperationType::Other; static void Execute(Cpu6502* cpu, Memory64k& mem) { cpu->C = 0; } };
+	struct Sec { static constexpr OperationType kType = OperationType::Other; static void Execute(Cpu6502* cpu, Memory64k& mem) { cpu->C = 1; } };
+	struct Cli { static constexpr OperationType kType = OperationType::Other; static void Execute(Cpu6502* cpu, Memory64k& mem) { cpu->I = 0; } };
+	struct Sei { static constexpr OperationType kType = OperationType::Other; static void Execute(Cpu6502* cpu, Memory64k& mem) { cpu->I = 1; } };
+	struct Cld { static constexpr OperationType kType = OperationType::Other; static void Execute(Cpu6502* cpu, Memory64k& mem) { cpu->D = 0; } };
+	struct Clv { static constexpr OperationType kType = OperationType::Other; static void Execute(Cpu6502* cpu, Memory64k& mem) { cpu->V = 0; } };
+	struct Nop { static constexpr OperationType kType = OperationType::Other; static void Execute(Cpu6502* cpu, Memory64k& mem) {} };
+
+	struct Sed
+	{
+		static constexpr OperationType kType = OperationType::Other;
+		static void Execute(Cpu6502* cpu, Memory64k& mem)
+		{
+			assert(false); // Decimal mode is not supported....
+			cpu->D = 1;
+		}
+	};
+
+	template <uint8_t Cpu6502::* DESTINATION, uint8_t Cpu6502::* SOURCE>
+	struct Transfer
+	{
+		static constexpr OperationType kType = OperationType::Other;
+		static void Execute(Cpu6502* cpu, Memory64k& mem) { cpu->*DESTINATION = cpu->*SOURCE; SetNZ(cpu, cpu->*DESTINATION); }
+	};
+	using Tax = Transfer<&Cpu6502::X, &Cpu6502::A>;
+	using Tay = Transfer<&Cpu6502::Y, &Cpu6502::A>;
+	using Txa = Transfer<&Cpu6502::A, &Cpu6502::X>;
+	using Tya = Transfer<&Cpu6502::A, &Cpu6502::Y>;
+
+	struct Tsx
+	{
+		static constexpr OperationType kType = OperationType::Other;
+		static void Execute(Cpu6502* cpu, Memory64k& mem) { cpu->X = cpu->SP & 0xFF; SetNZ(cpu, cpu->X); }
+	};
+
+	// The only transfer not affecting the flags
+	struct Txs
+	{
+		static constexpr OperationType kType = OperationType::Other;
+		static void Execute(Cpu6502* cpu, Memory64k& mem) { cpu->SP = kStackPage | cpu->X; }
+	};
+
+	template <uint8_t Cpu6502::* REGISTER, uint8_t DELTA>
+	struct Increment
+	{
+		static constexpr OperationType kType = OperationType::Other;
+		static void Execute(Cpu6502* cpu, Memory64k& mem) { cpu->*REGISTER += DELTA; SetNZ(cpu, cpu->*REGISTER); }
+	};
+	using Inx = Increment<&Cpu6502::X, 1>;
+	using Iny = Increment<&Cpu6502::Y, 1>;
+	using Dex = Increment<&Cpu6502::X, 0xFF>;
+	using Dey = Increment<&Cpu6502::Y, 0xFF>;
+
+	//
+	// Composition
+	//
+
+	template <class MODE, class OPERATION>
+	static void Execute(Cpu6502* cpu, Memory64k& mem)
+	{
+		if constexpr (OPERATION::kType == OperationType::Read)
+		{
+			OPERATION::Apply(cpu, Load<MODE>(cpu, mem));
+		}
+		else if constexpr (OPERATION::kType == OperationType::Write)
+		{
+			Write(cpu, mem, MODE::Address(cpu, mem), OPERATION::Value(cpu));
+		}
+		else if constexpr (OPERATION::kType == OperationType::ReadModifyWrite)
+		{
+			if constexpr (std::is_same_v<MODE, Accumulator>)
+			{
+				cpu->A = OPERATION::Modify(cpu, cpu->A);
+			}
+			else
+			{
+				uint16_t addr = MODE::Address(cpu, mem);
+				Write(cpu, mem, addr, OPERATION::Modify(cpu, Read(cpu, mem, addr)));
+			}
+		}
+		else if constexpr (OPERATION::kType == OperationType::Branch)
+		{
+			if (OPERATION::Condition(cpu))
+				cpu->PC += AsInt8(Operand8(cpu));
+		}
+		else if constexpr (OPERATION::kType == OperationType::Jump)
+		{
+			cpu->PC = MODE::Address(cpu, mem);
+		}
+		else
+		{
+			OPERATION::Execute(cpu, mem);
+		}
+	}
+
+	// Called before Execute, once the operands are fetched
+	template <class MODE, class OPERATION>
+	static uint8_t ExtraCycle(Cpu6502* cpu, Memory64k& mem)
+	{
+		if constexpr (OPERATION::kType == OperationType::Read)
+		{
+			// Add 1 cycle if a page boundary is crossed
+			return MODE::PageCrossed(cpu, mem);
+		}
+		else if constexpr (OPERATION::kType == OperationType::Branch)
+		{
+			// Add 1 cycle if the branch occurs and the destination address is on the same page
+			// Add 2 cycles if the branch occurs and the destination address is on a different page
+			if (!OPERATION::Condition(cpu))
+				return 0;
+			uint16_t destination = cpu->PC + AsInt8(Operand8(cpu));
+			return (destination & 0xFF00) != (cpu->PC & 0xFF00) ? 2 : 1;
+		}
+		else
+		{
+			return 0;
+		}
+	}
+
+	template <class MODE, class OPERATION>
+	static uint8_t ExecuteWithExtraCycle(Cpu6502* cpu, Memory64k& mem)
+	{
+		if constexpr (OPERATION::kType == OperationType::Read && std::is_same_v<MODE, IndirectIndexed>)
+		{
+			uint8_t pageCrossed;
+			OPERATION::Apply(cpu, Read(cpu, mem, IndirectIndexed::Address(cpu, mem, pageCrossed)));
+			return pageCrossed;
+		}
+		else
+		{
+			uint8_t extraCycle = ExtraCycle<MODE, OPERATION>(cpu, mem);
+			Execute<MODE, OPERATION>(cpu, mem);
+			return extraCycle;
+		}
+	}
+
+	// Two instructions run by a single handler, used by the BlockCache for common pairs.
+	// PC already points after both, the first one is never a branch or jump.
+	template <class MODE1, class OPERATION1, uint8_t SIZE1, class MODE2, class OPERATION2>
+	static uint8_t ExecuteFused(Cpu6502* cpu, Memory64k& mem)
+	{
+		static_assert(OPERATION1::kType != OperationType::Branch && OPERATION1::kType != OperationType::Jump && OPERATION1::kType != OperationType::Control);
+		uint8_t extraCycles = ExecuteWithExtraCycle<MODE1, OPERATION1>(cpu, mem);
+		for (uint8_t i = 0; i < 3; ++i)
+			cpu->InstructionDecoding[i] = cpu->InstructionDecoding[SIZE1 + i];
+		return extraCycles + ExecuteWithExtraCycle<MODE2, OPERATION2>(cpu, mem);
+	}
+
+	template <class MODE, class OPERATION>
+	static constexpr InstructionInformation Instruction(uint8_t size, uint8_t cycles)
+	{
+		constexpr bool changesFlow = OPERATION::kType == OperationType::Branch
+			|| OPERATION::kType == OperationType::Jump
+			|| OPERATION::kType == OperationType::Control;
+		constexpr bool readOnly = OPERATION::kType == OperationType::Read
+			|| OPERATION::kType == OperationType::Branch
+			|| OPERATION::kType == OperationType::Jump;
+		return { size, cycles, changesFlow, readOnly, &Execute<MODE, OPERATION>, &ExecuteWithExtraCycle<MODE, OPERATION> };
+	}
+
+	static void IllegalExecute(Cpu6502* cpu, Memory64k& mem) {}
+	static uint8_t IllegalExecuteWithExtraCycle(Cpu6502* cpu, Memory64k& mem) { return 0; }
+
+	static constexpr InstructionInformation Illegal()
+	{
+		return { 0, 0, false, false, &IllegalExecute, &IllegalExecuteWithExtraCycle };
+	}
+};
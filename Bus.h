@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+// Memory mapped device, gets the CPU accesses to the pages it is mapped to with Memory::MapDevice.
+// Reads can have side effects, like acknowledging an interrupt or popping a FIFO.
+class BusDevice
+{
+public:
+	virtual ~BusDevice() = default;
+
+	virtual uint8_t Read(uint16_t address) = 0;
+	virtual void Write(uint16_t address, uint8_t value) = 0;
+};
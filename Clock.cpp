@@ -1,33 +1,163 @@
 #include "Clock.h"
 
-#include <thread>
+#include <algorithm>
+#include <cassert>
+#include <numeric>
 
-Clock::Clock(uint64_t frequency)
-	: TimeCycleUs(1000000/frequency)
-	, NextCycleTime(clock_type::now())
-	, CycleCount(0)
+Clock::Clock(uint64_t frequency, ClockPacing pacing)
+	: Clock(ClockRate{ frequency, 1 }, pacing)
 {
+}
 
+Clock::Clock(ClockRate rate, ClockPacing pacing)
+	: Rate(rate)
+	, Pacing(pacing)
+	, SpeedMultiplier(1)
+	, SpeedDivisor(1)
+	, MeasureTime(clock_type::now())
+	, MeasureCycle(0)
+	, Quantum(std::max<uint64_t>(1, rate.numerator / (rate.denominator * 1000)))
+	, StartTime(clock_type::now())
+	, StartCycle(0)
+	, NextSyncCycle(Quantum)
+	, CycleCount(0)
+	, Events()
+	, NextEventCycle(UINT64_MAX)
+	, Drift(0)
+	, Resyncs(0)
+	, SyncPacer()
+{
+	assert(Rate.numerator > 0 && Rate.denominator > 0);
+	const uint64_t divisor = std::gcd(Rate.numerator, Rate.denominator);
+	Rate.numerator /= divisor;
+	Rate.denominator /= divisor;
 }
 
 void Clock::Start()
 {
-	NextCycleTime = clock_type::now() + TimeCycleUs;
+	Restart();
+	MeasureTime = StartTime;
+	MeasureCycle = CycleCount;
+}
+
+void Clock::Restart()
+{
+	StartTime = clock_type::now();
+	StartCycle = CycleCount;
+	NextSyncCycle = CycleCount + Quantum;
+	Drift = std::chrono::nanoseconds(0);
 }
 
 void Clock::WaitForNextCycle()
 {
-	if (clock_type::now() < NextCycleTime)
-		std::this_thread::sleep_until(NextCycleTime);
+	if (CycleCount >= NextSyncCycle)
+		Sync();
 }
 
 void Clock::NextCycle()
 {
-	NextCycleTime += TimeCycleUs;
 	++CycleCount;
+	if (CycleCount >= NextEventCycle)
+		RunEvents();
+}
+
+void Clock::AdvanceCycles(uint64_t count)
+{
+	CycleCount += count;
+	if (CycleCount >= NextEventCycle)
+		RunEvents();
 }
 
 uint64_t Clock::Cycle()
 {
 	return CycleCount;
-}
\ No newline at end of file
+}
+
+EventId Clock::Schedule(uint64_t cycle, EventScheduler::Callback callback)
+{
+	EventId id = Events.Schedule(cycle, std::move(callback));
+	NextEventCycle = Events.NextCycle();
+	return id;
+}
+
+bool Clock::Cancel(EventId id)
+{
+	bool cancelled = Events.Cancel(id);
+	NextEventCycle = Events.NextCycle();
+	return cancelled;
+}
+
+void Clock::RunEvents()
+{
+	Events.RunDue(CycleCount);
+	NextEventCycle = Events.NextCycle();
+}
+
+void Clock::SetQuantum(uint64_t cycles)
+{
+	Quantum = std::max<uint64_t>(1, cycles);
+	NextSyncCycle = CycleCount + Quantum;
+}
+
+void Clock::SetPacing(ClockPacing pacing)
+{
+	Pacing = pacing;
+	Restart();
+}
+
+void Clock::SetSpeed(uint32_t multiplier, uint32_t divisor)
+{
+	SpeedMultiplier = std::max(1u, multiplier);
+	SpeedDivisor = std::max(1u, divisor);
+	Restart();
+}
+
+double Clock::GetMHz() const
+{
+	const double speed = Pacing == ClockPacing::Scaled ? double(SpeedMultiplier) / SpeedDivisor : 1.0;
+	return double(Rate.numerator) / Rate.denominator * speed / 1e6;
+}
+
+double Clock::GetEffectiveMHz() const
+{
+	const std::chrono::duration<double, std::micro> elapsed = clock_type::now() - MeasureTime;
+	return elapsed.count() > 0 ? (CycleCount - MeasureCycle) / elapsed.count() : 0.0;
+}
+
+std::chrono::nanoseconds Clock::CyclesDuration(uint64_t cycles) const
+{
+	// Host time of the cycles at the current speed, cycles * denominator / numerator seconds.
+	// Whole seconds apart so the product by 1e9 can't overflow below 18 GHz.
+	uint64_t numerator = Rate.numerator;
+	uint64_t ticks = cycles * Rate.denominator;
+	if (Pacing == ClockPacing::Scaled)
+	{
+		numerator *= SpeedMultiplier;
+		ticks *= SpeedDivisor;
+	}
+	const uint64_t seconds = ticks / numerator;
+	const uint64_t remainder = ticks % numerator;
+	return std::chrono::nanoseconds(seconds * 1000000000 + remainder * 1000000000 / numerator);
+}
+
+void Clock::Sync()
+{
+	NextSyncCycle = CycleCount + Quantum;
+	if (Pacing == ClockPacing::Virtual)
+		return;
+
+	const std::chrono::time_point<clock_type> deadline = StartTime + CyclesDuration(CycleCount - StartCycle);
+	const std::chrono::time_point<clock_type> now = clock_type::now();
+	Drift = now - deadline;
+	if (Drift < std::chrono::nanoseconds(0))
+	{
+		SyncPacer.WaitUntil(deadline);
+	}
+	else if (Drift > kMaxLag)
+	{
+		// Host suspended or too slow, running flat out would not catch up in a reasonable time
+		StartTime = now;
+		StartCycle = CycleCount;
+		++Resyncs;
+	}
+}
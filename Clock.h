@@ -1,23 +1,127 @@
 #pragma once
 
+#include "EventScheduler.h"
+#include "Pacer.h"
+
 #include <cstdint>
 #include <chrono>
 
+// Exact frequency in Hz, numerator / denominator, for crystals which are not a whole number of Hz
+struct ClockRate
+{
+	uint64_t numerator;
+	uint64_t denominator;
+};
+
+enum class ClockPacing
+{
+	RealTime, // Emulated time follows the host time
+	Scaled, // Emulated time runs at SetSpeed times the host time
+	Virtual, // Unthrottled, only counts cycles and never reads the host time to pace
+};
+
+// Paces the emulation against real time by quantum: the CPU runs a whole quantum of cycles flat out,
+// then Sync sleeps until the real time of the cycle reached. Deadlines are computed from the Start
+// time and the cycle count, so rounding errors and oversleeps don't accumulate over the quanta.
 class Clock
 {
-	using clock_type = std::chrono::high_resolution_clock;
+	using clock_type = std::chrono::steady_clock;
 public:
-	Clock(uint64_t frequency);
+	Clock(uint64_t frequency, ClockPacing pacing = ClockPacing::RealTime);
+	Clock(ClockRate rate, ClockPacing pacing = ClockPacing::RealTime);
 
 	void Start();
-	void WaitForNextCycle();
+	void WaitForNextCycle(); // Per cycle loop, only waits once per quantum
 	void NextCycle();
+	void AdvanceCycles(uint64_t count); // Account for several cycles at once, fires the events reached
 
 	uint64_t Cycle();
 
+	// Events fire once the cycle count reaches their cycle, from the thread advancing the clock.
+	// Cpu6502 runs stop at the first instruction boundary at or after the next event to fire it.
+	EventId Schedule(uint64_t cycle, EventScheduler::Callback callback);
+	bool Cancel(EventId id);
+
+	uint64_t CyclesUntilEvent() const
+	{
+		return NextEventCycle > CycleCount ? NextEventCycle - CycleCount : 0;
+	}
+
+	// Cycles run between two syncs, one emulated millisecond by default
+	void SetQuantum(uint64_t cycles);
+	uint64_t GetQuantum() const
+	{
+		return Quantum;
+	}
+
+	// Cycles to run before the next Sync
+	uint64_t CyclesUntilSync() const
+	{
+		return NextSyncCycle > CycleCount ? NextSyncCycle - CycleCount : 0;
+	}
+
+	// Wait until the real time of the current cycle, see Pacer. When late the next quanta run without waiting
+	// to catch up, unless the lag exceeds kMaxLag: then it is dropped instead of fast forwarded.
+	void Sync();
+
+	// Lateness of the emulation at the last sync, negative when it had to wait
+	std::chrono::nanoseconds GetDrift() const
+	{
+		return Drift;
+	}
+
+	// Times the lag was dropped
+	uint64_t GetResyncs() const
+	{
+		return Resyncs;
+	}
+
+	// Wake up jitter statistics and spin settings
+	Pacer& GetPacer()
+	{
+		return SyncPacer;
+	}
+
+	// Changing the pacing or the speed restarts the pacing from the current cycle
+	void SetPacing(ClockPacing pacing);
+	ClockPacing GetPacing() const
+	{
+		return Pacing;
+	}
+
+	// Speed of the Scaled pacing, multiplier / divisor times the real time
+	void SetSpeed(uint32_t multiplier, uint32_t divisor = 1);
+
+	ClockRate GetRate() const
+	{
+		return Rate;
+	}
+
+	// Nominal frequency and the one measured since Start, which reads the host time
+	double GetMHz() const;
+	double GetEffectiveMHz() const;
+
+	static constexpr std::chrono::milliseconds kMaxLag{ 100 };
+
 private:
-	std::chrono::microseconds TimeCycleUs;
-	std::chrono::time_point<clock_type> NextCycleTime;
+	std::chrono::nanoseconds CyclesDuration(uint64_t cycles) const;
+	void Restart();
+	void RunEvents();
+
+	ClockRate Rate;
+	ClockPacing Pacing;
+	uint32_t SpeedMultiplier;
+	uint32_t SpeedDivisor;
+	std::chrono::time_point<clock_type> MeasureTime; // Start of the effective frequency measure
+	uint64_t MeasureCycle;
+	uint64_t Quantum;
+	std::chrono::time_point<clock_type> StartTime;
+	uint64_t StartCycle; // Cycle count at StartTime
+	uint64_t NextSyncCycle;
 	uint64_t CycleCount;
+	EventScheduler Events;
+	uint64_t NextEventCycle; // Cached from Events for the per cycle check
+	std::chrono::nanoseconds Drift;
+	uint64_t Resyncs;
+	Pacer SyncPacer;
 };
-
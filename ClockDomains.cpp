@@ -0,0 +1,40 @@
+#include "ClockDomains.h"
+
+#include <cassert>
+#include <numeric>
+
+ClockDomains::ClockDomains(ClockRate master)
+	: Master(master)
+	, Dividers()
+{
+	assert(master.numerator > 0 && master.denominator > 0);
+}
+
+ClockDomains::Domain ClockDomains::Add(uint32_t divider)
+{
+	assert(divider > 0);
+	Dividers.push_back(divider);
+	return Domain(Dividers.size() - 1);
+}
+
+ClockRate ClockDomains::GetRate(Domain domain) const
+{
+	const uint64_t denominator = Master.denominator * Dividers[domain];
+	const uint64_t divisor = std::gcd(Master.numerator, denominator);
+	return { Master.numerator / divisor, denominator / divisor };
+}
+
+uint64_t ClockDomains::ToDomain(uint64_t cycles, Domain from, Domain to) const
+{
+	// cycles * from / to rounded down, whole `to` dividers apart so the product can't overflow
+	const uint64_t fromDivider = Dividers[from];
+	const uint64_t toDivider = Dividers[to];
+	return cycles / toDivider * fromDivider + cycles % toDivider * fromDivider / toDivider;
+}
+
+uint64_t ClockDomains::ToDomainCeil(uint64_t cycles, Domain from, Domain to) const
+{
+	const uint64_t fromDivider = Dividers[from];
+	const uint64_t toDivider = Dividers[to];
+	return cycles / toDivider * fromDivider + (cycles % toDivider * fromDivider + toDivider - 1) / toDivider;
+}
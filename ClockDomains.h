@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Clock.h"
+
+#include <cstdint>
+#include <vector>
+
+// Clock domains derived from one master crystal, like the CPU, video and audio clocks of a machine
+// which all divide the same oscillator. A domain ticks once every `divider` master ticks, so the time
+// of every domain is kept exactly on the master tick count and converting between domains only takes
+// integer arithmetic.
+// Typically the CPU Clock is created with GetRate(cpu), and the devices compute how far they are in
+// their own domain from the CPU cycle count, or schedule their events at ToDomainCeil(cycle, own, cpu).
+class ClockDomains
+{
+public:
+	using Domain = uint32_t;
+
+	ClockDomains(ClockRate master);
+
+	Domain Add(uint32_t divider);
+
+	ClockRate GetMasterRate() const
+	{
+		return Master;
+	}
+
+	// Master rate / divider
+	ClockRate GetRate(Domain domain) const;
+
+	uint32_t GetDivider(Domain domain) const
+	{
+		return Dividers[domain];
+	}
+
+	// Master ticks at the start of the cycle
+	uint64_t ToMaster(Domain domain, uint64_t cycles) const
+	{
+		return cycles * Dividers[domain];
+	}
+
+	// Cycles started at or before the master tick
+	uint64_t FromMaster(Domain domain, uint64_t ticks) const
+	{
+		return ticks / Dividers[domain];
+	}
+
+	// Cycles of `to` started at or before the start of the `from` cycle
+	uint64_t ToDomain(uint64_t cycles, Domain from, Domain to) const;
+
+	// First cycle of `to` starting at or after the start of the `from` cycle
+	uint64_t ToDomainCeil(uint64_t cycles, Domain from, Domain to) const;
+
+private:
+	ClockRate Master;
+	std::vector<uint32_t> Dividers;
+};
@@ -0,0 +1,112 @@
+#include "EventScheduler.h"
+
+#include <cassert>
+
+EventScheduler::EventScheduler()
+	: Heap()
+	, Slots()
+	, FreeSlots()
+	, NextSequence(0)
+{
+}
+
+EventId EventScheduler::Schedule(uint64_t cycle, Callback callback)
+{
+	uint32_t slot;
+	if (FreeSlots.empty())
+	{
+		slot = uint32_t(Slots.size());
+		Slots.push_back({ nullptr, 0, 1 });
+	}
+	else
+	{
+		slot = FreeSlots.back();
+		FreeSlots.pop_back();
+	}
+	Slots[slot].callback = std::move(callback);
+
+	Heap.push_back({});
+	SiftUp(Heap.size() - 1, { cycle, NextSequence++, slot });
+	return EventId(Slots[slot].generation) << 32 | slot;
+}
+
+bool EventScheduler::Cancel(EventId id)
+{
+	const uint32_t slot = uint32_t(id);
+	if (slot >= Slots.size() || Slots[slot].generation != uint32_t(id >> 32))
+		return false;
+	Remove(Slots[slot].heapIndex);
+	return true;
+}
+
+void EventScheduler::RunDue(uint64_t cycle)
+{
+	while (!Heap.empty() && Heap[0].cycle <= cycle)
+	{
+		const uint64_t eventCycle = Heap[0].cycle;
+		Callback callback = std::move(Slots[Heap[0].slot].callback);
+		Remove(0);
+		callback(eventCycle);
+	}
+}
+
+void EventScheduler::Place(size_t index, const Entry& entry)
+{
+	Heap[index] = entry;
+	Slots[entry.slot].heapIndex = uint32_t(index);
+}
+
+void EventScheduler::SiftUp(size_t index, Entry entry)
+{
+	while (index > 0)
+	{
+		size_t parent = (index - 1) / kArity;
+		if (!Before(entry, Heap[parent]))
+			break;
+		Place(index, Heap[parent]);
+		index = parent;
+	}
+	Place(index, entry);
+}
+
+void EventScheduler::SiftDown(size_t index, Entry entry)
+{
+	const size_t size = Heap.size();
+	for (;;)
+	{
+		const size_t first = index * kArity + 1;
+		if (first >= size)
+			break;
+		size_t best = first;
+		const size_t last = first + kArity < size ? first + kArity : size;
+		for (size_t child = first + 1; child < last; ++child)
+		{
+			if (Before(Heap[child], Heap[best]))
+				best = child;
+		}
+		if (!Before(Heap[best], entry))
+			break;
+		Place(index, Heap[best]);
+		index = best;
+	}
+	Place(index, entry);
+}
+
+void EventScheduler::Remove(size_t index)
+{
+	assert(index < Heap.size());
+	Slot& slot = Slots[Heap[index].slot];
+	slot.callback = nullptr;
+	++slot.generation;
+	FreeSlots.push_back(Heap[index].slot);
+
+	// Move the last entry into the hole, it can have to go either way
+	Entry last = Heap.back();
+	Heap.pop_back();
+	if (index == Heap.size())
+		return;
+	if (index > 0 && Before(last, Heap[(index - 1) / kArity]))
+		SiftUp(index, last);
+	else
+		SiftDown(index, last);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// 0 is never a valid id
+using EventId = uint64_t;
+
+// Events keyed by the cycle they fire at, in a 4-ary min heap: O(log n) schedule and cancel,
+// O(1) access to the next event. Events of the same cycle fire in the order they were scheduled.
+class EventScheduler
+{
+public:
+	using Callback = std::function<void(uint64_t cycle)>;
+
+	EventScheduler();
+
+	EventId Schedule(uint64_t cycle, Callback callback);
+
+	// Return false when the event already fired or was cancelled
+	bool Cancel(EventId id);
+
+	// UINT64_MAX when empty
+	uint64_t NextCycle() const
+	{
+		return Heap.empty() ? UINT64_MAX : Heap[0].cycle;
+	}
+
+	// Fire the events due at that cycle, the callbacks can schedule and cancel events
+	void RunDue(uint64_t cycle);
+
+	size_t GetCount() const
+	{
+		return Heap.size();
+	}
+
+private:
+	static constexpr size_t kArity = 4;
+
+	// The key is kept in the heap so the sifts don't touch the slots
+	struct Entry
+	{
+		uint64_t cycle;
+		uint64_t sequence;
+		uint32_t slot;
+	};
+
+	struct Slot
+	{
+		Callback callback;
+		uint32_t heapIndex;
+		uint32_t generation; // Bumped when freed, makes the ids of fired events stale
+	};
+
+	static bool Before(const Entry& a, const Entry& b)
+	{
+		return a.cycle < b.cycle || (a.cycle == b.cycle && a.sequence < b.sequence);
+	}
+
+	void Place(size_t index, const Entry& entry);
+	void SiftUp(size_t index, Entry entry);
+	void SiftDown(size_t index, Entry entry);
+	void Remove(size_t index);
+
+	std::vector<Entry> Heap;
+	std::vector<Slot> Slots;
+	std::vector<uint32_t> FreeSlots;
+	uint64_t NextSequence;
+};
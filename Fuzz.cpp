@@ -0,0 +1,332 @@
+#include "Fuzz.h"
+#include "6502.h"
+#include "6502Batch.h"
+
+#include <cassert>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+	// Legal instructions by size, without the ones leaving the loop (BRK, JSR, RTS, RTI, JMP), the
+	// indirect stores, whose pointers in zero page can be anything, and SED and PLP since decimal mode
+	// is not implemented
+	constexpr uint8_t kOneByte[] =
+	{
+		0x08, 0x0A, 0x18, 0x2A, 0x38, 0x48, 0x4A, 0x58, 0x68, 0x6A, 0x78, 0x88, 0x8A, 0x98, 0x9A,
+		0xA8, 0xAA, 0xB8, 0xBA, 0xC8, 0xCA, 0xD8, 0xE8, 0xEA,
+	};
+	constexpr uint8_t kTwoBytes[] =
+	{
+		0x01, 0x05, 0x06, 0x09, 0x11, 0x15, 0x16, 0x21, 0x24, 0x25, 0x26, 0x29, 0x31, 0x35, 0x36, 0x41,
+		0x45, 0x46, 0x49, 0x51, 0x55, 0x56, 0x61, 0x65, 0x66, 0x69, 0x71, 0x75, 0x76, 0x84, 0x85, 0x86,
+		0x94, 0x95, 0x96, 0xA0, 0xA1, 0xA2, 0xA4, 0xA5, 0xA6, 0xA9, 0xB1, 0xB4, 0xB5, 0xB6, 0xC0, 0xC1,
+		0xC4, 0xC5, 0xC6, 0xC9, 0xD1, 0xD5, 0xD6, 0xE0, 0xE1, 0xE4, 0xE5, 0xE6, 0xE9, 0xF1, 0xF5, 0xF6,
+	};
+	// Absolute, Absolute,X and Absolute,Y
+	constexpr uint8_t kThreeBytes[] =
+	{
+		0x0D, 0x0E, 0x19, 0x1D, 0x1E, 0x2C, 0x2D, 0x2E, 0x39, 0x3D, 0x3E, 0x4D, 0x4E, 0x59, 0x5D, 0x5E,
+		0x6D, 0x6E, 0x79, 0x7D, 0x7E, 0x8C, 0x8D, 0x8E, 0x99, 0x9D, 0xAC, 0xAD, 0xAE, 0xB9, 0xBC, 0xBD,
+		0xBE, 0xCC, 0xCD, 0xCE, 0xD9, 0xDD, 0xDE, 0xEC, 0xED, 0xEE, 0xF9, 0xFD, 0xFE,
+	};
+	constexpr uint8_t kBranches[] = { 0x10, 0x30, 0x50, 0x70, 0x90, 0xB0, 0xD0, 0xF0 };
+
+	constexpr uint16_t kCodeStart = 0xC000; // The RAM below is random, the stores stay there
+	constexpr uint16_t kInterruptHandler = 0xFF00;
+	constexpr uint32_t kMaxInstructions = 40;
+	constexpr size_t kLaneCount = 8; // Batch lanes, they run the same code on different RAM
+	constexpr uint32_t kSlices = 4; // RunFor calls of the core checks
+
+	template <size_t N>
+	uint8_t Pick(std::mt19937& random, const uint8_t (&opcodes)[N])
+	{
+		return opcodes[random() % N];
+	}
+
+	void GenerateRam(std::mt19937& random, std::vector<uint8_t>& image)
+	{
+		for (uint32_t i = 0; i < kCodeStart; ++i)
+			image[i] = uint8_t(random());
+	}
+
+	// Full memory image of a program: random RAM, then CLI, the loop and the vectors
+	void Generate(std::mt19937& random, std::vector<uint8_t>& image)
+	{
+		image.assign(kMemory64kSize, 0);
+		GenerateRam(random, image);
+
+		uint16_t pc = kCodeStart;
+		image[pc++] = 0x58; // CLI, so the interrupts are taken
+		const uint16_t loop = pc;
+		std::vector<uint16_t> starts;
+		std::vector<uint16_t> branches;
+		const uint32_t count = 4 + random() % (kMaxInstructions - 4);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			starts.push_back(pc);
+			const uint32_t kind = random() % 8;
+			if (kind < 2)
+			{
+				image[pc++] = Pick(random, kOneByte);
+			}
+			else if (kind < 5)
+			{
+				image[pc++] = Pick(random, kTwoBytes);
+				image[pc++] = uint8_t(random());
+			}
+			else if (kind < 7)
+			{
+				// Indexed by up to $FF, stays below the code
+				const uint16_t address = uint16_t(0x200 + random() % (kCodeStart - 0x200 - 0x100));
+				image[pc++] = Pick(random, kThreeBytes);
+				image[pc++] = uint8_t(address);
+				image[pc++] = uint8_t(address >> 8);
+			}
+			else
+			{
+				branches.push_back(pc);
+				image[pc++] = Pick(random, kBranches);
+				image[pc++] = 0;
+			}
+		}
+		starts.push_back(pc);
+		image[pc++] = 0x4C; // JMP loop
+		image[pc++] = uint8_t(loop);
+		image[pc++] = uint8_t(loop >> 8);
+
+		// Branch to any instruction of the loop, the loop is short enough for all of them to be in range
+		for (uint16_t branch : branches)
+		{
+			const int offset = starts[random() % starts.size()] - (branch + 2);
+			assert(offset >= -128 && offset <= 127);
+			image[branch + 1] = uint8_t(offset);
+		}
+
+		image[kInterruptHandler] = 0x40; // RTI
+		for (uint16_t vector : { 0xFFFA, 0xFFFE })
+		{
+			image[vector] = uint8_t(kInterruptHandler);
+			image[vector + 1] = uint8_t(kInterruptHandler >> 8);
+		}
+		image[0xFFFC] = uint8_t(kCodeStart);
+		image[0xFFFD] = uint8_t(kCodeStart >> 8);
+	}
+
+	void Load(Memory64k& mem, const std::vector<uint8_t>& image)
+	{
+		for (uint32_t i = 0; i < kMemory64kSize; ++i)
+			mem[i] = image[i];
+	}
+
+	struct MachineState
+	{
+		uint8_t a;
+		uint8_t x;
+		uint8_t y;
+		uint16_t sp;
+		uint16_t pc;
+		uint8_t status;
+		uint64_t cycles;
+	};
+
+	MachineState GetState(Cpu6502& cpu, Memory64k& mem, uint64_t cycles)
+	{
+		Cpu6502::Snapshot snapshot = cpu.TakeSnapshot(mem);
+		return { snapshot.a, snapshot.x, snapshot.y, snapshot.sp, snapshot.pc, snapshot.status, cycles };
+	}
+
+	MachineState GetState(const Cpu6502Batch& batch, size_t lane)
+	{
+		Cpu6502Batch::Registers registers = batch.GetRegisters(lane);
+		return { registers.a, registers.x, registers.y, registers.sp, registers.pc, registers.status, batch.GetCycles(lane) };
+	}
+
+	const char* GetModelName(Cpu6502Model model)
+	{
+		return model == Cpu6502Model::Original ? "6502" : "65C02";
+	}
+
+	const char* GetCoreName(Cpu6502Core core)
+	{
+		switch (core)
+		{
+		case Cpu6502Core::FunctionTable:
+			return "FunctionTable";
+		case Cpu6502Core::Switch:
+			return "Switch";
+		case Cpu6502Core::BlockCache:
+			return "BlockCache";
+		case Cpu6502Core::Jit:
+			return "Jit";
+		}
+		return "?";
+	}
+
+	// Prints the first difference with the expected state
+	bool Check(const char* path, uint32_t seed, uint32_t program, Cpu6502Model model,
+		const MachineState& state, const Memory64k& mem, const MachineState& expected, const Memory64k& expectedMem)
+	{
+		const char* difference = nullptr;
+		if (state.cycles != expected.cycles)
+			difference = "cycles";
+		else if (state.pc != expected.pc)
+			difference = "PC";
+		else if (state.a != expected.a || state.x != expected.x || state.y != expected.y || state.sp != expected.sp)
+			difference = "registers";
+		else if (state.status != expected.status)
+			difference = "status";
+		for (uint32_t i = 0; i < kMemory64kSize && !difference; ++i)
+		{
+			if (mem.Read(i) != expectedMem.Read(i))
+				difference = "memory";
+		}
+		if (!difference)
+			return true;
+
+		fprintf(stderr, "seed %u program %u %s: %s differs in %s"
+			" (PC %04X A %02X X %02X Y %02X SP %03X P %02X, %llu cycles,"
+			" expected PC %04X A %02X X %02X Y %02X SP %03X P %02X, %llu cycles)\n",
+			seed, program, GetModelName(model), path, difference,
+			state.pc, state.a, state.x, state.y, state.sp, state.status, (unsigned long long)state.cycles,
+			expected.pc, expected.a, expected.x, expected.y, expected.sp, expected.status, (unsigned long long)expected.cycles);
+		return false;
+	}
+
+	bool CheckExecuteCycle(uint32_t seed, uint32_t program, Cpu6502Model model, const std::vector<uint8_t>& image, std::mt19937& random)
+	{
+		const uint64_t before = 50 + random() % 500;
+		const uint64_t after = 50 + random() % 500;
+
+		Clock referenceClock(1000000, ClockPacing::Virtual);
+		Memory64k referenceMem;
+		Load(referenceMem, image);
+		Cpu6502 reference(referenceClock, model, Cpu6502Core::FunctionTable);
+		reference.Reset(referenceMem);
+		const uint64_t cyclesBefore = reference.RunInstructions(referenceMem, before);
+		reference.Interrupt();
+		const uint64_t cyclesAfter = reference.RunInstructions(referenceMem, after);
+
+		Clock clock(1000000, ClockPacing::Virtual);
+		Memory64k mem;
+		Load(mem, image);
+		Cpu6502 cpu(clock, model);
+		cpu.Reset(mem);
+		for (uint64_t i = 0; i < cyclesBefore; ++i)
+		{
+			cpu.ExecuteCycle(mem);
+			clock.AdvanceCycles(1);
+		}
+		cpu.Interrupt();
+		for (uint64_t i = 0; i < cyclesAfter; ++i)
+		{
+			cpu.ExecuteCycle(mem);
+			clock.AdvanceCycles(1);
+		}
+
+		const uint64_t cycles = cyclesBefore + cyclesAfter;
+		return Check("ExecuteCycle", seed, program, model, GetState(cpu, mem, cycles), mem,
+			GetState(reference, referenceMem, cycles), referenceMem);
+	}
+
+	// A CPU running one lane, the same RunFor slices as the batch
+	struct CoreRun
+	{
+		Clock clock;
+		Memory64k mem;
+		Cpu6502 cpu;
+		uint64_t cycles;
+
+		CoreRun(Cpu6502Model model, Cpu6502Core core, const std::vector<uint8_t>& image)
+			: clock(1000000, ClockPacing::Virtual)
+			, cpu(clock, model, core)
+			, cycles(0)
+		{
+			Load(mem, image);
+			cpu.Reset(mem);
+		}
+	};
+
+	// Every core and the batch engine against FunctionTable, on the lanes of the program
+	uint32_t CheckCores(uint32_t seed, uint32_t program, Cpu6502Model model, const std::vector<uint8_t>& image, std::mt19937& random)
+	{
+		std::vector<std::vector<uint8_t>> lanes(kLaneCount, image);
+		for (size_t lane = 1; lane < kLaneCount; ++lane)
+			GenerateRam(random, lanes[lane]);
+		uint64_t slices[kSlices];
+		for (uint64_t& slice : slices)
+			slice = 500 + random() % 5000;
+
+		std::vector<std::unique_ptr<CoreRun>> references;
+		for (const std::vector<uint8_t>& lane : lanes)
+		{
+			references.push_back(std::make_unique<CoreRun>(model, Cpu6502Core::FunctionTable, lane));
+			for (uint64_t slice : slices)
+				references.back()->cycles += references.back()->cpu.RunFor(references.back()->mem, slice);
+		}
+
+		uint32_t failures = 0;
+		for (Cpu6502Core core : { Cpu6502Core::Switch, Cpu6502Core::BlockCache, Cpu6502Core::Jit })
+		{
+			for (size_t lane = 0; lane < kLaneCount; ++lane)
+			{
+				CoreRun run(model, core, lanes[lane]);
+				for (uint64_t slice : slices)
+					run.cycles += run.cpu.RunFor(run.mem, slice);
+				CoreRun& reference = *references[lane];
+				failures += Check(GetCoreName(core), seed, program, model, GetState(run.cpu, run.mem, run.cycles), run.mem,
+					GetState(reference.cpu, reference.mem, reference.cycles), reference.mem) ? 0 : 1;
+			}
+		}
+
+		std::vector<std::unique_ptr<Memory64k>> memories;
+		Cpu6502Batch batch(model, kLaneCount);
+		for (size_t lane = 0; lane < kLaneCount; ++lane)
+		{
+			memories.push_back(std::make_unique<Memory64k>());
+			Load(*memories.back(), lanes[lane]);
+			batch.Reset(lane, *memories.back());
+		}
+		for (uint64_t slice : slices)
+			batch.RunFor(slice);
+		for (size_t lane = 0; lane < kLaneCount; ++lane)
+		{
+			CoreRun& reference = *references[lane];
+			failures += Check("Batch", seed, program, model, GetState(batch, lane), *memories[lane],
+				GetState(reference.cpu, reference.mem, reference.cycles), reference.mem) ? 0 : 1;
+		}
+		return failures;
+	}
+}
+
+uint32_t FuzzExecuteCycle(uint32_t seed, uint32_t programs)
+{
+	uint32_t failures = 0;
+	std::vector<uint8_t> image;
+	for (uint32_t program = 0; program < programs; ++program)
+	{
+		std::seed_seq sequence{ seed, program };
+		std::mt19937 random(sequence);
+		Generate(random, image);
+		for (Cpu6502Model model : { Cpu6502Model::Original, Cpu6502Model::Cpu65C02 })
+			failures += CheckExecuteCycle(seed, program, model, image, random) ? 0 : 1;
+	}
+	return failures;
+}
+
+uint32_t FuzzCores(uint32_t seed, uint32_t programs)
+{
+	uint32_t failures = 0;
+	std::vector<uint8_t> image;
+	for (uint32_t program = 0; program < programs; ++program)
+	{
+		std::seed_seq sequence{ seed, program };
+		std::mt19937 random(sequence);
+		Generate(random, image);
+		for (Cpu6502Model model : { Cpu6502Model::Original, Cpu6502Model::Cpu65C02 })
+			failures += CheckCores(seed, program, model, image, random);
+	}
+	return failures;
+}
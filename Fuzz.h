@@ -0,0 +1,16 @@
+#pragma once
+
+// Random program checks between the execution paths of Cpu6502, run with `6502 --fuzz [seed] [programs]`.
+// A program is a loop of random legal instructions at $C000, branching to random instructions of the
+// loop, with random RAM below. Its stores never reach the code, so every path keeps running the same
+// instructions and must end with the same registers, memory and cycles.
+// Build with CPU6502_JIT_LOCKSTEP=1 to also check every native run of the Jit core as it goes.
+
+#include <cstdint>
+
+// Each function returns the number of runs which diverged, and prints them to stderr.
+// The per cycle path (ExecuteCycle) against RunInstructions, with an interrupt in the middle.
+uint32_t FuzzExecuteCycle(uint32_t seed, uint32_t programs);
+// Switch, BlockCache, Jit and the batch engine against FunctionTable, over the same RunFor slices.
+// The batch lanes and the cores run the program on several RAM contents.
+uint32_t FuzzCores(uint32_t seed, uint32_t programs);
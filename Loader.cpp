@@ -0,0 +1,295 @@
+#include "Loader.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	constexpr uint32_t kPageSize = Memory64k::kPageSize;
+
+	bool ReadWholeFile(const char* path, std::vector<uint8_t>& bytes)
+	{
+		FILE* file = fopen(path, "rb");
+		if (!file)
+			return false;
+		uint8_t buffer[4096];
+		size_t read;
+		while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+			bytes.insert(bytes.end(), buffer, buffer + read);
+		bool ok = !ferror(file);
+		fclose(file);
+		return ok;
+	}
+
+	int HexDigit(uint8_t c)
+	{
+		if (c >= '0' && c <= '9')
+			return c - '0';
+		if (c >= 'A' && c <= 'F')
+			return c - 'A' + 10;
+		if (c >= 'a' && c <= 'f')
+			return c - 'a' + 10;
+		return -1;
+	}
+}
+
+MappedFile::MappedFile()
+	: Data(nullptr)
+	, Size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const char* path)
+{
+	Close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	bool ok = GetFileSizeEx(file, &size) != 0;
+	if (ok && size.QuadPart > 0)
+	{
+		// The view keeps the mapping and the file alive once the handles are closed
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (mapping)
+			CloseHandle(mapping);
+		ok = view != nullptr;
+		Data = reinterpret_cast<const uint8_t*>(view);
+		Size = ok ? size_t(size.QuadPart) : 0;
+	}
+	CloseHandle(file);
+	return ok;
+#else
+	int file = open(path, O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat status;
+	bool ok = fstat(file, &status) == 0;
+	if (ok && status.st_size > 0)
+	{
+		void* view = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_SHARED, file, 0);
+		ok = view != MAP_FAILED;
+		Data = ok ? reinterpret_cast<const uint8_t*>(view) : nullptr;
+		Size = ok ? size_t(status.st_size) : 0;
+	}
+	close(file);
+	return ok;
+#endif
+}
+
+void MappedFile::Close()
+{
+	if (!Data)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(Data);
+#else
+	munmap(const_cast<uint8_t*>(Data), Size);
+#endif
+	Data = nullptr;
+	Size = 0;
+}
+
+ProgramImage::ProgramImage()
+	: File()
+	, Bytes()
+	, Segments()
+{
+}
+
+void ProgramImage::Clear()
+{
+	File.reset();
+	Bytes.reset();
+	Segments.clear();
+}
+
+bool ProgramImage::MapFile(const char* path, size_t headerSize)
+{
+	Clear();
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	if (!file->Open(path) || file->GetSize() < headerSize)
+		return false;
+	File = std::move(file);
+	return true;
+}
+
+bool ProgramImage::AddSegment(uint32_t address, const uint8_t* data, size_t size)
+{
+	if (address + size > kMemory64kSize)
+		return false;
+	if (size == 0)
+		return true;
+	// Consecutive records of a HEX file become a single segment
+	if (!Segments.empty())
+	{
+		Segment& last = Segments.back();
+		if (last.address + last.size == address && last.data + last.size == data)
+		{
+			last.size += uint32_t(size);
+			return true;
+		}
+	}
+	Segments.push_back({ uint16_t(address), data, uint32_t(size) });
+	return true;
+}
+
+bool ProgramImage::LoadRaw(const char* path, uint16_t address)
+{
+	if (!MapFile(path, 0) || !AddSegment(address, File->GetData(), File->GetSize()))
+	{
+		Clear();
+		return false;
+	}
+	return true;
+}
+
+bool ProgramImage::LoadPrg(const char* path)
+{
+	if (!MapFile(path, 2))
+	{
+		Clear();
+		return false;
+	}
+	const uint8_t* data = File->GetData();
+	if (!AddSegment(combineAddr(data[0], data[1]), data + 2, File->GetSize() - 2))
+	{
+		Clear();
+		return false;
+	}
+	return true;
+}
+
+bool ProgramImage::LoadIntelHex(const char* path)
+{
+	Clear();
+	std::vector<uint8_t> text;
+	if (!ReadWholeFile(path, text))
+		return false;
+
+	struct Record
+	{
+		uint32_t address;
+		size_t offset;
+		size_t size;
+	};
+	std::vector<Record> records;
+	std::shared_ptr<std::vector<uint8_t>> bytes = std::make_shared<std::vector<uint8_t>>();
+	uint32_t base = 0;
+	bool ended = false;
+	size_t position = 0;
+	while (!ended && position < text.size())
+	{
+		uint8_t c = text[position++];
+		if (c == '\r' || c == '\n' || c == ' ' || c == '\t')
+			continue;
+		if (c != ':')
+			return false;
+
+		// Count, address, type, data and checksum, as pairs of hex digits
+		uint8_t record[5 + 255];
+		size_t length = 0;
+		while (position + 1 < text.size() && HexDigit(text[position]) >= 0 && length < sizeof(record))
+		{
+			int low = HexDigit(text[position + 1]);
+			if (low < 0)
+				return false;
+			record[length++] = uint8_t(HexDigit(text[position]) << 4 | low);
+			position += 2;
+		}
+		if (length < 5 || length != size_t(record[0]) + 5)
+			return false;
+		uint8_t checksum = 0;
+		for (size_t i = 0; i < length; ++i)
+			checksum += record[i];
+		if (checksum != 0)
+			return false;
+
+		const uint8_t count = record[0];
+		const uint8_t* data = &record[4];
+		switch (record[3])
+		{
+		case 0x00: // Data
+			records.push_back({ base + (uint32_t(record[1]) << 8 | record[2]), bytes->size(), count });
+			bytes->insert(bytes->end(), data, data + count);
+			break;
+		case 0x01: // End of file
+			ended = true;
+			break;
+		case 0x02: // Extended segment address
+		case 0x04: // Extended linear address
+			if (count != 2)
+				return false;
+			base = (uint32_t(data[0]) << 8 | data[1]) << (record[3] == 0x02 ? 4 : 16);
+			break;
+		case 0x03: // Start addresses, the 6502 starts from its reset vector
+		case 0x05:
+			break;
+		default:
+			return false;
+		}
+	}
+	if (!ended)
+		return false; // Truncated
+
+	// The buffer doesn't move anymore
+	Bytes = std::move(bytes);
+	for (const Record& record : records)
+	{
+		if (!AddSegment(record.address, Bytes->data() + record.offset, record.size))
+		{
+			Clear();
+			return false;
+		}
+	}
+	return true;
+}
+
+void ProgramImage::MapRom(Memory64k& mem) const
+{
+	for (const Segment& segment : Segments)
+	{
+		const uint32_t start = segment.address;
+		const uint32_t end = start + segment.size;
+		const uint32_t firstPage = (start + kPageSize - 1) / kPageSize;
+		const uint32_t endPage = end / kPageSize;
+		if (firstPage < endPage)
+			mem.MapRom(firstPage, endPage - firstPage, segment.data + (firstPage * kPageSize - start));
+
+		for (uint32_t page = start / kPageSize; page * kPageSize < end; ++page)
+		{
+			if (page >= firstPage && page < endPage)
+				continue;
+			mem.MapRam(page, 1);
+			const uint32_t from = std::max(start, page * kPageSize);
+			const uint32_t to = std::min(end, (page + 1) * kPageSize);
+			for (uint32_t address = from; address < to; ++address)
+				mem[address] = segment.data[address - start];
+		}
+	}
+}
+
+void ProgramImage::CopyTo(Memory64k& mem) const
+{
+	for (const Segment& segment : Segments)
+	{
+		for (uint32_t i = 0; i < segment.size; ++i)
+			mem[segment.address + i] = segment.data[i];
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+// Program and ROM images: raw binaries, .prg files (a little endian load address then the bytes) and
+// Intel HEX. Raw and .prg files are memory mapped read-only and their whole pages are mapped as ROM
+// straight into the bus, so the machines loading the same image, in this process or any other one,
+// share a single copy through the page cache.
+
+#include "Memory.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Read-only view of a whole file
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator = (const MappedFile&) = delete;
+
+	// Return false when the file can't be accessed or mapped, an empty file maps to no data
+	bool Open(const char* path);
+	void Close();
+
+	const uint8_t* GetData() const
+	{
+		return Data;
+	}
+
+	size_t GetSize() const
+	{
+		return Size;
+	}
+
+private:
+	const uint8_t* Data;
+	size_t Size;
+};
+
+class ProgramImage
+{
+public:
+	// Bytes loaded at consecutive addresses
+	struct Segment
+	{
+		uint16_t address;
+		const uint8_t* data;
+		uint32_t size;
+	};
+
+	ProgramImage();
+
+	// Return false when the file can't be accessed, is not a valid image or doesn't fit in the 64k,
+	// the image is left empty then
+	bool LoadRaw(const char* path, uint16_t address);
+	bool LoadPrg(const char* path);
+	// Data records, with the extended addresses as long as they stay in the 64k. Decoded into a buffer
+	// owned by the image, which can still be mapped into any number of memories.
+	bool LoadIntelHex(const char* path);
+
+	void Clear();
+
+	const std::vector<Segment>& GetSegments() const
+	{
+		return Segments;
+	}
+
+	// Maps the pages fully covered by the image as ROM, without copying them. The partial pages at the
+	// ends of a segment are mapped to their own RAM and the image bytes copied into it.
+	// The image must outlive the mapping, and code decoded from these pages is not invalidated, call
+	// Cpu6502::InvalidateCode.
+	void MapRom(Memory64k& mem) const;
+
+	// Copies the image into the RAM, for programs which write over themselves
+	void CopyTo(Memory64k& mem) const;
+
+private:
+	bool MapFile(const char* path, size_t headerSize);
+	bool AddSegment(uint32_t address, const uint8_t* data, size_t size);
+
+	std::shared_ptr<MappedFile> File; // Shared by the copies of the image
+	std::shared_ptr<std::vector<uint8_t>> Bytes; // Decoded Intel HEX
+	std::vector<Segment> Segments;
+};
@@ -0,0 +1,102 @@
+#include "Mapper.h"
+
+#include <cassert>
+
+Mapper::Mapper(Memory64k& mem, const uint8_t* rom, size_t romSize, size_t ramSize)
+	: Mem(mem)
+	, Rom(rom)
+	, RomSize(romSize)
+	, Ram(ramSize, 0)
+	, Cpu(nullptr)
+	, Switches(0)
+{
+}
+
+void Mapper::MapRomBank(uint32_t window, uint32_t bankSize, uint32_t bank, BusDevice* writeDevice)
+{
+	assert(window % kPageSize == 0 && bankSize % kPageSize == 0 && window + bankSize <= kMemory64kSize);
+	const uint32_t bankCount = GetRomBankCount(bankSize);
+	assert(bankCount > 0);
+	const uint8_t* data = Rom + size_t(bank % bankCount) * bankSize;
+	if (Mem.GetReadPage(window / kPageSize) == data)
+		return;
+	Mem.MapRom(window / kPageSize, bankSize / kPageSize, data, writeDevice);
+	Switched(window, bankSize);
+}
+
+void Mapper::MapRamBank(uint32_t window, uint32_t bankSize, uint32_t bank)
+{
+	assert(window % kPageSize == 0 && bankSize % kPageSize == 0 && window + bankSize <= kMemory64kSize);
+	const uint32_t bankCount = GetRamBankCount(bankSize);
+	if (bankCount == 0)
+		return; // No RAM on the cartridge, the window keeps the Memory RAM
+	uint8_t* data = &Ram[size_t(bank % bankCount) * bankSize];
+	if (Mem.GetReadPage(window / kPageSize) == data)
+		return;
+	Mem.MapRam(window / kPageSize, bankSize / kPageSize, data);
+	Switched(window, bankSize);
+}
+
+void Mapper::Switched(uint32_t window, uint32_t size)
+{
+	++Switches;
+	if (Cpu)
+		Cpu->InvalidateCode(uint16_t(window), size);
+}
+
+UxRomMapper::UxRomMapper(Memory64k& mem, const uint8_t* rom, size_t romSize)
+	: Mapper(mem, rom, romSize, 0)
+{
+	assert(romSize >= kBankSize);
+}
+
+void UxRomMapper::Reset()
+{
+	MapRomBank(0x8000, kBankSize, 0, this);
+	MapRomBank(0xC000, kBankSize, GetRomBankCount(kBankSize) - 1, this);
+}
+
+void UxRomMapper::Write(uint16_t address, uint8_t value)
+{
+	MapRomBank(0x8000, kBankSize, value, this);
+}
+
+Paged8kMapper::Paged8kMapper(Memory64k& mem, const uint8_t* rom, size_t romSize, size_t ramSize, uint8_t registerPage)
+	: Mapper(mem, rom, romSize, ramSize)
+	, RegisterPage(registerPage)
+	, Registers()
+{
+	assert(romSize >= kBankSize);
+	assert(registerPage < 0x60); // Outside of the windows
+}
+
+void Paged8kMapper::Reset()
+{
+	Mem.MapDevice(RegisterPage, 1, *this);
+	for (uint32_t i = 0; i < kRegisterCount; ++i)
+	{
+		Registers[i] = uint8_t(i == 0 ? 0 : i - 1);
+		MapWindow(i);
+	}
+	MapRomBank(0xE000, kBankSize, GetRomBankCount(kBankSize) - 1);
+}
+
+uint8_t Paged8kMapper::Read(uint16_t address)
+{
+	return Registers[address % kRegisterCount];
+}
+
+void Paged8kMapper::Write(uint16_t address, uint8_t value)
+{
+	const uint32_t index = address % kRegisterCount;
+	Registers[index] = value;
+	MapWindow(index);
+}
+
+void Paged8kMapper::MapWindow(uint32_t index)
+{
+	if (index == 0)
+		MapRamBank(0x6000, kBankSize, Registers[0]);
+	else
+		MapRomBank(0x6000 + index * kBankSize, kBankSize, Registers[index]);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+// Cartridge mappers: ROM and RAM banks of any total size, switched into windows of the 64k address
+// space when the program writes the mapper registers. A switch only rewrites the bus page table
+// entries of the window, the banks are never copied.
+// Code decoded from a window is dropped when another bank gets mapped in, through the CPU given with
+// SetCpu. The banked RAM lives outside the Memory and is not part of its snapshots.
+
+#include "6502.h"
+#include "Bus.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Mapper : public BusDevice
+{
+public:
+	// The rom holds romSize bytes, a MappedFile of the cartridge for instance, and must outlive the mapper
+	Mapper(Memory64k& mem, const uint8_t* rom, size_t romSize, size_t ramSize);
+
+	void SetCpu(Cpu6502* cpu)
+	{
+		Cpu = cpu;
+	}
+
+	// Maps the windows and the registers in their power-on state
+	virtual void Reset() = 0;
+
+	// Register pages mapped as a device read back as open bus unless the mapper says otherwise
+	uint8_t Read(uint16_t address) override
+	{
+		return 0xFF;
+	}
+
+	// Windows which actually got another bank
+	uint64_t GetSwitchCount() const
+	{
+		return Switches;
+	}
+
+	static constexpr uint32_t kPageSize = Memory64k::kPageSize;
+
+protected:
+	// Bank numbers wrap around the bank count, like the address lines a cartridge doesn't decode
+	void MapRomBank(uint32_t window, uint32_t bankSize, uint32_t bank, BusDevice* writeDevice = nullptr);
+	void MapRamBank(uint32_t window, uint32_t bankSize, uint32_t bank);
+
+	uint32_t GetRomBankCount(uint32_t bankSize) const
+	{
+		return uint32_t(RomSize / bankSize);
+	}
+
+	uint32_t GetRamBankCount(uint32_t bankSize) const
+	{
+		return uint32_t(Ram.size() / bankSize);
+	}
+
+	Memory64k& Mem;
+
+private:
+	void Switched(uint32_t window, uint32_t size);
+
+	const uint8_t* Rom;
+	size_t RomSize;
+	std::vector<uint8_t> Ram;
+	Cpu6502* Cpu;
+	uint64_t Switches;
+};
+
+// 16k ROM banks: $8000-$BFFF switchable, $C000-$FFFF fixed to the last bank. Any write to the ROM
+// selects the bank of the switchable window, as on the NES UxROM boards.
+class UxRomMapper : public Mapper
+{
+public:
+	static constexpr uint32_t kBankSize = 16 * 1024;
+
+	UxRomMapper(Memory64k& mem, const uint8_t* rom, size_t romSize);
+
+	void Reset() override;
+	void Write(uint16_t address, uint8_t value) override;
+};
+
+// 8k banks, selected by registers at a device page:
+//   register 0: RAM bank at $6000-$7FFF
+//   registers 1-3: ROM banks at $8000, $A000 and $C000, $E000-$FFFF is fixed to the last ROM bank
+// The registers repeat every 4 bytes of their page and read back as written.
+class Paged8kMapper : public Mapper
+{
+public:
+	static constexpr uint32_t kBankSize = 8 * 1024;
+	static constexpr uint32_t kRegisterCount = 4;
+
+	Paged8kMapper(Memory64k& mem, const uint8_t* rom, size_t romSize, size_t ramSize, uint8_t registerPage = 0x5F);
+
+	void Reset() override;
+	uint8_t Read(uint16_t address) override;
+	void Write(uint16_t address, uint8_t value) override;
+
+private:
+	void MapWindow(uint32_t index);
+
+	uint8_t RegisterPage;
+	uint8_t Registers[kRegisterCount];
+};
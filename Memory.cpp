@@ -1 +1,144 @@
 #include "Memory.h"
+
+template <int SIZE>
+uint8_t Memory<SIZE>::DeviceRead(uint32_t address)
+{
+	++DeviceAccesses;
+	return Devices[address / kPageSize]->Read(uint16_t(address));
+}
+
+template <int SIZE>
+void Memory<SIZE>::DeviceWrite(uint32_t address, uint8_t value)
+{
+	if (Lazy[address / kPageSize] && WriteTargets[address / kPageSize] == &Data[address / kPageSize * kPageSize])
+		Materialize(address / kPageSize);
+	if (uint8_t* page = WriteTargets[address / kPageSize])
+	{
+		// Watched or just materialized page
+		page[address % kPageSize] = value;
+		MarkWritten(address);
+		return;
+	}
+
+	// Writes to a ROM without a write device are ignored
+	BusDevice* device = Devices[address / kPageSize];
+	if (!device)
+		return;
+	++DeviceAccesses;
+	device->Write(uint16_t(address), value);
+}
+
+template <int SIZE>
+void Memory<SIZE>::Materialize(uint32_t index, bool clear)
+{
+	if (clear)
+		memset(&Data[index * kPageSize], 0, kPageSize);
+	Lazy[index] = 0;
+	Materialized.push_back(index);
+	UpdatePage(index);
+}
+
+template <int SIZE>
+void Memory<SIZE>::SetSparse(bool sparse)
+{
+	Sparse = sparse;
+	Materialized.clear();
+	if (sparse)
+	{
+		for (uint32_t page = 0; page < kPageCount; ++page)
+		{
+			Lazy[page] = 1;
+			UpdatePage(page);
+		}
+		MarkAllWritten();
+	}
+	else
+	{
+		for (uint32_t page = 0; page < kPageCount; ++page)
+		{
+			Lazy[page] = 0;
+			UpdatePage(page);
+		}
+		Reset();
+	}
+}
+
+template <int SIZE>
+std::bitset<Memory<SIZE>::kPageCount> Memory<SIZE>::FetchDirtyPages()
+{
+	std::bitset<kPageCount> pages;
+	for (uint32_t page = 0; page < kPageCount; ++page)
+	{
+		// Most pages are clean, only the dirty ones pay for the exchange
+		if ((Dirty[page].load(std::memory_order_relaxed) & kFetchDirty)
+			&& (Dirty[page].fetch_and(uint8_t(~kFetchDirty), std::memory_order_acquire) & kFetchDirty))
+			pages.set(page);
+	}
+	return pages;
+}
+
+template <int SIZE>
+void Memory<SIZE>::Watch(uint32_t address, uint32_t size)
+{
+	assert(address + size <= SIZE);
+	if (!Watches)
+	{
+		Watches = std::make_unique<WriteWatch>();
+		for (uint32_t i = 0; i < SIZE / 64; ++i)
+		{
+			Watches->mask[i] = 0;
+			Watches->hits[i].store(0, std::memory_order_relaxed);
+		}
+	}
+	for (uint32_t i = address; i < address + size; ++i)
+		Watches->mask[i / 64] |= uint64_t(1) << (i % 64);
+	for (uint32_t page = address / kPageSize; page * kPageSize < address + size; ++page)
+		UpdatePage(page);
+}
+
+template <int SIZE>
+void Memory<SIZE>::Unwatch(uint32_t address, uint32_t size)
+{
+	assert(address + size <= SIZE);
+	if (!Watches)
+		return;
+	for (uint32_t i = address; i < address + size; ++i)
+		Watches->mask[i / 64] &= ~(uint64_t(1) << (i % 64));
+	for (uint32_t page = address / kPageSize; page * kPageSize < address + size; ++page)
+		UpdatePage(page);
+}
+
+template <int SIZE>
+bool Memory<SIZE>::IsWatchedPage(uint32_t index) const
+{
+	if (!Watches)
+		return false;
+	constexpr uint32_t kWordsPerPage = kPageSize / 64;
+	for (uint32_t i = 0; i < kWordsPerPage; ++i)
+	{
+		if (Watches->mask[index * kWordsPerPage + i])
+			return true;
+	}
+	return false;
+}
+
+template <int SIZE>
+void Memory<SIZE>::FetchWatchHits(std::vector<uint32_t>& addresses)
+{
+	if (!Watches)
+		return;
+	for (uint32_t i = 0; i < SIZE / 64; ++i)
+	{
+		if (!Watches->hits[i].load(std::memory_order_relaxed))
+			continue;
+		for (uint64_t hits = Watches->hits[i].exchange(0, std::memory_order_acquire); hits; hits &= hits - 1)
+		{
+			uint32_t bit = 0;
+			while (!(hits >> bit & 1))
+				++bit;
+			addresses.push_back(i * 64 + bit);
+		}
+	}
+}
+
+template class Memory<kMemory64kSize>;
@@ -1,36 +1,438 @@
 #pragma once
+#include "Bus.h"
+
+#include <atomic>
+#include <bitset>
 #include <cassert>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
 
+// The bus accesses are inlined in the huge interpreter loops, where the compiler stops inlining by itself
+#if defined(_MSC_VER)
+#define MEMORY_FORCE_INLINE __forceinline
+#else
+#define MEMORY_FORCE_INLINE inline __attribute__((always_inline))
+#endif
 
+// Flat memory, with copy-on-write snapshots of its 256 bytes pages.
+// Writes through operator[] mark their page dirty, a snapshot only copies the pages dirtied since
+// the previous snapshot or restore and shares the others with it, a restore only copies the dirty
+// pages and the pages which differ between the two snapshots.
+// The CPU sees it through a bus: a page table mapping each page either to host memory, this RAM by
+// default or ROM whose writes are ignored, or to a device. Snapshots only hold the RAM.
+// The users mirroring the memory find what changed with FetchDirtyPages, and the writes to chosen
+// addresses with Watch and FetchWatchHits.
+// In sparse mode the RAM pages are only cleared on their first write, see SetSparse.
 template <int SIZE>
 class Memory
 {
+public:
+	static constexpr uint32_t kPageSize = 256;
+	static constexpr uint32_t kPageCount = SIZE / kPageSize;
+	static constexpr uint32_t kPagesPerChunk = 16;
+	static constexpr uint32_t kChunkCount = kPageCount / kPagesPerChunk;
+	static_assert(SIZE % (kPageSize * kPagesPerChunk) == 0, "Memory size must be a multiple of 4k");
+
+private:
+	struct Page
+	{
+		uint8_t bytes[kPageSize];
+	};
+
+	// Snapshots share the pages and the chunks of pages they have in common, none is modified once created
+	struct Chunk
+	{
+		std::shared_ptr<const Page> pages[kPagesPerChunk];
+	};
+
+public:
+	// Immutable copy of the whole memory, cheap to copy and to keep around
+	class Snapshot
+	{
+	private:
+		friend class Memory;
+		std::shared_ptr<const Chunk> Chunks[kChunkCount];
+	};
+
 private:
 	uint8_t* Data;
 
+	// One dirty marker per page, set by the writes with a single store. kSnapshotDirty, page modified since
+	// Base, is cleared by the snapshots and restores. kFetchDirty, page written since the last
+	// FetchDirtyPages, is cleared by it, maybe from another thread.
+	static constexpr uint8_t kSnapshotDirty = 1;
+	static constexpr uint8_t kFetchDirty = 2;
+	std::atomic<uint8_t> Dirty[kPageCount];
+	Snapshot Base; // Last snapshot taken or restored, empty at first
+
+	// Page table, split so the RAM and ROM accesses only touch one array
+	const uint8_t* ReadPages[kPageCount]; // Host memory of the page, nullptr for a device
+	uint8_t* WritePages[kPageCount]; // nullptr for a device, a ROM, a watched page or a sparse page not written yet
+	// Mapping of the pages, the page table entries follow from them, see UpdatePage
+	const uint8_t* ReadTargets[kPageCount];
+	uint8_t* WriteTargets[kPageCount];
+	BusDevice* Devices[kPageCount]; // Also gets the writes to a ROM page when set
+	uint8_t Remapped[kPageCount]; // Page table entries not on the own RAM of the page
+	uint32_t RemappedPages;
+	uint64_t MappingGeneration; // 0 once ReadPages changed, until GetMappingGeneration draws a new one
+	static inline std::atomic<uint64_t> MappingGenerations{ 0 }; // Shared by all the memories
+	uint64_t DeviceAccesses;
+
+	// Sparse mode
+	static constexpr uint8_t kZeroPage[kPageSize] = {};
+	bool Sparse;
+	uint8_t Lazy[kPageCount]; // RAM page reading as zeros, its host memory is only cleared by the first write
+	std::vector<uint32_t> Materialized; // Pages written since the last Reset
+
+	struct WriteWatch
+	{
+		uint64_t mask[SIZE / 64]; // One bit per watched address
+		std::atomic<uint64_t> hits[SIZE / 64]; // Watched addresses written since the last FetchWatchHits
+	};
+	std::unique_ptr<WriteWatch> Watches; // Allocated by the first Watch
+	bool OwnsData;
+
+	Memory(uint8_t* data, bool ownsData)
+		: Data(data)
+		, Remapped()
+		, RemappedPages(0)
+		, MappingGeneration(0)
+		, DeviceAccesses(0)
+		, Sparse(false)
+		, Lazy()
+		, OwnsData(ownsData)
+	{
+		if (!Data)
+			throw std::bad_alloc();
+		MarkAllWritten();
+		for (uint32_t i = 0; i < kPageCount; ++i)
+		{
+			ReadPages[i] = ReadTargets[i] = WritePages[i] = WriteTargets[i] = &Data[i * kPageSize];
+			Devices[i] = nullptr;
+		}
+	}
+
 public:
 	Memory()
+		: Memory(reinterpret_cast<uint8_t*>(malloc(SIZE)), true)
 	{
-		Data = reinterpret_cast<uint8_t*>(malloc(SIZE));
 	}
 
+	// RAM provided by the caller, SIZE bytes which must outlive the memory, see MemoryPool
+	explicit Memory(uint8_t* data)
+		: Memory(data, false)
+	{
+	}
+
+	Memory(const Memory&) = delete;
+	Memory& operator = (const Memory&) = delete;
+
 	~Memory()
 	{
-		free(Data);
+		if (OwnsData)
+			free(Data);
 	}
 
 	void Reset()
 	{
+		if (Sparse)
+		{
+			// Only the pages written since the previous reset go back to the zero page
+			for (uint32_t page : Materialized)
+			{
+				Lazy[page] = 1;
+				MarkDirty(page);
+				UpdatePage(page);
+			}
+			Materialized.clear();
+			return;
+		}
 		memset(Data, 0, SIZE);
+		MarkAllWritten();
+	}
+
+	// In sparse mode the RAM pages read as zeros, from a shared zero page, until their first write
+	// clears their host memory, and Reset costs as many pages as the program wrote instead of the whole
+	// memory. The untouched host pages of a MemoryPool memory are never even committed.
+	// The lazy pages are mapped to the zero page: the Jit keeps the code reading them in the interpreter,
+	// and the batch engine reads them through the bus, until the program wrote them.
+	// Switching the mode resets the memory.
+	void SetSparse(bool sparse);
+
+	bool IsSparse() const
+	{
+		return Sparse;
 	}
 
+	// Direct access to the RAM, regardless of the mapping. Any access through operator[] may be a write,
+	// reads from the hot paths use Read.
 	uint8_t& operator [] (uint32_t index)
 	{
 		assert(index < SIZE);
+		if (Lazy[index / kPageSize])
+			Materialize(index / kPageSize);
+		MarkDirty(index / kPageSize);
 		return Data[index];
 	}
+
+	uint8_t Read(uint32_t index) const
+	{
+		assert(index < SIZE);
+		return Lazy[index / kPageSize] ? 0 : Data[index];
+	}
+
+	// Direct access for the code generated by the Jit and the batch engine, for the pages reading their own
+	// RAM. Writes done through this pointer must be signaled with MarkWritten.
+	uint8_t* GetData()
+	{
+		return Data;
+	}
+
+	void MarkWritten(uint32_t index)
+	{
+		MarkDirty(index / kPageSize);
+		if (Watches && (Watches->mask[index / 64] >> (index % 64) & 1))
+			Watches->hits[index / 64].fetch_or(uint64_t(1) << (index % 64), std::memory_order_relaxed);
+	}
+
+	void MarkAllWritten()
+	{
+		for (uint32_t page = 0; page < kPageCount; ++page)
+			MarkDirty(page);
+	}
+
+	uint32_t DirtyPageCount() const
+	{
+		uint32_t count = 0;
+		for (uint32_t page = 0; page < kPageCount; ++page)
+			count += IsSnapshotDirty(page);
+		return count;
+	}
+
+	// Copies the pages dirtied since the last snapshot or restore, shares the others with it
+	Snapshot TakeSnapshot()
+	{
+		for (uint32_t chunk = 0; chunk < kChunkCount; ++chunk)
+		{
+			if (Base.Chunks[chunk] && !IsChunkSnapshotDirty(chunk))
+				continue;
+
+			std::shared_ptr<Chunk> copy = Base.Chunks[chunk] ? std::make_shared<Chunk>(*Base.Chunks[chunk]) : std::make_shared<Chunk>();
+			for (uint32_t i = 0; i < kPagesPerChunk; ++i)
+			{
+				const uint32_t index = chunk * kPagesPerChunk + i;
+				if (!IsSnapshotDirty(index) && copy->pages[i])
+					continue;
+				std::shared_ptr<Page> page = std::make_shared<Page>();
+				memcpy(page->bytes, Lazy[index] ? kZeroPage : &Data[index * kPageSize], kPageSize);
+				copy->pages[i] = std::move(page);
+			}
+			Base.Chunks[chunk] = std::move(copy);
+		}
+		ClearSnapshotDirty();
+		return Base;
+	}
+
+	// Bring the memory back to the snapshot content, taken from this memory or any other one.
+	// onPageRestored(address) is called for each page whose content was copied.
+	template <class ON_PAGE_RESTORED>
+	void Restore(const Snapshot& snapshot, ON_PAGE_RESTORED onPageRestored)
+	{
+		for (uint32_t chunk = 0; chunk < kChunkCount; ++chunk)
+		{
+			const Chunk* target = snapshot.Chunks[chunk].get();
+			const Chunk* current = Base.Chunks[chunk].get();
+			assert(target); // Snapshots are always complete
+			if (target == current && !IsChunkSnapshotDirty(chunk))
+				continue;
+
+			for (uint32_t i = 0; i < kPagesPerChunk; ++i)
+			{
+				if (!IsSnapshotDirty(chunk * kPagesPerChunk + i) && current && current->pages[i] == target->pages[i])
+					continue;
+				uint32_t address = (chunk * kPagesPerChunk + i) * kPageSize;
+				memcpy(&Data[address], target->pages[i]->bytes, kPageSize);
+				// Same content as Base, but changed for the users of FetchDirtyPages
+				Dirty[address / kPageSize].store(kFetchDirty, std::memory_order_relaxed);
+				if (Lazy[address / kPageSize])
+					Materialize(address / kPageSize, false);
+				onPageRestored(address);
+			}
+		}
+		Base = snapshot;
+		ClearSnapshotDirty();
+	}
+
+	void Restore(const Snapshot& snapshot)
+	{
+		Restore(snapshot, [](uint32_t) {});
+	}
+
+	// CPU accesses, RAM and ROM are a page table lookup and a load
+	MEMORY_FORCE_INLINE uint8_t BusRead(uint32_t address)
+	{
+		assert(address < SIZE);
+		if (const uint8_t* page = ReadPages[address / kPageSize])
+			return page[address % kPageSize];
+		return DeviceRead(address);
+	}
+
+	MEMORY_FORCE_INLINE void BusWrite(uint32_t address, uint8_t value)
+	{
+		assert(address < SIZE);
+		uint8_t* page = WritePages[address / kPageSize];
+		if (page)
+		{
+			page[address % kPageSize] = value;
+			MarkDirty(address / kPageSize);
+		}
+		else
+		{
+			DeviceWrite(address, value);
+		}
+	}
+
+	// Pages of host memory, data holds pageCount * kPageSize bytes. Without data the pages map their own RAM.
+	// Code decoded from remapped pages is not invalidated, call Cpu6502::InvalidateCode.
+	void MapRam(uint32_t firstPage, uint32_t pageCount, uint8_t* data = nullptr)
+	{
+		for (uint32_t i = 0; i < pageCount; ++i)
+		{
+			uint8_t* page = data ? data + i * kPageSize : &Data[(firstPage + i) * kPageSize];
+			SetPage(firstPage + i, page, page, nullptr);
+		}
+	}
+
+	// Writes to the ROM pages are ignored, or given to writeDevice, like the registers of a cartridge mapper
+	void MapRom(uint32_t firstPage, uint32_t pageCount, const uint8_t* data, BusDevice* writeDevice = nullptr)
+	{
+		for (uint32_t i = 0; i < pageCount; ++i)
+			SetPage(firstPage + i, data + i * kPageSize, nullptr, writeDevice);
+	}
+
+	void MapDevice(uint32_t firstPage, uint32_t pageCount, BusDevice& device)
+	{
+		for (uint32_t i = 0; i < pageCount; ++i)
+			SetPage(firstPage + i, nullptr, nullptr, &device);
+	}
+
+	// Host memory currently read for the page, nullptr for a device
+	const uint8_t* GetReadPage(uint32_t page) const
+	{
+		assert(page < kPageCount);
+		return ReadPages[page];
+	}
+
+	// All the pages map their own RAM, the bus is the flat memory
+	bool IsFlat() const
+	{
+		return RemappedPages == 0;
+	}
+
+	// The bus reads of the page come from its own RAM, GetData can be read directly
+	bool ReadsOwnRam(uint32_t page) const
+	{
+		assert(page < kPageCount);
+		return ReadPages[page] == &Data[page * kPageSize];
+	}
+
+	// Identifies the host memory every page is read from, unique across all the memories. Changes when a
+	// page gets mapped to other host memory or a device, so users of GetReadPage or ReadsOwnRam only
+	// check the pages again when it changed.
+	uint64_t GetMappingGeneration()
+	{
+		if (MappingGeneration == 0)
+			MappingGeneration = MappingGenerations.fetch_add(1, std::memory_order_relaxed) + 1;
+		return MappingGeneration;
+	}
+
+	// Reads and writes handled by devices, they may have side effects
+	uint64_t GetDeviceAccesses() const
+	{
+		return DeviceAccesses;
+	}
+
+	// Pages written since the previous fetch, through the bus, operator[] or MarkWritten, or restored.
+	// They are cleared as they are returned, one by one, so this can run on another thread while the
+	// CPU runs: a page written during or after the fetch is reported again by the next one.
+	std::bitset<kPageCount> FetchDirtyPages();
+
+	// Records the writes to the addresses, in the pages mapped to host memory. The writes to the pages
+	// holding a watched address leave the inlined bus path, the other pages don't pay anything.
+	void Watch(uint32_t address, uint32_t size);
+	void Unwatch(uint32_t address, uint32_t size);
+
+	// Appends the watched addresses written since the previous fetch in increasing order, and clears
+	// them. Can run on another thread like FetchDirtyPages.
+	void FetchWatchHits(std::vector<uint32_t>& addresses);
+
+private:
+	// Out of line in Memory.cpp so BusRead/BusWrite stay small enough for the handlers to be inlined
+	uint8_t DeviceRead(uint32_t address);
+	void DeviceWrite(uint32_t address, uint8_t value);
+
+	void SetPage(uint32_t index, const uint8_t* read, uint8_t* write, BusDevice* device)
+	{
+		assert(index < kPageCount);
+		ReadTargets[index] = read;
+		WriteTargets[index] = write;
+		Devices[index] = device;
+		UpdatePage(index);
+	}
+
+	// The writes to a watched page and the first write to a sparse page go through DeviceWrite
+	void UpdatePage(uint32_t index)
+	{
+		const uint8_t* own = &Data[index * kPageSize];
+		const bool lazy = Lazy[index] && WriteTargets[index] == own;
+		const uint8_t* read = lazy ? kZeroPage : ReadTargets[index];
+		if (ReadPages[index] != read)
+			MappingGeneration = 0;
+		ReadPages[index] = read;
+		WritePages[index] = lazy || IsWatchedPage(index) ? nullptr : WriteTargets[index];
+		RemappedPages -= Remapped[index];
+		Remapped[index] = ReadPages[index] != own || WriteTargets[index] != own;
+		RemappedPages += Remapped[index];
+	}
+
+	bool IsWatchedPage(uint32_t index) const;
+
+	// Relaxed stores and loads, plain moves on the hosts we build for
+	MEMORY_FORCE_INLINE void MarkDirty(uint32_t page)
+	{
+		Dirty[page].store(kSnapshotDirty | kFetchDirty, std::memory_order_relaxed);
+	}
+
+	bool IsSnapshotDirty(uint32_t page) const
+	{
+		return Dirty[page].load(std::memory_order_relaxed) & kSnapshotDirty;
+	}
+
+	bool IsChunkSnapshotDirty(uint32_t chunk) const
+	{
+		for (uint32_t i = 0; i < kPagesPerChunk; ++i)
+		{
+			if (IsSnapshotDirty(chunk * kPagesPerChunk + i))
+				return true;
+		}
+		return false;
+	}
+
+	// FetchDirtyPages may clear kFetchDirty at the same time, the dirty pages clear their bit with an atomic AND
+	void ClearSnapshotDirty()
+	{
+		for (uint32_t page = 0; page < kPageCount; ++page)
+		{
+			if (IsSnapshotDirty(page))
+				Dirty[page].fetch_and(uint8_t(~kSnapshotDirty), std::memory_order_relaxed);
+		}
+	}
+	// Clears the host memory of a lazy page and maps it back
+	void Materialize(uint32_t index, bool clear = true);
 };
 
 constexpr uint16_t combineAddr(uint8_t a, uint8_t b)
@@ -0,0 +1,158 @@
+#include "MemoryPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	size_t RoundUp(size_t size, size_t alignment)
+	{
+		return (size + alignment - 1) / alignment * alignment;
+	}
+
+	size_t GetHostPageSize()
+	{
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwPageSize;
+#else
+		return size_t(sysconf(_SC_PAGESIZE));
+#endif
+	}
+}
+
+MemoryArena::MemoryArena(size_t arenaSize)
+	: ArenaSize(RoundUp(std::max<size_t>(arenaSize, 1), kHugePageSize))
+	, Arenas()
+	, ReadOnly()
+	, Next(nullptr)
+	, End(nullptr)
+{
+}
+
+MemoryArena::~MemoryArena()
+{
+	for (const Mapping& mapping : Arenas)
+		Unmap(mapping);
+	for (const Mapping& mapping : ReadOnly)
+		Unmap(mapping);
+}
+
+MemoryArena::Mapping MemoryArena::Map(size_t size)
+{
+#ifdef _WIN32
+	// Large pages need the SeLockMemoryPrivilege, without it the allocation fails and normal pages are used
+	const size_t largePageSize = GetLargePageMinimum();
+	if (largePageSize != 0 && size % largePageSize == 0)
+	{
+		if (void* base = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE))
+			return { reinterpret_cast<uint8_t*>(base), size, true };
+	}
+	void* base = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (!base)
+		throw std::bad_alloc();
+	return { reinterpret_cast<uint8_t*>(base), size, false };
+#else
+#ifdef MAP_HUGETLB
+	// Only succeeds when the administrator reserved huge pages
+	void* huge = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (huge != MAP_FAILED)
+		return { reinterpret_cast<uint8_t*>(huge), size, true };
+#endif
+	// Otherwise huge page aligned, so that transparent huge pages can back it
+	void* raw = mmap(nullptr, size + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED)
+		throw std::bad_alloc();
+	uint8_t* start = reinterpret_cast<uint8_t*>(raw);
+	uint8_t* base = reinterpret_cast<uint8_t*>(RoundUp(reinterpret_cast<uintptr_t>(start), kHugePageSize));
+	if (base != start)
+		munmap(start, size_t(base - start));
+	if (base + size != start + size + kHugePageSize)
+		munmap(base + size, size_t(start + kHugePageSize - base));
+	bool hugePages = false;
+#ifdef MADV_HUGEPAGE
+	hugePages = madvise(base, size, MADV_HUGEPAGE) == 0;
+#endif
+	return { base, size, hugePages };
+#endif
+}
+
+void MemoryArena::Unmap(const Mapping& mapping)
+{
+#ifdef _WIN32
+	VirtualFree(mapping.base, 0, MEM_RELEASE);
+#else
+	munmap(mapping.base, mapping.size);
+#endif
+}
+
+void* MemoryArena::Allocate(size_t size, size_t alignment)
+{
+	assert(alignment != 0 && (alignment & (alignment - 1)) == 0 && alignment <= kHugePageSize);
+	std::lock_guard<std::mutex> lock(Lock);
+	uint8_t* start = Next ? reinterpret_cast<uint8_t*>(RoundUp(reinterpret_cast<uintptr_t>(Next), alignment)) : nullptr;
+	if (!start || start > End || size_t(End - start) < size)
+	{
+		// The rest of the last arena is lost, arenas are large compared to the allocations
+		Mapping arena = Map(std::max(ArenaSize, RoundUp(size, kHugePageSize)));
+		Arenas.push_back(arena);
+		start = arena.base;
+		End = arena.base + arena.size;
+	}
+	Next = start + size;
+	return start;
+}
+
+const uint8_t* MemoryArena::AllocateReadOnly(const uint8_t* data, size_t size)
+{
+	const size_t mappingSize = RoundUp(std::max<size_t>(RoundUp(size, Memory64k::kPageSize), 1), GetHostPageSize());
+	uint8_t* base;
+#ifdef _WIN32
+	base = reinterpret_cast<uint8_t*>(VirtualAlloc(nullptr, mappingSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+	if (!base)
+		throw std::bad_alloc();
+	if (size)
+		memcpy(base, data, size);
+	DWORD previous;
+	VirtualProtect(base, mappingSize, PAGE_READONLY, &previous);
+#else
+	void* mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED)
+		throw std::bad_alloc();
+	base = reinterpret_cast<uint8_t*>(mapping);
+	if (size)
+		memcpy(base, data, size);
+	mprotect(base, mappingSize, PROT_READ);
+#endif
+	// The padding is already zero, fresh mappings are
+	std::lock_guard<std::mutex> lock(Lock);
+	ReadOnly.push_back({ base, mappingSize, false });
+	return base;
+}
+
+size_t MemoryArena::GetReservedSize() const
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	size_t size = 0;
+	for (const Mapping& mapping : Arenas)
+		size += mapping.size;
+	for (const Mapping& mapping : ReadOnly)
+		size += mapping.size;
+	return size;
+}
+
+size_t MemoryArena::GetHugePageArenaCount() const
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	return size_t(std::count_if(Arenas.begin(), Arenas.end(), [](const Mapping& mapping) { return mapping.hugePages; }));
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+// Memories for hosts running thousands of machines. Instead of a malloc each, they are carved out of
+// large arenas backed by huge pages when the system provides them, which keeps the TLB misses down,
+// and the ROMs all the machines map are stored once, read-only, and shared by every instance.
+
+#include "Memory.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Bump allocator over arenas of host memory, released all together with the arena
+class MemoryArena
+{
+public:
+	static constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+	static constexpr size_t kDefaultArenaSize = 16 * kHugePageSize;
+
+	// arenaSize is rounded up to whole huge pages
+	explicit MemoryArena(size_t arenaSize = kDefaultArenaSize);
+	~MemoryArena();
+
+	MemoryArena(const MemoryArena&) = delete;
+	MemoryArena& operator = (const MemoryArena&) = delete;
+
+	// Alignment is a power of two up to kHugePageSize. Throws std::bad_alloc when the system is out of memory.
+	void* Allocate(size_t size, size_t alignment);
+
+	// Read-only copy of the data, in its own mapping whose pages are protected once filled.
+	// The size is rounded up to 256 bytes pages filled with zeros, for Memory::MapRom.
+	const uint8_t* AllocateReadOnly(const uint8_t* data, size_t size);
+
+	size_t GetReservedSize() const;
+	// Arenas the system gave huge pages for, explicitly or transparently
+	size_t GetHugePageArenaCount() const;
+
+private:
+	struct Mapping
+	{
+		uint8_t* base;
+		size_t size;
+		bool hugePages;
+	};
+
+	static Mapping Map(size_t size);
+	static void Unmap(const Mapping& mapping);
+
+	size_t ArenaSize;
+	std::vector<Mapping> Arenas;
+	std::vector<Mapping> ReadOnly;
+	uint8_t* Next; // Free space of the last arena
+	uint8_t* End;
+	mutable std::mutex Lock;
+};
+
+// Memories carved out of an arena, each one a single slot holding the object and then its RAM aligned
+// on a host page. Released memories go to a free list and get reused by the next Create.
+template <int SIZE>
+class MemoryPool
+{
+public:
+	class Deleter
+	{
+	public:
+		Deleter(MemoryPool* pool = nullptr)
+			: Pool(pool)
+		{
+		}
+
+		void operator () (Memory<SIZE>* mem) const
+		{
+			Pool->Release(mem);
+		}
+
+	private:
+		MemoryPool* Pool;
+	};
+
+	// The pool must outlive its memories
+	using Handle = std::unique_ptr<Memory<SIZE>, Deleter>;
+
+	explicit MemoryPool(size_t arenaSize = MemoryArena::kDefaultArenaSize)
+		: Arena(arenaSize)
+	{
+	}
+
+	// Like a new Memory, the RAM content is undefined until Reset
+	Handle Create()
+	{
+		void* slot = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(FreeLock);
+			if (!FreeSlots.empty())
+			{
+				slot = FreeSlots.back();
+				FreeSlots.pop_back();
+			}
+		}
+		if (!slot)
+			slot = Arena.Allocate(kSlotSize, kHostPageSize);
+		uint8_t* data = reinterpret_cast<uint8_t*>(slot) + kObjectSize;
+		return Handle(new (slot) Memory<SIZE>(data), Deleter(this));
+	}
+
+	// One read-only copy of a ROM for all the memories, to map with Memory::MapRom. Lives as long as the pool.
+	const uint8_t* AddRom(const uint8_t* data, size_t size)
+	{
+		return Arena.AllocateReadOnly(data, size);
+	}
+
+	const MemoryArena& GetArena() const
+	{
+		return Arena;
+	}
+
+private:
+	static constexpr size_t kHostPageSize = 4096;
+	static constexpr size_t kObjectSize = (sizeof(Memory<SIZE>) + kHostPageSize - 1) / kHostPageSize * kHostPageSize;
+	static constexpr size_t kSlotSize = kObjectSize + SIZE;
+	static_assert(alignof(Memory<SIZE>) <= kHostPageSize, "Memory must fit the slot alignment");
+
+	void Release(Memory<SIZE>* mem)
+	{
+		mem->~Memory<SIZE>();
+		std::lock_guard<std::mutex> lock(FreeLock);
+		FreeSlots.push_back(mem);
+	}
+
+	MemoryArena Arena;
+	std::vector<void*> FreeSlots;
+	std::mutex FreeLock;
+};
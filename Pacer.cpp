@@ -0,0 +1,119 @@
+#include "Pacer.h"
+
+#include <algorithm>
+#include <thread>
+
+LatencyHistogram::LatencyHistogram()
+	: Total(0)
+	, Max(0)
+{
+	for (std::atomic<uint64_t>& bucket : Buckets)
+		bucket.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Add(std::chrono::nanoseconds duration)
+{
+	const uint64_t ns = uint64_t(std::max<int64_t>(0, duration.count()));
+	uint32_t bucket = 0;
+	for (uint64_t value = ns; value != 0 && bucket < kBucketCount - 1; value >>= 1)
+		++bucket;
+	// Single writer, plain read-modify-write sequences are enough
+	Buckets[bucket].store(Buckets[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	Total.store(Total.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+	if (int64_t(ns) > Max.load(std::memory_order_relaxed))
+		Max.store(int64_t(ns), std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Clear()
+{
+	for (std::atomic<uint64_t>& bucket : Buckets)
+		bucket.store(0, std::memory_order_relaxed);
+	Total.store(0, std::memory_order_relaxed);
+	Max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetCount() const
+{
+	uint64_t count = 0;
+	for (const std::atomic<uint64_t>& bucket : Buckets)
+		count += bucket.load(std::memory_order_relaxed);
+	return count;
+}
+
+std::chrono::nanoseconds LatencyHistogram::GetPercentile(double percentile) const
+{
+	const uint64_t count = GetCount();
+	if (count == 0)
+		return std::chrono::nanoseconds(0);
+	const uint64_t rank = std::max<uint64_t>(1, uint64_t(count * percentile / 100.0 + 0.5));
+	uint64_t seen = 0;
+	for (uint32_t bucket = 0; bucket < kBucketCount; ++bucket)
+	{
+		seen += Buckets[bucket].load(std::memory_order_relaxed);
+		if (seen >= rank)
+			return GetBucketLimit(bucket);
+	}
+	return GetBucketLimit(kBucketCount - 1);
+}
+
+std::chrono::nanoseconds LatencyHistogram::GetMean() const
+{
+	const uint64_t count = GetCount();
+	return std::chrono::nanoseconds(count ? int64_t(Total.load(std::memory_order_relaxed) / count) : 0);
+}
+
+Pacer::Pacer()
+	: Overshoot()
+	, Undershoot()
+	, SpinThreshold(std::chrono::nanoseconds(std::chrono::microseconds(200)).count())
+	, MaxSpin(std::chrono::nanoseconds(kDefaultMaxSpin).count())
+	, OversleepMean(std::chrono::nanoseconds(std::chrono::microseconds(100)).count())
+	, OversleepDeviation(std::chrono::nanoseconds(std::chrono::microseconds(25)).count())
+{
+}
+
+void Pacer::WaitUntil(std::chrono::time_point<clock_type> deadline)
+{
+	const std::chrono::nanoseconds threshold(SpinThreshold.load(std::memory_order_relaxed));
+	std::chrono::time_point<clock_type> now = clock_type::now();
+	if (deadline - now > threshold)
+	{
+		const std::chrono::time_point<clock_type> wake = deadline - threshold;
+		std::this_thread::sleep_until(wake);
+		now = clock_type::now();
+		Calibrate(now - wake);
+		if (now < deadline)
+			Undershoot.Add(deadline - now);
+	}
+
+	while (now < deadline)
+		now = clock_type::now();
+	Overshoot.Add(now - deadline);
+}
+
+void Pacer::Calibrate(std::chrono::nanoseconds oversleep)
+{
+	// Moving averages over about 16 sleeps, the deviation as the mean absolute difference
+	const int64_t sample = oversleep.count();
+	const int64_t difference = sample - OversleepMean;
+	OversleepMean += difference / 16;
+	OversleepDeviation += ((difference < 0 ? -difference : difference) - OversleepDeviation) / 16;
+
+	const int64_t minSpin = std::min<int64_t>(MaxSpin, std::chrono::nanoseconds(kMinSpin).count());
+	int64_t threshold = OversleepMean + 4 * OversleepDeviation;
+	// A long oversleep raises the threshold at once, at most doubling it, the averages bring it back down
+	threshold = std::max(threshold, std::min(sample, 2 * SpinThreshold.load(std::memory_order_relaxed)));
+	SpinThreshold.store(std::clamp(threshold, minSpin, MaxSpin), std::memory_order_relaxed);
+}
+
+void Pacer::SetMaxSpin(std::chrono::nanoseconds duration)
+{
+	MaxSpin = std::max<int64_t>(0, duration.count());
+	SpinThreshold.store(std::min(SpinThreshold.load(std::memory_order_relaxed), MaxSpin), std::memory_order_relaxed);
+}
+
+void Pacer::ClearStatistics()
+{
+	Overshoot.Clear();
+	Undershoot.Clear();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Counts of durations in power of two nanosecond buckets, bucket i holds [2^(i-1), 2^i[ and bucket 0 holds 0.
+// Written by the pacing thread and readable from any other one while it runs.
+class LatencyHistogram
+{
+public:
+	static constexpr uint32_t kBucketCount = 40; // Up to 9 minutes
+
+	LatencyHistogram();
+
+	void Add(std::chrono::nanoseconds duration);
+	void Clear();
+
+	uint64_t GetCount() const;
+	uint64_t GetBucketCount(uint32_t bucket) const
+	{
+		return Buckets[bucket].load(std::memory_order_relaxed);
+	}
+
+	// Upper bound of the bucket
+	static std::chrono::nanoseconds GetBucketLimit(uint32_t bucket)
+	{
+		return std::chrono::nanoseconds(bucket == 0 ? 0 : int64_t(1) << bucket);
+	}
+
+	// Upper bound of the bucket holding the percentile, 0 to 100
+	std::chrono::nanoseconds GetPercentile(double percentile) const;
+	std::chrono::nanoseconds GetMax() const
+	{
+		return std::chrono::nanoseconds(Max.load(std::memory_order_relaxed));
+	}
+	std::chrono::nanoseconds GetMean() const;
+
+private:
+	std::atomic<uint64_t> Buckets[kBucketCount];
+	std::atomic<uint64_t> Total; // Sum of the durations in ns
+	std::atomic<int64_t> Max;
+};
+
+// Waits for a deadline with a coarse sleep ending shortly before it, then spins on steady_clock until it.
+// The spin threshold follows the measured lateness of the sleeps: mean plus four deviations, so the spin
+// covers nearly all the oversleeps of the host without burning more time than needed.
+class Pacer
+{
+	using clock_type = std::chrono::steady_clock;
+public:
+	Pacer();
+
+	void WaitUntil(std::chrono::time_point<clock_type> deadline);
+
+	// Lateness of the wake up after a wait
+	const LatencyHistogram& GetOvershoot() const
+	{
+		return Overshoot;
+	}
+
+	// How early the coarse sleeps woke up before the deadline, the time left to spin
+	const LatencyHistogram& GetUndershoot() const
+	{
+		return Undershoot;
+	}
+
+	std::chrono::nanoseconds GetSpinThreshold() const
+	{
+		return std::chrono::nanoseconds(SpinThreshold.load(std::memory_order_relaxed));
+	}
+
+	// Upper bound of the calibrated threshold, 0 only sleeps and leaves the whole oversleep
+	void SetMaxSpin(std::chrono::nanoseconds duration);
+
+	void ClearStatistics();
+
+	static constexpr std::chrono::microseconds kMinSpin{ 10 };
+	static constexpr std::chrono::microseconds kDefaultMaxSpin{ 2000 };
+
+private:
+	void Calibrate(std::chrono::nanoseconds oversleep);
+
+	LatencyHistogram Overshoot;
+	LatencyHistogram Undershoot;
+	std::atomic<int64_t> SpinThreshold; // ns
+	int64_t MaxSpin; // ns
+	int64_t OversleepMean; // ns, moving averages of the sleep lateness
+	int64_t OversleepDeviation;
+};
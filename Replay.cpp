@@ -0,0 +1,228 @@
+#include "Replay.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	constexpr char kLogMagic[8] = { '6', '5', '0', '2', 'E', 'V', 'T', '1' };
+
+	void AppendVarint(std::vector<uint8_t>& bytes, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			bytes.push_back(uint8_t(value | 0x80));
+			value >>= 7;
+		}
+		bytes.push_back(uint8_t(value));
+	}
+
+	bool ReadVarint(const std::vector<uint8_t>& bytes, size_t& position, uint64_t& value)
+	{
+		value = 0;
+		for (uint32_t shift = 0; shift < 64 && position < bytes.size(); shift += 7)
+		{
+			uint8_t byte = bytes[position++];
+			value |= uint64_t(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				return true;
+		}
+		return false;
+	}
+}
+
+EventLog::EventLog()
+	: Bytes()
+	, EventCount(0)
+	, LastCycle(0)
+{
+}
+
+void EventLog::Append(const ExternalEvent& event)
+{
+	assert(event.cycle >= LastCycle); // Events are logged in order
+	AppendVarint(Bytes, (event.cycle - LastCycle) << 1 | uint64_t(event.type));
+	if (event.type == ExternalEventType::Write)
+	{
+		Bytes.push_back(uint8_t(event.address));
+		Bytes.push_back(uint8_t(event.address >> 8));
+		Bytes.push_back(event.value);
+	}
+	LastCycle = event.cycle;
+	++EventCount;
+}
+
+bool EventLog::Save(const char* path) const
+{
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return false;
+	bool ok = fwrite(kLogMagic, sizeof(kLogMagic), 1, file) == 1
+		&& (Bytes.empty() || fwrite(Bytes.data(), Bytes.size(), 1, file) == 1);
+	return fclose(file) == 0 && ok;
+}
+
+bool EventLog::Load(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	char magic[sizeof(kLogMagic)];
+	std::vector<uint8_t> bytes;
+	bool ok = fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, kLogMagic, sizeof(magic)) == 0;
+	if (ok)
+	{
+		uint8_t buffer[4096];
+		size_t read;
+		while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+			bytes.insert(bytes.end(), buffer, buffer + read);
+		ok = !ferror(file);
+	}
+	fclose(file);
+	if (!ok)
+		return false;
+
+	// Decode it all to validate it and to be able to append to it
+	EventLog log;
+	log.Bytes = std::move(bytes);
+	Reader reader(log);
+	ExternalEvent event;
+	while (reader.Next(event))
+	{
+		++log.EventCount;
+		log.LastCycle = event.cycle;
+	}
+	if (!reader.IsAtEnd())
+		return false; // Truncated
+
+	*this = std::move(log);
+	return true;
+}
+
+EventLog::Reader::Reader(const EventLog& log)
+	: Bytes(log.Bytes)
+	, Position(0)
+	, Cycle(0)
+{
+}
+
+bool EventLog::Reader::Next(ExternalEvent& event)
+{
+	size_t position = Position;
+	uint64_t header;
+	if (!ReadVarint(Bytes, position, header))
+		return false;
+
+	event.cycle = Cycle + (header >> 1);
+	event.type = ExternalEventType(header & 1);
+	event.address = 0;
+	event.value = 0;
+	if (event.type == ExternalEventType::Write)
+	{
+		if (position + 3 > Bytes.size())
+			return false;
+		event.address = combineAddr(Bytes[position], Bytes[position + 1]);
+		event.value = Bytes[position + 2];
+		position += 3;
+	}
+
+	Position = position;
+	Cycle = event.cycle;
+	return true;
+}
+
+void ApplyExternalEvent(Cpu6502& cpu, Memory64k& mem, const ExternalEvent& event)
+{
+	switch (event.type)
+	{
+	case ExternalEventType::Write:
+		mem[event.address] = event.value;
+		cpu.InvalidateCode(event.address, 1);
+		break;
+	case ExternalEventType::Interrupt:
+		cpu.Interrupt();
+		break;
+	}
+}
+
+EventRecorder::EventRecorder(Cpu6502& cpu, Memory64k& mem)
+	: Cpu(cpu)
+	, Mem(mem)
+	, Cycles(0)
+	, Log()
+	, Posted()
+	, Applying()
+{
+}
+
+void EventRecorder::PostWrite(uint16_t address, uint8_t value)
+{
+	std::lock_guard<std::mutex> lock(PostedLock);
+	Posted.push_back({ 0, ExternalEventType::Write, address, value });
+}
+
+void EventRecorder::PostInterrupt()
+{
+	std::lock_guard<std::mutex> lock(PostedLock);
+	Posted.push_back({ 0, ExternalEventType::Interrupt, 0, 0 });
+}
+
+uint64_t EventRecorder::RunFor(uint64_t cycles)
+{
+	{
+		std::lock_guard<std::mutex> lock(PostedLock);
+		Applying.swap(Posted);
+	}
+	// The events take effect now, whenever they were posted
+	for (ExternalEvent& event : Applying)
+	{
+		event.cycle = Cycles;
+		ApplyExternalEvent(Cpu, Mem, event);
+		Log.Append(event);
+	}
+	Applying.clear();
+
+	uint64_t executed = Cpu.RunFor(Mem, cycles);
+	Cycles += executed;
+	return executed;
+}
+
+EventPlayer::EventPlayer(Cpu6502& cpu, Memory64k& mem, const EventLog& log)
+	: Cpu(cpu)
+	, Mem(mem)
+	, Cycles(0)
+	, Reader(log)
+	, NextEvent()
+	, HasEvent(false)
+{
+	HasEvent = Reader.Next(NextEvent);
+}
+
+void EventPlayer::ApplyEvents()
+{
+	// RunFor stops at the first instruction boundary after its limit, the same boundaries as the recording
+	while (HasEvent && NextEvent.cycle <= Cycles)
+	{
+		assert(NextEvent.cycle == Cycles); // Different initial state or log not from this program
+		ApplyExternalEvent(Cpu, Mem, NextEvent);
+		HasEvent = Reader.Next(NextEvent);
+	}
+}
+
+uint64_t EventPlayer::RunFor(uint64_t cycles)
+{
+	const uint64_t start = Cycles;
+	const uint64_t end = Cycles + cycles;
+	for (;;)
+	{
+		ApplyEvents();
+		if (Cycles >= end)
+			break;
+		uint64_t stop = HasEvent ? std::min(end, NextEvent.cycle) : end;
+		Cycles += Cpu.RunFor(Mem, stop - Cycles);
+	}
+	return Cycles - start;
+}
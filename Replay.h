@@ -0,0 +1,141 @@
+#pragma once
+
+// Deterministic record/replay of the events coming from outside the CPU: interrupt requests and
+// memory writes by the other chips. EventRecorder applies them between two runs of the CPU and logs
+// them with the emulated cycle they took effect at, EventPlayer applies them back at the same cycles,
+// without any pacing, so a replay from the same initial state is bit exact and as fast as the CPU runs.
+
+#include "6502.h"
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+enum class ExternalEventType : uint8_t
+{
+	Write,
+	Interrupt,
+};
+
+struct ExternalEvent
+{
+	uint64_t cycle;
+	ExternalEventType type;
+	uint16_t address; // Write only
+	uint8_t value; // Write only
+};
+
+// Compact binary log: each event is a varint of (cycles since the previous event << 1 | type),
+// followed by the address and value for the writes
+class EventLog
+{
+public:
+	EventLog();
+
+	void Append(const ExternalEvent& event);
+
+	size_t GetEventCount() const
+	{
+		return EventCount;
+	}
+
+	const std::vector<uint8_t>& GetBytes() const
+	{
+		return Bytes;
+	}
+
+	// Return false when the file can't be accessed or is not a valid log
+	bool Save(const char* path) const;
+	bool Load(const char* path);
+
+	// Sequential decoding
+	class Reader
+	{
+	public:
+		Reader(const EventLog& log);
+		bool Next(ExternalEvent& event);
+
+		bool IsAtEnd() const
+		{
+			return Position == Bytes.size();
+		}
+
+	private:
+		const std::vector<uint8_t>& Bytes;
+		size_t Position;
+		uint64_t Cycle;
+	};
+
+private:
+	std::vector<uint8_t> Bytes;
+	size_t EventCount;
+	uint64_t LastCycle;
+};
+
+class EventRecorder
+{
+public:
+	// Cycles are counted from here, the replay must start from the same machine state
+	EventRecorder(Cpu6502& cpu, Memory64k& mem);
+
+	// Thread safe, for the other chips. Applied at the start of the next RunFor.
+	void PostWrite(uint16_t address, uint8_t value);
+	void PostInterrupt();
+
+	// CPU thread: apply the posted events, then run the CPU like Cpu6502::RunFor
+	uint64_t RunFor(uint64_t cycles);
+
+	uint64_t GetCycles() const
+	{
+		return Cycles;
+	}
+
+	const EventLog& GetLog() const
+	{
+		return Log;
+	}
+
+private:
+	Cpu6502& Cpu;
+	Memory64k& Mem;
+	uint64_t Cycles;
+	EventLog Log;
+
+	std::mutex PostedLock;
+	std::vector<ExternalEvent> Posted;
+	std::vector<ExternalEvent> Applying; // Swapped with Posted, keeps both allocations
+};
+
+class EventPlayer
+{
+public:
+	// The machine must be in the state the recording started from
+	EventPlayer(Cpu6502& cpu, Memory64k& mem, const EventLog& log);
+
+	// Run the CPU like Cpu6502::RunFor, stopping at the cycle of each event to apply it
+	uint64_t RunFor(uint64_t cycles);
+
+	uint64_t GetCycles() const
+	{
+		return Cycles;
+	}
+
+	// All the events of the log were applied
+	bool IsFinished() const
+	{
+		return !HasEvent;
+	}
+
+private:
+	void ApplyEvents();
+
+	Cpu6502& Cpu;
+	Memory64k& Mem;
+	uint64_t Cycles;
+	EventLog::Reader Reader;
+	ExternalEvent NextEvent;
+	bool HasEvent;
+};
+
+// Shared by the recorder and the player so both apply the events the same way
+void ApplyExternalEvent(Cpu6502& cpu, Memory64k& mem, const ExternalEvent& event);
@@ -0,0 +1,174 @@
+#include "Scheduler.h"
+
+#include <algorithm>
+
+Machine::Machine(Cpu6502Model model, uint64_t frequency, Cpu6502Core core)
+	: MachineClock(frequency, ClockPacing::Virtual)
+	, Mem()
+	, Cpu(MachineClock, model, core)
+	, Cycles(0)
+	, CycleBudget(UINT64_MAX)
+	, StopCondition()
+	, Finished(false)
+{
+	Mem.Reset();
+}
+
+void Machine::Reset()
+{
+	// The memory got loaded from outside, the code cached by a previous run is stale
+	Cpu.InvalidateCode(0, kMemory64kSize);
+	Cpu.Reset(Mem);
+	Cycles = 0;
+	Finished = false;
+}
+
+bool Machine::RunSlice(uint64_t cycles)
+{
+	if (Finished)
+		return true;
+
+	// RunFor stops at an instruction boundary, a slice can go a few cycles past its end
+	uint64_t slice = std::min(cycles, CycleBudget - std::min(Cycles, CycleBudget));
+	Cycles += Cpu.RunFor(Mem, slice);
+	Finished = Cycles >= CycleBudget || (StopCondition && StopCondition(*this));
+	return Finished;
+}
+
+Scheduler::Scheduler(size_t workerCount, uint64_t sliceCycles)
+	: SliceCycles(sliceCycles)
+	, Workers()
+	, Generation(0)
+	, Unfinished(0)
+	, Idle(0)
+	, NextWorker(0)
+	, Steals(0)
+	, Stopping(false)
+{
+	if (workerCount == 0)
+		workerCount = std::max(1u, std::thread::hardware_concurrency());
+
+	for (size_t i = 0; i < workerCount; ++i)
+		Workers.push_back(std::make_unique<Worker>());
+	// All the workers must exist before any of them tries to steal
+	for (size_t i = 0; i < workerCount; ++i)
+		Workers[i]->Thread = std::thread(&Scheduler::WorkerLoop, this, i);
+}
+
+Scheduler::~Scheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(IdleLock);
+		Stopping = true;
+	}
+	WorkAvailable.notify_all();
+	for (std::unique_ptr<Worker>& worker : Workers)
+		worker->Thread.join();
+}
+
+void Scheduler::Add(Machine& machine)
+{
+	if (machine.IsFinished())
+		return;
+
+	++Unfinished;
+	Push(NextWorker++ % Workers.size(), &machine);
+	{
+		std::lock_guard<std::mutex> lock(IdleLock);
+		++Generation;
+	}
+	WorkAvailable.notify_one();
+}
+
+void Scheduler::Wait()
+{
+	std::unique_lock<std::mutex> lock(IdleLock);
+	AllFinished.wait(lock, [this]() { return Unfinished == 0; });
+}
+
+void Scheduler::Push(size_t index, Machine* machine)
+{
+	std::lock_guard<std::mutex> lock(Workers[index]->Lock);
+	Workers[index]->Queue.push_back(machine);
+}
+
+Machine* Scheduler::Pop(size_t index)
+{
+	std::lock_guard<std::mutex> lock(Workers[index]->Lock);
+	std::deque<Machine*>& queue = Workers[index]->Queue;
+	if (queue.empty())
+		return nullptr;
+	Machine* machine = queue.front();
+	queue.pop_front();
+	return machine;
+}
+
+Machine* Scheduler::Steal(size_t index)
+{
+	// Start after the thief so the victims are spread over the workers
+	for (size_t i = 1; i < Workers.size(); ++i)
+	{
+		Worker& victim = *Workers[(index + i) % Workers.size()];
+		std::lock_guard<std::mutex> lock(victim.Lock);
+		if (victim.Queue.empty())
+			continue;
+		Machine* machine = victim.Queue.back();
+		victim.Queue.pop_back();
+		++Steals;
+		return machine;
+	}
+	return nullptr;
+}
+
+void Scheduler::WorkerLoop(size_t index)
+{
+	Worker& worker = *Workers[index];
+	while (!Stopping)
+	{
+		// Read before looking for work, so work pushed after the search is not missed by the wait
+		uint64_t generation = Generation;
+
+		Machine* machine = Pop(index);
+		if (!machine)
+			machine = Steal(index);
+		if (!machine)
+		{
+			std::unique_lock<std::mutex> lock(IdleLock);
+			++Idle;
+			WorkAvailable.wait(lock, [&]() { return Stopping || Generation != generation; });
+			--Idle;
+			continue;
+		}
+
+		// A slice at a time until no other machine is waiting, this keeps the machines of the queue progressing together
+		bool finished;
+		size_t waiting;
+		do
+		{
+			finished = machine->RunSlice(SliceCycles);
+			std::lock_guard<std::mutex> lock(worker.Lock);
+			waiting = worker.Queue.size();
+		} while (!finished && waiting == 0 && !Stopping);
+
+		if (finished)
+		{
+			if (--Unfinished == 0)
+			{
+				std::lock_guard<std::mutex> lock(IdleLock);
+				AllFinished.notify_all();
+			}
+			continue;
+		}
+
+		Push(index, machine);
+		// Give the machines waiting in this queue to the idle workers
+		if (waiting > 0 && Idle > 0)
+		{
+			{
+				std::lock_guard<std::mutex> lock(IdleLock);
+				++Generation;
+			}
+			WorkAvailable.notify_one();
+		}
+	}
+}
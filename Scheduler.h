@@ -0,0 +1,124 @@
+#pragma once
+
+// Runs many independent machines over a fixed pool of worker threads.
+// Machines run in time slices measured in emulated cycles. Each worker owns a queue of machines
+// and runs them round robin, an idle worker steals machines from the queue of another worker.
+
+#include "6502.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A CPU with its own memory and unthrottled clock, the unit of work of the Scheduler
+class Machine
+{
+public:
+	Machine(Cpu6502Model model, uint64_t frequency = 1000000, Cpu6502Core core = CPU6502_DEFAULT_CORE);
+
+	Memory64k& GetMemory()
+	{
+		return Mem;
+	}
+
+	Cpu6502& GetCpu()
+	{
+		return Cpu;
+	}
+
+	// Cycles executed since the last Reset
+	uint64_t GetCycles() const
+	{
+		return Cycles;
+	}
+
+	bool IsFinished() const
+	{
+		return Finished;
+	}
+
+	// The machine stops once it executed that many cycles, unlimited by default
+	void SetCycleBudget(uint64_t cycles)
+	{
+		CycleBudget = cycles;
+	}
+
+	// Checked after every slice, the machine stops when it returns true
+	void SetStopCondition(std::function<bool(Machine&)> condition)
+	{
+		StopCondition = std::move(condition);
+	}
+
+	// Load the memory first, the CPU starts from the reset vector. A finished machine can be loaded and
+	// reset again, its cycles and budget start over.
+	void Reset();
+
+	// Run up to the given number of cycles, or less when the budget ends first. Returns true once finished.
+	bool RunSlice(uint64_t cycles);
+
+private:
+	Clock MachineClock;
+	Memory64k Mem;
+	Cpu6502 Cpu;
+	uint64_t Cycles;
+	uint64_t CycleBudget;
+	std::function<bool(Machine&)> StopCondition;
+	bool Finished;
+};
+
+class Scheduler
+{
+public:
+	// workerCount 0 uses one worker per hardware thread
+	Scheduler(size_t workerCount = 0, uint64_t sliceCycles = 10000);
+	~Scheduler();
+
+	// The machine is owned by the caller and must stay alive until it finished
+	void Add(Machine& machine);
+
+	// Block until all the added machines finished
+	void Wait();
+
+	size_t GetWorkerCount() const
+	{
+		return Workers.size();
+	}
+
+	// Machines taken from the queue of another worker
+	uint64_t GetSteals() const
+	{
+		return Steals;
+	}
+
+private:
+	struct Worker
+	{
+		std::mutex Lock;
+		std::deque<Machine*> Queue; // Owner runs the front, thieves take the back
+		std::thread Thread;
+	};
+
+	void WorkerLoop(size_t index);
+	Machine* Pop(size_t index);
+	Machine* Steal(size_t index);
+	void Push(size_t index, Machine* machine);
+
+	uint64_t SliceCycles;
+	std::vector<std::unique_ptr<Worker>> Workers;
+
+	std::mutex IdleLock;
+	std::condition_variable WorkAvailable; // Signaled on new work and on stop
+	std::condition_variable AllFinished;
+	std::atomic<uint64_t> Generation; // Bumped under IdleLock when work is pushed for the idle workers
+	std::atomic<size_t> Unfinished; // Machines added and not finished yet
+	std::atomic<size_t> Idle; // Workers waiting on WorkAvailable
+	std::atomic<size_t> NextWorker; // Add distributes the machines round robin
+	std::atomic<uint64_t> Steals;
+	std::atomic<bool> Stopping;
+};
@@ -0,0 +1,56 @@
+#include "TraceRing.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace
+{
+	size_t RoundUpPowerOfTwo(size_t value)
+	{
+		size_t power = 1;
+		while (power < value)
+			power *= 2;
+		return power;
+	}
+}
+
+TraceRing::TraceRing(size_t capacity)
+	: Records(new TraceRecord[RoundUpPowerOfTwo(std::max<size_t>(capacity, 1))])
+	, Mask(RoundUpPowerOfTwo(std::max<size_t>(capacity, 1)) - 1)
+	, Head(0)
+	, CachedTail(0)
+	, Dropped(0)
+	, Tail(0)
+{
+}
+
+size_t TraceRing::Drain(TraceRecord* records, size_t maxCount)
+{
+	const uint64_t tail = Tail.load(std::memory_order_relaxed);
+	const uint64_t head = Head.load(std::memory_order_acquire);
+	const size_t count = size_t(std::min<uint64_t>(head - tail, maxCount));
+	if (count == 0)
+		return 0;
+
+	// At most two runs, up to the end of the ring then from its start
+	const size_t start = size_t(tail & Mask);
+	const size_t first = std::min(count, GetCapacity() - start);
+	memcpy(records, &Records[start], first * sizeof(TraceRecord));
+	if (first < count)
+		memcpy(records + first, &Records[0], (count - first) * sizeof(TraceRecord));
+
+	// The producer can reuse the slots once Tail moved past them
+	Tail.store(tail + count, std::memory_order_release);
+	return count;
+}
+
+size_t TraceRing::Drain(std::vector<TraceRecord>& records, size_t maxCount)
+{
+	const uint64_t available = Head.load(std::memory_order_acquire) - Tail.load(std::memory_order_relaxed);
+	const size_t size = records.size();
+	records.resize(size + size_t(std::min<uint64_t>(available, maxCount)));
+	const size_t count = Drain(records.data() + size, records.size() - size);
+	assert(size + count == records.size()); // Only this thread moves Tail, the records can't go away
+	return count;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+// Trace of the memory accesses of the instructions, for debuggers and profilers running on another
+// thread. Build with CPU6502_TRACE=1 and attach a ring with Cpu6502::SetTrace: each access the
+// instructions do through the bus is pushed as a record, which the other thread drains at its pace.
+// The CPU never waits for the consumer, when the ring is full the records are dropped and counted.
+// Without CPU6502_TRACE the CPU has no trace code at all. The flag must be the same for all the files.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#ifndef CPU6502_TRACE
+#define CPU6502_TRACE 0
+#endif
+
+enum class TraceAccess : uint8_t
+{
+	Read,
+	Write
+};
+
+struct TraceRecord
+{
+	uint64_t cycle; // Clock cycle the instruction started at
+	uint16_t pc; // Address of the instruction
+	uint16_t address;
+	uint8_t value;
+	TraceAccess access;
+};
+
+// Lock-free ring with a single producer, the CPU, and a single consumer
+class TraceRing
+{
+public:
+	// capacity is rounded up to a power of two
+	explicit TraceRing(size_t capacity);
+
+	TraceRing(const TraceRing&) = delete;
+	TraceRing& operator = (const TraceRing&) = delete;
+
+	// Producer side, returns false when the ring is full and the record got dropped
+	bool Push(const TraceRecord& record)
+	{
+		const uint64_t head = Head.load(std::memory_order_relaxed);
+		if (head - CachedTail > Mask)
+		{
+			// Only reads the consumer index when the ring looks full, it's on another cache line
+			CachedTail = Tail.load(std::memory_order_acquire);
+			if (head - CachedTail > Mask)
+			{
+				Dropped.store(Dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+				return false;
+			}
+		}
+		Records[head & Mask] = record;
+		Head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side, oldest records first. Return the number of records drained.
+	size_t Drain(TraceRecord* records, size_t maxCount);
+	size_t Drain(std::vector<TraceRecord>& records, size_t maxCount = SIZE_MAX); // Appends
+
+	// Any thread
+	uint64_t GetDropped() const
+	{
+		return Dropped.load(std::memory_order_relaxed);
+	}
+
+	size_t GetCapacity() const
+	{
+		return size_t(Mask + 1);
+	}
+
+private:
+	std::unique_ptr<TraceRecord[]> Records;
+	uint64_t Mask;
+
+	// The indices only grow, each side on its own cache line
+	alignas(64) std::atomic<uint64_t> Head; // Next record pushed
+	uint64_t CachedTail; // Last Tail seen by the producer
+	std::atomic<uint64_t> Dropped;
+	alignas(64) std::atomic<uint64_t> Tail; // Next record drained
+};
@@ -0,0 +1,317 @@
+#pragma once
+
+// Minimal x86-64 machine code emitter, only covers what the 6502 JIT needs.
+// Registers are numbered like in the instruction encoding (RAX = 0 ... R15 = 15).
+// 8 bit operations on registers 4-7 always get a REX prefix so they address SPL/BPL/SIL/DIL.
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+
+class X64Emitter
+{
+public:
+	enum Reg : uint8_t
+	{
+		RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+		R8, R9, R10, R11, R12, R13, R14, R15,
+	};
+
+	enum Condition : uint8_t
+	{
+		kOverflow = 0x0,
+		kCarry = 0x2,
+		kNotCarry = 0x3,
+		kZero = 0x4,
+		kNotZero = 0x5,
+		kAbove = 0x7,
+		kSign = 0x8,
+	};
+
+	// Group 1 arithmetic operations, the value is the /digit of the 0x80/0x81 encodings
+	enum AluOp : uint8_t
+	{
+		kAdd = 0, kOr = 1, kAdc = 2, kSbb = 3, kAnd = 4, kSub = 5, kXor = 6, kCmp = 7,
+	};
+
+	// Group 2 shifts and rotates (/digit of 0xD0)
+	enum ShiftOp : uint8_t
+	{
+		kRol = 0, kRor = 1, kRcl = 2, kRcr = 3, kShl = 4, kShr = 5,
+	};
+
+	// Forward jump whose target is set later with Bind
+	struct Label
+	{
+		size_t fixup;
+	};
+
+	X64Emitter(uint8_t* buffer, size_t capacity)
+		: Buffer(buffer)
+		, Capacity(capacity)
+		, Size(0)
+		, Overflow(false)
+	{
+	}
+
+	size_t GetSize() const { return Size; }
+	bool HasOverflowed() const { return Overflow; }
+	size_t Here() const { return Size; }
+
+	// movzx dst32, byte [base + disp]
+	void MovzxLoad8(Reg dst, Reg base, int32_t disp) { RegMem({ 0x0F, 0xB6 }, dst, base, disp, false, false); }
+
+	// movzx dst32, byte [base + index]
+	void MovzxLoad8Indexed(Reg dst, Reg base, Reg index) { RegMemIndex({ 0x0F, 0xB6 }, dst, base, index); }
+
+	// mov byte [base + disp], src8
+	void Store8(Reg base, int32_t disp, Reg src) { RegMem({ 0x88 }, src, base, disp, false, true); }
+
+	// movzx dst32, src8
+	void Movzx8(Reg dst, Reg src) { RegReg({ 0x0F, 0xB6 }, dst, src, false, true); }
+
+	// mov dst32, src32
+	void Mov32(Reg dst, Reg src) { RegReg({ 0x8B }, dst, src, false, false); }
+
+	// mov dst64, src64
+	void Mov64(Reg dst, Reg src) { RegReg({ 0x8B }, dst, src, true, false); }
+
+	// mov dst32, imm32
+	void MovImm32(Reg dst, uint32_t imm)
+	{
+		Rex(false, 0, 0, dst, false);
+		Byte(0xB8 + (dst & 7));
+		Dword(imm);
+	}
+
+	// mov dst64, imm64
+	void MovImm64(Reg dst, uint64_t imm)
+	{
+		Rex(true, 0, 0, dst, false);
+		Byte(0xB8 + (dst & 7));
+		Dword(uint32_t(imm));
+		Dword(uint32_t(imm >> 32));
+	}
+
+	// op dst8, imm8
+	void Alu8Imm(AluOp op, Reg dst, uint8_t imm)
+	{
+		RegReg({ 0x80 }, Reg(op), dst, false, true);
+		Byte(imm);
+	}
+
+	// op dst8, src8
+	void Alu8(AluOp op, Reg dst, Reg src) { RegReg({ uint8_t(op << 3) }, src, dst, false, true); }
+
+	// op dst32, imm32
+	void Alu32Imm(AluOp op, Reg dst, uint32_t imm)
+	{
+		RegReg({ 0x81 }, Reg(op), dst, false, false);
+		Dword(imm);
+	}
+
+	// op dst32, src32
+	void Alu32(AluOp op, Reg dst, Reg src) { RegReg({ uint8_t((op << 3) | 1) }, src, dst, false, false); }
+
+	// mov byte [base + disp], imm8
+	void Store8Imm(Reg base, int32_t disp, uint8_t imm)
+	{
+		RegMem({ 0xC6 }, Reg(0), base, disp, false, false);
+		Byte(imm);
+	}
+
+	// op dst64, imm32 (sign extended)
+	void Alu64Imm(AluOp op, Reg dst, int32_t imm)
+	{
+		RegReg({ 0x81 }, Reg(op), dst, true, false);
+		Dword(uint32_t(imm));
+	}
+
+	// cmp byte [base + disp], imm8
+	void Cmp8MemImm(Reg base, int32_t disp, uint8_t imm)
+	{
+		RegMem({ 0x80 }, Reg(kCmp), base, disp, false, false);
+		Byte(imm);
+	}
+
+	// add qword [base + disp], imm32
+	void Add64MemImm(Reg base, int32_t disp, int32_t imm)
+	{
+		RegMem({ 0x81 }, Reg(kAdd), base, disp, true, false);
+		Dword(uint32_t(imm));
+	}
+
+	// mov dst64, qword [base + disp]
+	void Load64(Reg dst, Reg base, int32_t disp) { RegMem({ 0x8B }, dst, base, disp, true, false); }
+
+	// cmp src64, qword [base + disp]
+	void Cmp64Mem(Reg src, Reg base, int32_t disp) { RegMem({ 0x3B }, src, base, disp, true, false); }
+
+	// mov word [base + disp], imm16
+	void Store16Imm(Reg base, int32_t disp, uint16_t imm)
+	{
+		Byte(0x66);
+		RegMem({ 0xC7 }, Reg(0), base, disp, false, false);
+		Byte(uint8_t(imm));
+		Byte(uint8_t(imm >> 8));
+	}
+
+	// bt dword [base + disp], bit (loads the bit into CF)
+	void BitTestMem(Reg base, int32_t disp, uint8_t bit)
+	{
+		RegMem({ 0x0F, 0xBA }, Reg(4), base, disp, false, false);
+		Byte(bit);
+	}
+
+	// setcc byte [base + disp]
+	void SetccMem(Condition condition, Reg base, int32_t disp) { RegMem({ 0x0F, uint8_t(0x90 | condition) }, Reg(0), base, disp, false, false); }
+
+	// test dst32, imm32
+	void TestImm32(Reg dst, uint32_t imm)
+	{
+		RegReg({ 0xF7 }, Reg(0), dst, false, false);
+		Dword(imm);
+	}
+
+	// test a32, b32
+	void Test32(Reg a, Reg b) { RegReg({ 0x85 }, b, a, false, false); }
+
+	// shift/rotate dst8 by 1
+	void Shift8(ShiftOp op, Reg dst) { RegReg({ 0xD0 }, Reg(op), dst, false, true); }
+
+	// inc/dec dst32
+	void Inc32(Reg dst) { RegReg({ 0xFF }, Reg(0), dst, false, false); }
+	void Dec32(Reg dst) { RegReg({ 0xFF }, Reg(1), dst, false, false); }
+
+	// inc/dec dst8
+	void Inc8(Reg dst) { RegReg({ 0xFE }, Reg(0), dst, false, true); }
+	void Dec8(Reg dst) { RegReg({ 0xFE }, Reg(1), dst, false, true); }
+
+	// Complement carry flag
+	void Cmc() { Byte(0xF5); }
+
+	void Push(Reg reg)
+	{
+		Rex(false, 0, 0, reg, false);
+		Byte(0x50 + (reg & 7));
+	}
+
+	void Pop(Reg reg)
+	{
+		Rex(false, 0, 0, reg, false);
+		Byte(0x58 + (reg & 7));
+	}
+
+	void SubRsp(uint8_t imm) { Byte(0x48); Byte(0x83); Byte(0xEC); Byte(imm); }
+	void AddRsp(uint8_t imm) { Byte(0x48); Byte(0x83); Byte(0xC4); Byte(imm); }
+
+	// call reg64
+	void Call(Reg reg) { RegReg({ 0xFF }, Reg(2), reg, false, false); }
+
+	void Ret() { Byte(0xC3); }
+
+	// Jumps to a position already emitted
+	void Jmp(size_t target)
+	{
+		Byte(0xE9);
+		Rel32(target);
+	}
+
+	// Jumps to a position emitted later, resolved by Bind
+	Label Jmp()
+	{
+		Byte(0xE9);
+		return ForwardRel32();
+	}
+
+	Label Jcc(Condition condition, bool negate = false)
+	{
+		Byte(0x0F);
+		Byte(0x80 | (condition ^ (negate ? 1 : 0)));
+		return ForwardRel32();
+	}
+
+	void Bind(Label label) { Bind(label, Size); }
+
+	void Bind(Label label, size_t target)
+	{
+		if (Overflow)
+			return;
+		int32_t rel = int32_t(int64_t(target) - int64_t(label.fixup + 4));
+		memcpy(Buffer + label.fixup, &rel, 4);
+	}
+
+private:
+	void Byte(uint8_t value)
+	{
+		if (Size < Capacity)
+			Buffer[Size] = value;
+		else
+			Overflow = true;
+		++Size;
+	}
+
+	void Dword(uint32_t value)
+	{
+		for (int i = 0; i < 4; ++i)
+			Byte(uint8_t(value >> (i * 8)));
+	}
+
+	void Rel32(size_t target) { Dword(uint32_t(int32_t(int64_t(target) - int64_t(Size + 4)))); }
+
+	Label ForwardRel32()
+	{
+		Label label = { Size };
+		Dword(0);
+		return label;
+	}
+
+	void Rex(bool w, uint8_t reg, uint8_t index, uint8_t rm, bool force)
+	{
+		uint8_t rex = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((index & 8) ? 2 : 0) | ((rm & 8) ? 1 : 0);
+		if (rex != 0x40 || force)
+			Byte(rex);
+	}
+
+	void Opcode(std::initializer_list<uint8_t> opcode)
+	{
+		for (uint8_t value : opcode)
+			Byte(value);
+	}
+
+	// Register to register form, reg goes in ModRM.reg and rm in ModRM.rm
+	void RegReg(std::initializer_list<uint8_t> opcode, Reg reg, Reg rm, bool w, bool byteRegs)
+	{
+		bool force = byteRegs && ((reg >= 4 && reg <= 7) || (rm >= 4 && rm <= 7));
+		Rex(w, reg, 0, rm, force);
+		Opcode(opcode);
+		Byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+	}
+
+	// [base + disp32] form, base can't be RSP/R12 (would need a SIB byte)
+	void RegMem(std::initializer_list<uint8_t> opcode, Reg reg, Reg base, int32_t disp, bool w, bool byteReg)
+	{
+		assert((base & 7) != 4);
+		bool force = byteReg && reg >= 4 && reg <= 7;
+		Rex(w, reg, 0, base, force);
+		Opcode(opcode);
+		Byte(0x80 | ((reg & 7) << 3) | (base & 7));
+		Dword(uint32_t(disp));
+	}
+
+	// [base + index] form, base can't be RBP/R13 (would need a displacement)
+	void RegMemIndex(std::initializer_list<uint8_t> opcode, Reg reg, Reg base, Reg index)
+	{
+		assert((base & 7) != 5 && (index & 7) != 4);
+		Rex(false, reg, index, base, false);
+		Opcode(opcode);
+		Byte(((reg & 7) << 3) | 4);
+		Byte(((index & 7) << 3) | (base & 7));
+	}
+
+	uint8_t* Buffer;
+	size_t Capacity;
+	size_t Size;
+	bool Overflow;
+};
@@ -1,29 +1,87 @@
 #include "6502.h"
+#include "Fuzz.h"
+#include "Loader.h"
 
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <thread>
 
-int main()
+namespace
 {
+	bool HasExtension(const char* path, const char* extension)
+	{
+		const size_t length = strlen(path);
+		const size_t extensionLength = strlen(extension);
+		if (length < extensionLength)
+			return false;
+		for (size_t i = 0; i < extensionLength; ++i)
+		{
+			if (tolower(path[length - extensionLength + i]) != extension[i])
+				return false;
+		}
+		return true;
+	}
+
+	// .prg and Intel HEX files hold their address, any other file is a ROM ending at $FFFF, with the vectors
+	bool LoadImage(ProgramImage& image, const char* path)
+	{
+		if (HasExtension(path, ".prg"))
+			return image.LoadPrg(path);
+		if (HasExtension(path, ".hex") || HasExtension(path, ".ihx"))
+			return image.LoadIntelHex(path);
+		std::error_code error;
+		const uintmax_t size = std::filesystem::file_size(path, error);
+		return !error && size <= kMemory64kSize && image.LoadRaw(path, uint16_t(kMemory64kSize - size));
+	}
+}
+
+int main(int argc, char** argv)
+{
+	// 6502 --fuzz [seed] [programs]: compares the execution paths on random programs
+	if (argc > 1 && strcmp(argv[1], "--fuzz") == 0)
+	{
+		const uint32_t seed = argc > 2 ? uint32_t(strtoul(argv[2], nullptr, 0)) : 1;
+		const uint32_t programs = argc > 3 ? uint32_t(strtoul(argv[3], nullptr, 0)) : 1000;
+		const uint32_t failures = FuzzExecuteCycle(seed, programs) + FuzzCores(seed, programs);
+		printf("%u programs, %u failures\n", programs, failures);
+		return failures == 0 ? 0 : 1;
+	}
+
 	Clock clock(1000000);
 	Memory64k mem;
 	mem.Reset();
 
-	// Todo preload a real program in Memory64k !
-	mem[0xFFFC] = 0x00;
-	mem[0xFFFD] = 0x60;
-	mem[0x6000] = 0xA9;
-	mem[0x6001] = 0x99;
+	ProgramImage image;
+	if (argc > 1)
+	{
+		if (!LoadImage(image, argv[1]))
+		{
+			fprintf(stderr, "Can't load %s\n", argv[1]);
+			return 1;
+		}
+		image.MapRom(mem);
+	}
+	else
+	{
+		mem[0xFFFC] = 0x00;
+		mem[0xFFFD] = 0x60;
+		mem[0x6000] = 0xA9;
+		mem[0x6001] = 0x99;
+	}
 
 	Cpu6502 cpu(clock, Cpu6502Model::Original);
 	std::thread cpuThread([&]()
 		{
 			cpu.Reset(mem);
 			clock.Start();
+			// A quantum of cycles flat out, then wait for real time to catch up
 			while (true)
 			{
-				clock.WaitForNextCycle();
-				cpu.ExecuteCycle(mem);
-				clock.NextCycle();
+				cpu.RunFor(mem, clock.CyclesUntilSync());
+				clock.Sync();
 			}
 		});
 